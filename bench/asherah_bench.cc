@@ -0,0 +1,226 @@
+// Native microbenchmarks for the Cobhan buffer and marshaling helpers,
+// without Node or libasherah in the loop.  Build with
+// cmake -DASHERAH_BUILD_BENCH=ON and run build/asherah_bench.
+
+#include "asherah_output_size.h"
+#include "base64.h"
+#include "cobhan_buffer.h"
+#include "drr_scanner.h"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Exposes the canary check, which is protected
+class BenchBuffer : public CobhanBuffer {
+public:
+  using CobhanBuffer::CobhanBuffer;
+  using CobhanBuffer::verify_canaries;
+};
+
+// Payload sizes from a short string to past the largest pool size class,
+// each with and without canaries
+void PayloadArgs(benchmark::internal::Benchmark *bench) {
+  bench->ArgNames({"bytes", "canaries"});
+  for (int64_t size = 64; size <= (int64_t{1} << 22); size *= 16) {
+    bench->Args({size, 0});
+    bench->Args({size, 1});
+  }
+}
+
+void PayloadSizes(benchmark::internal::Benchmark *bench) {
+  bench->ArgName("bytes");
+  for (int64_t size = 64; size <= (int64_t{1} << 22); size *= 16) {
+    bench->Arg(size);
+  }
+}
+
+size_t SetUp(benchmark::State &state) {
+  CobhanBuffer::SetCanariesEnabled(state.range(1) != 0);
+  return static_cast<size_t>(state.range(0));
+}
+
+void SetPayloadProcessed(benchmark::State &state, size_t size) {
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(size));
+}
+
+// A DRR in EncryptToJson's layout for size bytes of plaintext
+std::string MakeDrr(size_t size) {
+  // A 32 byte data row key plus its 12 byte nonce and 16 byte tag
+  std::string key(AsherahOutputSize::Base64EncodedLength(60), 'k');
+  std::vector<char> ciphertext(size + 28, 'c');
+  std::string data(Base64::EncodedLength(ciphertext.size()), '\0');
+  Base64::Encode(ciphertext.data(), ciphertext.size(), &data[0]);
+  return "{\"Key\":{\"Created\":1700000000,\"Key\":\"" + key +
+         "\",\"ParentKeyMeta\":{\"KeyId\":\"_IK_partition_service_product\","
+         "\"Created\":1700000000}},\"Data\":\"" +
+         data + "\"}";
+}
+
+void BM_DataSizeToAllocationSize(benchmark::State &state) {
+  size_t size = static_cast<size_t>(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(size);
+    benchmark::DoNotOptimize(CobhanBuffer::DataSizeToAllocationSize(size));
+  }
+}
+BENCHMARK(BM_DataSizeToAllocationSize)->Apply(PayloadSizes);
+
+// Pooled heap buffer: Acquire, initialize, verify and Release (which wipes
+// the block)
+void BM_ConstructPooled(benchmark::State &state) {
+  size_t size = SetUp(state);
+  for (auto _ : state) {
+    BenchBuffer buffer(size);
+    benchmark::DoNotOptimize(buffer.get_data_ptr());
+  }
+  SetPayloadProcessed(state, size);
+}
+BENCHMARK(BM_ConstructPooled)->Apply(PayloadArgs);
+
+// Caller-provided (stack) memory: initialize and verify only
+void BM_ConstructWrapped(benchmark::State &state) {
+  size_t size = SetUp(state);
+  std::vector<char> memory(CobhanBuffer::DataSizeToAllocationSize(size));
+  for (auto _ : state) {
+    BenchBuffer buffer(memory.data(), memory.size());
+    benchmark::DoNotOptimize(buffer.get_data_ptr());
+  }
+}
+BENCHMARK(BM_ConstructWrapped)->Apply(PayloadArgs);
+
+void BM_VerifyCanaries(benchmark::State &state) {
+  size_t size = SetUp(state);
+  BenchBuffer buffer(size);
+  for (auto _ : state) {
+    buffer.verify_canaries();
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_VerifyCanaries)->Apply(PayloadArgs);
+
+// Moving an owned buffer hands over the pointer
+void BM_MoveOwned(benchmark::State &state) {
+  size_t size = SetUp(state);
+  BenchBuffer buffer(size);
+  for (auto _ : state) {
+    BenchBuffer moved(std::move(buffer));
+    buffer = std::move(moved);
+    benchmark::DoNotOptimize(buffer.get_data_ptr());
+  }
+}
+BENCHMARK(BM_MoveOwned)->Apply(PayloadArgs);
+
+// Wrapping a stack buffer and moving it into an async worker, which copies
+// it to the pool
+void BM_MoveFromStack(benchmark::State &state) {
+  size_t size = SetUp(state);
+  std::vector<char> memory(CobhanBuffer::DataSizeToAllocationSize(size), 'x');
+  for (auto _ : state) {
+    BenchBuffer stack(memory.data(), memory.size());
+    BenchBuffer moved(std::move(stack));
+    benchmark::DoNotOptimize(moved.get_data_ptr());
+  }
+  SetPayloadProcessed(state, size);
+}
+BENCHMARK(BM_MoveFromStack)->Apply(PayloadArgs);
+
+// Asherah::EstimateAsherahOutputSize: escaped partition length plus the
+// DRR size arithmetic
+void BM_EstimateEncryptOutputSize(benchmark::State &state) {
+  size_t size = static_cast<size_t>(state.range(0));
+  std::string partition = "partition-<tenant>-" + std::to_string(size);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(AsherahOutputSize::EncryptOutputSize(
+        size,
+        AsherahOutputSize::JsonEscapedLength(partition.data(),
+                                             partition.size()),
+        32));
+  }
+}
+BENCHMARK(BM_EstimateEncryptOutputSize)->Apply(PayloadSizes);
+
+void BM_EstimateDecryptOutputSize(benchmark::State &state) {
+  std::string drr = MakeDrr(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        AsherahOutputSize::DecryptOutputSize(drr.data(), drr.size()));
+  }
+  SetPayloadProcessed(state, drr.size());
+}
+BENCHMARK(BM_EstimateDecryptOutputSize)->Apply(PayloadSizes);
+
+void BM_DrrScan(benchmark::State &state) {
+  std::string drr = MakeDrr(static_cast<size_t>(state.range(0)));
+  DrrScanner::Fields fields;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(DrrScanner::Scan(drr.data(), drr.size(), fields));
+  }
+  SetPayloadProcessed(state, drr.size());
+}
+BENCHMARK(BM_DrrScan)->Apply(PayloadSizes);
+
+// Payload sizes for every base64 kernel this CPU supports
+void KernelArgs(benchmark::internal::Benchmark *bench) {
+  bench->ArgNames({"bytes", "kernel"});
+  for (auto kernel : {Base64::Kernel::Scalar, Base64::Kernel::Sse41,
+                      Base64::Kernel::Avx2, Base64::Kernel::Neon}) {
+    if (!Base64::Supported(kernel)) {
+      continue;
+    }
+    for (int64_t size = 64; size <= (int64_t{1} << 22); size *= 16) {
+      bench->Args({size, static_cast<int64_t>(kernel)});
+    }
+  }
+}
+
+Base64::Kernel SetUpKernel(benchmark::State &state) {
+  auto kernel = static_cast<Base64::Kernel>(state.range(1));
+  state.SetLabel(Base64::KernelName(kernel));
+  return kernel;
+}
+
+void BM_Base64Encode(benchmark::State &state) {
+  size_t size = static_cast<size_t>(state.range(0));
+  Base64::Kernel kernel = SetUpKernel(state);
+  std::vector<char> input(size, 'x');
+  std::vector<char> output(Base64::EncodedLength(size));
+  for (auto _ : state) {
+    Base64::Encode(kernel, input.data(), size, output.data());
+    benchmark::ClobberMemory();
+  }
+  SetPayloadProcessed(state, size);
+}
+BENCHMARK(BM_Base64Encode)->Apply(KernelArgs);
+
+void BM_Base64Decode(benchmark::State &state) {
+  size_t size = static_cast<size_t>(state.range(0));
+  Base64::Kernel kernel = SetUpKernel(state);
+  std::vector<char> plain(size, 'x');
+  std::vector<char> encoded(Base64::EncodedLength(size));
+  Base64::Encode(plain.data(), size, encoded.data());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Base64::Decode(kernel, encoded.data(),
+                                            encoded.size(), plain.data()));
+  }
+  SetPayloadProcessed(state, encoded.size());
+}
+BENCHMARK(BM_Base64Decode)->Apply(KernelArgs);
+
+void BM_Base64Validate(benchmark::State &state) {
+  size_t size = static_cast<size_t>(state.range(0));
+  Base64::Kernel kernel = SetUpKernel(state);
+  std::vector<char> plain(size, 'x');
+  std::vector<char> encoded(Base64::EncodedLength(size));
+  Base64::Encode(plain.data(), size, encoded.data());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        Base64::Validate(kernel, encoded.data(), encoded.size()));
+  }
+  SetPayloadProcessed(state, encoded.size());
+}
+BENCHMARK(BM_Base64Validate)->Apply(KernelArgs);
+
+} // namespace
@@ -1,8 +1,13 @@
 {
+  'variables': {
+    # 1 links the null-crypto stub/libasherah_stub.c instead of
+    # lib/libasherah.a (ASHERAH_STUB=1 scripts/build.sh)
+    'asherah_stub%': 0,
+  },
   'targets': [
       {
       'target_name': 'asherah',
-      'include_dirs': ["<!(node -p \"require('node-addon-api').include_dir\")", "lib/", "src/"],
+      'include_dirs': ["<!(node -p \"require('node-addon-api').include_dir\")", "src/"],
       "cflags": ["-fexceptions", "-g", "-O3", "-std=c++17", "-fPIC", "-Wno-unknown-pragmas"],
       "cflags_cc": ["-fexceptions", "-g", "-O3", "-std=c++17", "-fPIC", "-Wno-unknown-pragmas"],
       "cflags!": [ "-fno-exceptions"],
@@ -27,10 +32,27 @@
         ],
       'sources': [
         'src/asherah.cc',
+        'src/base64.cc',
         'src/logging_napi.cc',
         'src/logging_stderr.cc'
       ],
-      'libraries': [ '../lib/libasherah.a' ]
+      'conditions': [
+        ['asherah_stub==1', {
+          'include_dirs': [ 'stub/' ],
+          'sources': [ 'stub/libasherah_stub.c' ],
+          'defines': [ 'ASHERAH_STUB' ],
+          'cflags!': [ '-std=c++17' ],
+          'cflags_c': [ '-std=c17' ],
+          'xcode_settings': {
+            'OTHER_CFLAGS!': [ '-std=c++17' ],
+            'CLANG_CXX_LANGUAGE_STANDARD': 'c++17',
+            'GCC_C_LANGUAGE_STANDARD': 'c17',
+          },
+        }, {
+          'include_dirs': [ 'lib/' ],
+          'libraries': [ '../lib/libasherah.a' ],
+        }],
+      ],
     }
   ]
 }
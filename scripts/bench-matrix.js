@@ -0,0 +1,331 @@
+// Benchmark matrix: every API x sync/async x payload size x concurrency,
+// written as JSON and optionally compared against a baseline run.
+//
+//   node scripts/bench-matrix.js --output results.json
+//   node scripts/bench-matrix.js --baseline results.json --fail-on-regression
+//
+// Uses the test-debug-static KMS and test-debug-memory metastore, so it needs
+// no network.  Build with ASHERAH_STUB=1 to measure the binding alone.
+
+const asherah = require('../dist/asherah.node');
+const crypto = require('crypto');
+const fs = require('fs');
+const os = require('os');
+const { monitorEventLoopDelay } = require('perf_hooks');
+
+const KB = 1024;
+const MB = 1024 * KB;
+
+const DEFAULTS = {
+  apis: ['encrypt_string', 'encrypt', 'decrypt_string', 'decrypt'],
+  modes: ['sync', 'async'],
+  sizes: [64, KB, 16 * KB, 256 * KB, 4 * MB, 64 * MB],
+  concurrency: [1, 8, 64],
+  duration: 2000,
+  warmup: 250,
+  minOps: 5,
+  maxInflightBytes: 1024 * MB,
+  threshold: 5,
+  partition: 'bench-partition',
+};
+
+const CONFIG = {
+  KMS: 'test-debug-static',
+  Metastore: 'test-debug-memory',
+  ServiceName: 'BenchService',
+  ProductID: 'BenchProduct',
+  Verbose: false,
+  EnableSessionCaching: true,
+  SessionCacheMaxSize: 1000,
+};
+
+function usage() {
+  console.log(`Usage: node scripts/bench-matrix.js [options]
+  --apis a,b          ${DEFAULTS.apis.join(',')}
+  --modes a,b         ${DEFAULTS.modes.join(',')}
+  --sizes n,n         payload bytes, with k/m suffixes (default 64..64m)
+  --concurrency n,n   in-flight async calls (default ${DEFAULTS.concurrency.join(',')}); sync runs at 1
+  --duration ms       measured time per cell (default ${DEFAULTS.duration})
+  --warmup ms         unmeasured time per cell (default ${DEFAULTS.warmup})
+  --min-ops n         minimum measured calls per cell (default ${DEFAULTS.minOps})
+  --max-inflight size skip cells whose size x concurrency exceeds this (default 1g)
+  --output file       write results JSON
+  --baseline file     compare against an earlier results JSON
+  --threshold pct     change counted as a regression (default ${DEFAULTS.threshold})
+  --fail-on-regression  exit 1 if any cell regressed
+  --quick             64,16k,1m sizes, concurrency 1,16, 500ms cells`);
+}
+
+function parseSize(text) {
+  const match = /^(\d+)([kmg]?)$/i.exec(text.trim());
+  if (!match) {
+    throw new Error(`Bad size: ${text}`);
+  }
+  const unit = { '': 1, k: KB, m: MB, g: 1024 * MB }[match[2].toLowerCase()];
+  return Number(match[1]) * unit;
+}
+
+function parseArgs(argv) {
+  const options = { ...DEFAULTS, output: null, baseline: null, failOnRegression: false };
+  for (let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    const value = () => {
+      if (i + 1 >= argv.length) {
+        throw new Error(`${arg} needs a value`);
+      }
+      return argv[++i];
+    };
+    switch (arg) {
+      case '--apis': options.apis = value().split(','); break;
+      case '--modes': options.modes = value().split(','); break;
+      case '--sizes': options.sizes = value().split(',').map(parseSize); break;
+      case '--concurrency': options.concurrency = value().split(',').map(Number); break;
+      case '--duration': options.duration = Number(value()); break;
+      case '--warmup': options.warmup = Number(value()); break;
+      case '--min-ops': options.minOps = Number(value()); break;
+      case '--max-inflight': options.maxInflightBytes = parseSize(value()); break;
+      case '--output': options.output = value(); break;
+      case '--baseline': options.baseline = value(); break;
+      case '--threshold': options.threshold = Number(value()); break;
+      case '--fail-on-regression': options.failOnRegression = true; break;
+      case '--quick':
+        options.sizes = [64, 16 * KB, MB];
+        options.concurrency = [1, 16];
+        options.duration = 500;
+        options.warmup = 100;
+        break;
+      case '--help': usage(); process.exit(0); break;
+      default: throw new Error(`Unknown option: ${arg}`);
+    }
+  }
+  for (const api of options.apis) {
+    if (!DEFAULTS.apis.includes(api)) {
+      throw new Error(`Unknown API: ${api}`);
+    }
+  }
+  return options;
+}
+
+function formatSize(bytes) {
+  if (bytes >= MB && bytes % MB === 0) return `${bytes / MB}MB`;
+  if (bytes >= KB && bytes % KB === 0) return `${bytes / KB}KB`;
+  return `${bytes}B`;
+}
+
+// The call under test and its argument for one API and payload size
+function prepare(api, size, partition) {
+  const bytes = crypto.randomBytes(size);
+  // Base64 keeps the string ASCII, so its UTF-8 length is size
+  const text = bytes.toString('base64').slice(0, size);
+  switch (api) {
+    case 'encrypt_string':
+      return { sync: asherah.encrypt_string, async: asherah.encrypt_string_async, input: text };
+    case 'encrypt':
+      return { sync: asherah.encrypt, async: asherah.encrypt_async, input: bytes };
+    case 'decrypt_string':
+      return { sync: asherah.decrypt_string, async: asherah.decrypt_string_async,
+               input: asherah.encrypt_string(partition, text) };
+    case 'decrypt':
+      return { sync: asherah.decrypt, async: asherah.decrypt_async,
+               input: asherah.encrypt(partition, bytes) };
+  }
+}
+
+// Latencies in nanoseconds, kept in a growable typed array
+class Samples {
+  constructor() {
+    this.values = new Float64Array(1024);
+    this.length = 0;
+  }
+
+  push(ns) {
+    if (this.length === this.values.length) {
+      const grown = new Float64Array(this.values.length * 2);
+      grown.set(this.values);
+      this.values = grown;
+    }
+    this.values[this.length++] = ns;
+  }
+
+  percentile(sorted, q) {
+    if (this.length === 0) return 0;
+    return sorted[Math.min(this.length - 1, Math.ceil(q * this.length) - 1)];
+  }
+
+  summary() {
+    const sorted = this.values.subarray(0, this.length).sort();
+    return {
+      p50_us: this.percentile(sorted, 0.5) / 1e3,
+      p99_us: this.percentile(sorted, 0.99) / 1e3,
+    };
+  }
+}
+
+const now = () => Number(process.hrtime.bigint());
+const yieldToLoop = () => new Promise(resolve => setImmediate(resolve));
+
+// Runs sync calls until deadline, yielding every few ms so the event loop
+// delay monitor sees how long the loop was blocked
+async function runSync(call, partition, input, durationMs, minOps, samples) {
+  const deadline = now() + durationMs * 1e6;
+  let ops = 0;
+  while (now() < deadline || ops < minOps) {
+    const sliceEnd = now() + 5e6;
+    do {
+      const start = now();
+      call(partition, input);
+      samples?.push(now() - start);
+      ops++;
+    } while (now() < sliceEnd && (now() < deadline || ops < minOps));
+    await yieldToLoop();
+  }
+  return ops;
+}
+
+// Closed loop: concurrency workers, each issuing its next call as soon as
+// the previous one settles
+async function runAsync(call, partition, input, durationMs, minOps, concurrency, samples) {
+  const deadline = now() + durationMs * 1e6;
+  let ops = 0;
+  const worker = async () => {
+    while (now() < deadline || ops < minOps) {
+      const start = now();
+      await call(partition, input);
+      samples?.push(now() - start);
+      ops++;
+    }
+  };
+  await Promise.all(Array.from({ length: concurrency }, worker));
+  return ops;
+}
+
+async function runCell(options, api, mode, size, concurrency) {
+  const target = prepare(api, size, options.partition);
+  const run = (durationMs, minOps, samples) => mode === 'sync'
+    ? runSync(target.sync, options.partition, target.input, durationMs, minOps, samples)
+    : runAsync(target.async, options.partition, target.input, durationMs, minOps, concurrency, samples);
+
+  await run(options.warmup, 1, null);
+
+  const samples = new Samples();
+  const eventLoopDelay = monitorEventLoopDelay({ resolution: 1 });
+  eventLoopDelay.enable();
+  const start = now();
+  const ops = await run(options.duration, options.minOps, samples);
+  const elapsedSeconds = (now() - start) / 1e9;
+  eventLoopDelay.disable();
+
+  return {
+    api, mode, size, concurrency, ops,
+    ops_per_sec: ops / elapsedSeconds,
+    mb_per_sec: ops * size / MB / elapsedSeconds,
+    ...samples.summary(),
+    event_loop_delay_ms: {
+      p50: eventLoopDelay.percentile(50) / 1e6,
+      p99: eventLoopDelay.percentile(99) / 1e6,
+      max: eventLoopDelay.max / 1e6,
+    },
+  };
+}
+
+const cellKey = cell => `${cell.api}/${cell.mode}/${formatSize(cell.size)}/c${cell.concurrency}`;
+
+function compare(results, baseline, threshold) {
+  const previous = new Map(baseline.results.map(cell => [cellKey(cell), cell]));
+  const regressions = [];
+  console.log(`\nCompared to ${baseline.meta.date} (${baseline.meta.commit || 'unknown commit'}):`);
+  console.log('cell'.padEnd(40) + 'ops/s'.padStart(12) + 'change'.padStart(10) +
+              'p99 us'.padStart(12) + 'change'.padStart(10));
+  for (const cell of results) {
+    const before = previous.get(cellKey(cell));
+    if (!before) {
+      continue;
+    }
+    const throughput = (cell.ops_per_sec / before.ops_per_sec - 1) * 100;
+    const latency = (cell.p99_us / before.p99_us - 1) * 100;
+    const regressed = throughput < -threshold || latency > threshold;
+    if (regressed) {
+      regressions.push(cellKey(cell));
+    }
+    const pct = value => `${value >= 0 ? '+' : ''}${value.toFixed(1)}%`;
+    console.log(cellKey(cell).padEnd(40) + cell.ops_per_sec.toFixed(0).padStart(12) +
+                pct(throughput).padStart(10) + cell.p99_us.toFixed(1).padStart(12) +
+                pct(latency).padStart(10) + (regressed ? '  REGRESSED' : ''));
+  }
+  return regressions;
+}
+
+function gitCommit() {
+  try {
+    return require('child_process')
+      .execSync('git rev-parse --short HEAD', { stdio: ['ignore', 'pipe', 'ignore'] })
+      .toString().trim();
+  } catch {
+    return null;
+  }
+}
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2));
+  asherah.setup(CONFIG);
+
+  const results = [];
+  const skipped = [];
+  try {
+    for (const api of options.apis) {
+      for (const mode of options.modes) {
+        for (const size of options.sizes) {
+          for (const concurrency of mode === 'sync' ? [1] : options.concurrency) {
+            const cell = { api, mode, size, concurrency };
+            if (size * concurrency > options.maxInflightBytes) {
+              skipped.push(cellKey(cell));
+              continue;
+            }
+            const result = await runCell(options, api, mode, size, concurrency);
+            results.push(result);
+            console.log(`${cellKey(result).padEnd(40)} ${result.ops_per_sec.toFixed(0).padStart(10)} ops/s ` +
+                        `${result.mb_per_sec.toFixed(1).padStart(9)} MB/s  p50 ${result.p50_us.toFixed(1)}us ` +
+                        `p99 ${result.p99_us.toFixed(1)}us  loop p99 ${result.event_loop_delay_ms.p99.toFixed(2)}ms`);
+          }
+        }
+      }
+    }
+  } finally {
+    asherah.shutdown();
+  }
+  if (skipped.length > 0) {
+    console.log(`Skipped (over --max-inflight): ${skipped.join(', ')}`);
+  }
+
+  const report = {
+    meta: {
+      date: new Date().toISOString(),
+      commit: gitCommit(),
+      node: process.version,
+      platform: `${process.platform}-${process.arch}`,
+      cpu: os.cpus()[0]?.model,
+      cpus: os.cpus().length,
+      uv_threadpool_size: process.env.UV_THREADPOOL_SIZE || null,
+      stub: process.env.ASHERAH_STUB === '1',
+      options: { ...options, output: undefined, baseline: undefined },
+    },
+    results,
+  };
+  if (options.output) {
+    fs.writeFileSync(options.output, JSON.stringify(report, null, 2));
+    console.log(`Wrote ${options.output}`);
+  }
+  if (options.baseline) {
+    const baseline = JSON.parse(fs.readFileSync(options.baseline, 'utf8'));
+    const regressions = compare(results, baseline, options.threshold);
+    console.log(`${regressions.length} cell(s) regressed by more than ${options.threshold}%`);
+    if (regressions.length > 0 && options.failOnRegression) {
+      process.exitCode = 1;
+    }
+  }
+}
+
+main().catch(error => {
+  console.error(error);
+  process.exit(1);
+});
@@ -4,13 +4,20 @@ set -e
 
 mkdir -p dist/
 
+# ASHERAH_STUB=1 links the null-crypto stub instead of lib/libasherah.a
+STUB=0
+if [ "$ASHERAH_STUB" = "1" ]; then
+    STUB=1
+    echo "WARNING: ASHERAH_STUB=1 builds an addon that DOES NOT ENCRYPT (benchmarks only)" >&2
+fi
+
 # Check if USE_CMAKE is set to 1
 if [ "$USE_CMAKE" = "1" ]; then
     # Run CMake commands
-    (cmake . && make) || exit 1
+    (cmake -DASHERAH_STUB=$([ $STUB = 1 ] && echo ON || echo OFF) . && make) || exit 1
 else
     # Run node-gyp commands
-    node-gyp configure && node-gyp build && cp build/Release/asherah.node dist/asherah.node
+    node-gyp configure -- -Dasherah_stub=$STUB && node-gyp build && cp build/Release/asherah.node dist/asherah.node
 fi
 
 cp src/asherah.d.ts dist/asherah.d.ts
@@ -240,6 +240,11 @@ function interval_message {
 
 # Main function
 function main {
+  if [[ "${ASHERAH_STUB}" == "1" ]]; then
+    echo "WARNING: ASHERAH_STUB=1: using stub/libasherah_stub.c, which DOES NOT ENCRYPT, not downloading Asherah libraries" >&2
+    return 0
+  fi
+
   echo "Downloading Asherah libraries"
   # shellcheck disable=SC1091
   source .asherah-version
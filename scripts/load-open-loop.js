@@ -0,0 +1,346 @@
+// Open-loop load generator for the *_async API.  Calls are issued on a
+// Poisson schedule at a target rate whether or not earlier calls have
+// finished, and latency is measured from each call's intended start, so
+// queueing delay is not hidden (no coordinated omission).
+//
+//   node scripts/load-open-loop.js --rate 20000 --duration 10
+//   node scripts/load-open-loop.js --sweep --pool-size 8 --output knee.json
+//
+// --sweep raises the rate step by step to find the saturation knee of the
+// thread pool: the highest rate still sustained with a bounded tail.
+
+// libuv reads UV_THREADPOOL_SIZE when its pool first starts, so this has to
+// happen before any async work
+const uvThreadsArg = process.argv.indexOf('--uv-threads');
+if (uvThreadsArg !== -1 && process.argv[uvThreadsArg + 1]) {
+  process.env.UV_THREADPOOL_SIZE = process.argv[uvThreadsArg + 1];
+}
+
+const asherah = require('../dist/asherah.node');
+const crypto = require('crypto');
+const fs = require('fs');
+const os = require('os');
+
+const DEFAULTS = {
+  op: 'encrypt',
+  size: 1024,
+  rate: 1000,
+  duration: 10,
+  sweep: false,
+  rateStart: 500,
+  rateStep: 1.25,
+  rateMax: 1e6,
+  kneeFactor: 10,
+  maxInflight: 100000,
+  poolSize: 0,
+  partition: 'load-partition',
+};
+
+const PERCENTILES = [50, 90, 99, 99.9, 99.99];
+
+function usage() {
+  console.log(`Usage: node scripts/load-open-loop.js [options]
+  --op encrypt|decrypt|mixed  call to drive (default ${DEFAULTS.op})
+  --size bytes        payload size (default ${DEFAULTS.size})
+  --rate ops/s        target arrival rate (default ${DEFAULTS.rate})
+  --duration s        seconds per rate (default ${DEFAULTS.duration})
+  --sweep             step the rate from --rate-start by --rate-step until saturated
+  --rate-start ops/s  first sweep rate (default ${DEFAULTS.rateStart})
+  --rate-step x       sweep rate multiplier (default ${DEFAULTS.rateStep})
+  --rate-max ops/s    last sweep rate (default ${DEFAULTS.rateMax})
+  --knee-factor x     saturated once p99 exceeds x times the first rate's p99 (default ${DEFAULTS.kneeFactor})
+  --max-inflight n    stop a rate once this many calls are outstanding (default ${DEFAULTS.maxInflight})
+  --pool-size n       NativeThreadPoolSize (default: libuv's pool)
+  --uv-threads n      UV_THREADPOOL_SIZE for this run
+  --output file       write results JSON`);
+}
+
+function parseArgs(argv) {
+  const options = { ...DEFAULTS, output: null };
+  for (let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    const value = () => {
+      if (i + 1 >= argv.length) {
+        throw new Error(`${arg} needs a value`);
+      }
+      return argv[++i];
+    };
+    switch (arg) {
+      case '--op': options.op = value(); break;
+      case '--size': options.size = Number(value()); break;
+      case '--rate': options.rate = Number(value()); break;
+      case '--duration': options.duration = Number(value()); break;
+      case '--sweep': options.sweep = true; break;
+      case '--rate-start': options.rateStart = Number(value()); break;
+      case '--rate-step': options.rateStep = Number(value()); break;
+      case '--rate-max': options.rateMax = Number(value()); break;
+      case '--knee-factor': options.kneeFactor = Number(value()); break;
+      case '--max-inflight': options.maxInflight = Number(value()); break;
+      case '--pool-size': options.poolSize = Number(value()); break;
+      case '--uv-threads': value(); break; // Applied at startup
+      case '--output': options.output = value(); break;
+      case '--help': usage(); process.exit(0); break;
+      default: throw new Error(`Unknown option: ${arg}`);
+    }
+  }
+  if (!['encrypt', 'decrypt', 'mixed'].includes(options.op)) {
+    throw new Error(`Unknown op: ${options.op}`);
+  }
+  if (options.sweep && !(options.rateStep > 1)) {
+    throw new Error('--rate-step must be greater than 1');
+  }
+  return options;
+}
+
+// HDR-style histogram of integer microseconds with three significant
+// digits: values below 2048 get their own bucket, larger ones share a
+// bucket with values within 1/1024 of them
+class Histogram {
+  static subBuckets = 1024;
+
+  constructor(maxMicros = 3600e6) {
+    this.maxMicros = maxMicros;
+    this.counts = new Float64Array(Histogram.index(maxMicros) + 1);
+    this.total = 0;
+    this.max = 0;
+    this.sum = 0;
+  }
+
+  static index(value) {
+    if (value < 2 * Histogram.subBuckets) {
+      return value;
+    }
+    const shift = Math.floor(Math.log2(value)) - Math.log2(Histogram.subBuckets);
+    return Histogram.subBuckets * shift + Math.floor(value / 2 ** shift);
+  }
+
+  // Largest value sharing bucket index, as HDR histograms report
+  static highestEquivalent(index) {
+    if (index < 2 * Histogram.subBuckets) {
+      return index;
+    }
+    const shift = Math.floor(index / Histogram.subBuckets) - 1;
+    const sub = index - Histogram.subBuckets * shift;
+    return (sub + 1) * 2 ** shift - 1;
+  }
+
+  record(micros) {
+    const value = Math.min(this.maxMicros, Math.max(0, Math.round(micros)));
+    this.counts[Histogram.index(value)]++;
+    this.total++;
+    this.sum += value;
+    this.max = Math.max(this.max, value);
+  }
+
+  percentile(q) {
+    if (this.total === 0) {
+      return 0;
+    }
+    const rank = Math.max(1, Math.ceil(q / 100 * this.total));
+    let seen = 0;
+    for (let i = 0; i < this.counts.length; i++) {
+      seen += this.counts[i];
+      if (seen >= rank) {
+        return Math.min(this.max, Histogram.highestEquivalent(i));
+      }
+    }
+    return this.max;
+  }
+
+  summary() {
+    const result = { count: this.total, mean_us: this.total ? this.sum / this.total : 0 };
+    for (const q of PERCENTILES) {
+      result[`p${q}_us`] = this.percentile(q);
+    }
+    result.max_us = this.max;
+    return result;
+  }
+}
+
+const now = () => Number(process.hrtime.bigint());
+
+// Exponentially distributed gap, in ns, between Poisson arrivals
+const nextGap = rate => -Math.log(1 - Math.random()) / rate * 1e9;
+
+function prepare(options) {
+  const payload = crypto.randomBytes(options.size);
+  const drr = asherah.encrypt(options.partition, payload);
+  const encrypt = () => asherah.encrypt_async(options.partition, payload);
+  const decrypt = () => asherah.decrypt_async(options.partition, drr);
+  switch (options.op) {
+    case 'encrypt': return encrypt;
+    case 'decrypt': return decrypt;
+    case 'mixed': return () => (Math.random() < 0.5 ? encrypt() : decrypt());
+  }
+}
+
+// Issues calls at rate for duration, then waits for the stragglers
+function runRate(call, rate, options) {
+  const latency = new Histogram();
+  const service = new Histogram();
+  const start = now();
+  const deadline = start + options.duration * 1e9;
+  let next = start + nextGap(rate);
+  let issued = 0;
+  let completed = 0;
+  let errors = 0;
+  let inflight = 0;
+  let peakInflight = 0;
+  let overloaded = false;
+  let lastCompletion = start;
+
+  return new Promise(resolve => {
+    const finish = () => {
+      if (inflight > 0 || (next < deadline && !overloaded)) {
+        return;
+      }
+      const elapsedSeconds = (lastCompletion - start) / 1e9;
+      resolve({
+        target_rate: rate,
+        issued,
+        completed,
+        errors,
+        achieved_rate: completed / Math.max(elapsedSeconds, options.duration),
+        peak_inflight: peakInflight,
+        overloaded,
+        latency: latency.summary(),
+        service_time: service.summary(),
+      });
+    };
+
+    const fire = intended => {
+      const issuedAt = now();
+      issued++;
+      inflight++;
+      peakInflight = Math.max(peakInflight, inflight);
+      const done = failed => {
+        const end = now();
+        // From when the call should have started, including any time the
+        // generator itself fell behind
+        latency.record((end - intended) / 1e3);
+        service.record((end - issuedAt) / 1e3);
+        lastCompletion = end;
+        completed++;
+        errors += failed ? 1 : 0;
+        inflight--;
+        finish();
+      };
+      call().then(() => done(false), () => done(true));
+    };
+
+    const tick = () => {
+      const t = now();
+      while (next <= t && next < deadline) {
+        if (inflight >= options.maxInflight) {
+          overloaded = true;
+          break;
+        }
+        fire(next);
+        next += nextGap(rate);
+      }
+      if (next < deadline && !overloaded) {
+        const waitMs = (next - now()) / 1e6;
+        // Timers are ms-granular; spin through the event loop for shorter waits
+        if (waitMs >= 2) {
+          setTimeout(tick, waitMs - 1);
+        } else {
+          setImmediate(tick);
+        }
+      } else {
+        finish();
+      }
+    };
+    tick();
+  });
+}
+
+function report(result) {
+  const l = result.latency;
+  const us = value => (value >= 1e4 ? `${(value / 1e3).toFixed(1)}ms` : `${value}us`).padStart(9);
+  console.log(`${String(result.target_rate).padStart(8)} ops/s -> ${result.achieved_rate.toFixed(0).padStart(8)} ops/s` +
+              `  p50 ${us(l.p50_us)} p99 ${us(l.p99_us)} p99.9 ${us(l['p99.9_us'])} max ${us(l.max_us)}` +
+              `  peak inflight ${result.peak_inflight}${result.errors ? `  errors ${result.errors}` : ''}` +
+              `${result.overloaded ? '  OVERLOADED' : ''}`);
+}
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2));
+  const config = {
+    KMS: 'test-debug-static',
+    Metastore: 'test-debug-memory',
+    ServiceName: 'LoadService',
+    ProductID: 'LoadProduct',
+    Verbose: false,
+    EnableSessionCaching: true,
+  };
+  if (options.poolSize > 0) {
+    config.NativeThreadPoolSize = options.poolSize;
+  }
+  asherah.setup(config);
+
+  const pool = options.poolSize > 0
+    ? `native pool of ${options.poolSize}`
+    : `libuv pool of ${process.env.UV_THREADPOOL_SIZE || 4}`;
+  console.log(`${options.op}_async, ${options.size} B payloads, ${pool}, ${options.duration}s per rate`);
+
+  const results = [];
+  let knee = null;
+  try {
+    const call = prepare(options);
+    // Warm the session cache and the pool threads
+    for (let i = 0; i < 100; i++) {
+      await call();
+    }
+
+    if (!options.sweep) {
+      const result = await runRate(call, options.rate, options);
+      results.push(result);
+      report(result);
+    } else {
+      let baselineP99 = null;
+      for (let rate = options.rateStart; rate <= options.rateMax; rate = Math.round(rate * options.rateStep)) {
+        const result = await runRate(call, rate, options);
+        results.push(result);
+        report(result);
+        baselineP99 = baselineP99 ?? Math.max(result.latency.p99_us, 1);
+        const saturated = result.overloaded ||
+                          result.achieved_rate < 0.95 * rate ||
+                          result.latency.p99_us > options.kneeFactor * baselineP99;
+        if (saturated) {
+          break;
+        }
+        knee = result;
+      }
+      if (knee) {
+        console.log(`Knee: ${knee.target_rate} ops/s (p99 ${knee.latency.p99_us}us) with ${pool}`);
+      } else {
+        console.log(`Saturated at the first rate; lower --rate-start`);
+      }
+    }
+  } finally {
+    asherah.shutdown();
+  }
+
+  if (options.output) {
+    const output = {
+      meta: {
+        date: new Date().toISOString(),
+        node: process.version,
+        platform: `${process.platform}-${process.arch}`,
+        cpus: os.cpus().length,
+        uv_threadpool_size: Number(process.env.UV_THREADPOOL_SIZE) || 4,
+        native_thread_pool_size: options.poolSize || null,
+        options: { ...options, output: undefined },
+      },
+      knee_rate: knee ? knee.target_rate : null,
+      results,
+    };
+    fs.writeFileSync(options.output, JSON.stringify(output, null, 2));
+    console.log(`Wrote ${options.output}`);
+  }
+}
+
+main().catch(error => {
+  console.error(error);
+  process.exit(1);
+});
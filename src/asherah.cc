@@ -2,53 +2,255 @@
 #pragma ide diagnostic ignored "readability-convert-member-functions-to-static"
 
 #include "asherah_async_worker.h"
+#include "asherah_output_size.h"
+#include "base64.h"
+#include "binary_envelope.h"
 #include "cobhan_buffer_napi.h"
+#include "cobhan_buffer_pool.h"
+#include "crypto_thread_pool.h"
+#include "decrypt_cache.h"
+#include "drr_scanner.h"
 #include "hints.h"
 #include "libasherah.h"
 #include "logging_napi.h"
+#include "marshal_counters.h"
 #include "napi_utils.h"
+#include "operation_metrics.h"
+#include "output_slab_allocator.h"
+#include "parallel_for.h"
+#include "phase_trace.h"
 #include "scoped_allocate.h"
+#include "shared_setup.h"
+#include "stream_framing.h"
+#include <algorithm>
 #include <atomic>
+#include <cstring>
+#include <memory>
 #include <napi.h>
-
-static std::atomic<int32_t> setup_state{0};
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 class Asherah : public Napi::Addon<Asherah> {
 public:
   Asherah(Napi::Env env, Napi::Object exports) : logger(env, "asherah-node") {
+    PhaseTrace::NameThread("js");
     DefineAddon(
         exports,
         {
-            InstanceMethod("setup", &Asherah::SetupAsherahSync),
-            InstanceMethod("setup_async", &Asherah::SetupAsherahAsync),
-            InstanceMethod("encrypt", &Asherah::EncryptSync),
-            InstanceMethod("encrypt_async", &Asherah::EncryptAsync),
-            InstanceMethod("encrypt_string", &Asherah::EncryptSync),
-            InstanceMethod("encrypt_string_async", &Asherah::EncryptAsync),
-            InstanceMethod("decrypt", &Asherah::DecryptSync),
-            InstanceMethod("decrypt_async", &Asherah::DecryptAsync),
-            InstanceMethod("decrypt_string", &Asherah::DecryptStringSync),
-            InstanceMethod("decrypt_string_async",
-                           &Asherah::DecryptStringAsync),
-            InstanceMethod("shutdown", &Asherah::ShutdownAsherahSync),
-            InstanceMethod("shutdown_async", &Asherah::ShutdownAsherahAsync),
-            InstanceMethod("set_max_stack_alloc_item_size",
-                           &Asherah::SetMaxStackAllocItemSize),
-            InstanceMethod("set_safety_padding_overhead",
-                           &Asherah::SetSafetyPaddingOverhead),
-            InstanceMethod("get_setup_status", &Asherah::GetSetupStatus),
-            InstanceMethod("set_log_hook", &Asherah::SetLogHook),
-            InstanceMethod("setenv", &Asherah::SetEnv),
+            Measured<&Asherah::SetupAsherahSync>("setup"),
+            Measured<&Asherah::SetupAsherahAsync>("setup_async"),
+            Measured<&Asherah::EncryptSync>("encrypt"),
+            Measured<&Asherah::EncryptAsync>("encrypt_async"),
+            Measured<&Asherah::EncryptSync>("encrypt_string"),
+            Measured<&Asherah::EncryptAsync>("encrypt_string_async"),
+            Measured<&Asherah::DecryptSync>("decrypt"),
+            Measured<&Asherah::DecryptAsync>("decrypt_async"),
+            Measured<&Asherah::DecryptStringSync>("decrypt_string"),
+            Measured<&Asherah::DecryptStringAsync>("decrypt_string_async"),
+            Measured<&Asherah::EncryptIntoSync>("encrypt_into"),
+            Measured<&Asherah::EncryptIntoAsync>("encrypt_into_async"),
+            Measured<&Asherah::DecryptIntoSync>("decrypt_into"),
+            Measured<&Asherah::DecryptIntoAsync>("decrypt_into_async"),
+            Measured<&Asherah::ShutdownAsherahSync>("shutdown"),
+            Measured<&Asherah::ShutdownAsherahAsync>("shutdown_async"),
+            Measured<&Asherah::SetMaxStackAllocItemSize>(
+                "set_max_stack_alloc_item_size"),
+            Measured<&Asherah::SetSafetyPaddingOverhead>(
+                "set_safety_padding_overhead"),
+            Measured<&Asherah::GetSetupStatus>("get_setup_status"),
+            Measured<&Asherah::SetLogHook>("set_log_hook"),
+            Measured<&Asherah::SetEnv>("setenv"),
+            Measured<&Asherah::Allocate>("allocate"),
+            Measured<&Asherah::EncryptBatchSync>("encrypt_batch"),
+            Measured<&Asherah::EncryptBatchAsync>("encrypt_batch_async"),
+            Measured<&Asherah::DecryptBatchSync>("decrypt_batch"),
+            Measured<&Asherah::DecryptBatchAsync>("decrypt_batch_async"),
+            Measured<&Asherah::EncryptManySync>("encrypt_many"),
+            Measured<&Asherah::EncryptManyAsync>("encrypt_many_async"),
+            Measured<&Asherah::DecryptManySync>("decrypt_many"),
+            Measured<&Asherah::DecryptManyAsync>("decrypt_many_async"),
+            Measured<&Asherah::EncryptRecordSync>("encrypt_record"),
+            Measured<&Asherah::EncryptRecordAsync>("encrypt_record_async"),
+            Measured<&Asherah::EncryptBinarySync>("encrypt_binary"),
+            Measured<&Asherah::EncryptBinaryAsync>("encrypt_binary_async"),
+            Measured<&Asherah::DecryptRecordSync>("decrypt_record"),
+            Measured<&Asherah::DecryptRecordAsync>("decrypt_record_async"),
+            Measured<&Asherah::CreateEncryptStream>("createEncryptStream"),
+            Measured<&Asherah::CreateDecryptStream>("createDecryptStream"),
+            InstanceMethod("get_metrics", &Asherah::GetMetrics),
+            InstanceMethod("get_marshal_stats", &Asherah::GetMarshalStats),
+            InstanceMethod("set_trace_enabled", &Asherah::SetTraceEnabled),
+            InstanceMethod("dump_trace", &Asherah::DumpTrace),
+            InstanceMethod("get_decrypt_cache_stats",
+                           &Asherah::GetDecryptCacheStats),
+            Measured<&Asherah::Partition>("partition"),
+            InstanceValue("is_stub", Napi::Boolean::New(env, is_stub),
+                          napi_enumerable),
         });
+    DefinePartitionMethods();
+  }
+
+  // A worker_thread that exits without calling shutdown still gives up its
+  // share of the setup, including one a setup_async in flight may take
+  ~Asherah() {
+    if (setup_claim) {
+      decrypt_cache.Configure(0, {});
+      crypto_pool.reset();
+      SharedSetup::Get().Release(*setup_claim, Shutdown);
+    }
   }
 
 private:
+  // Signature shared by EncryptToJson and DecryptFromJson
+  using CobhanFunction = GoInt32 (*)(void *, void *, void *);
+
+  // Whether this build links the null-crypto stub/libasherah_stub.c
+#ifdef ASHERAH_STUB
+  static constexpr bool is_stub = true;
+#else
+  static constexpr bool is_stub = false;
+#endif
+
+  // Returned in place of a libasherah error for malformed binary envelopes
+  static constexpr GoInt32 invalid_binary_envelope = -200;
+  // libasherah's code for a DRR it can't unmarshal
+  static constexpr GoInt32 json_decode_failed = -5;
+
+  // DecryptCacheMaxBytes and DecryptCacheDuration (seconds) limits
+  static constexpr size_t max_decrypt_cache_bytes = size_t{1} << 40;
+  static constexpr size_t default_decrypt_cache_duration = 60;
+  static constexpr size_t max_decrypt_cache_duration = 7 * 24 * 60 * 60;
+
+  struct BatchItem {
+    BatchItem(CobhanBufferNapi &&input, CobhanBufferNapi &&output,
+              size_t retry_output_size)
+        : input(std::move(input)), output(std::move(output)),
+          retry_output_size(retry_output_size) {}
+
+    CobhanBufferNapi input;
+    CobhanBufferNapi output;
+    size_t retry_output_size;
+    GoInt32 result = 0;
+  };
+
+  // Items sharing a partition ID, run in order on one thread so the
+  // partition's session stays hot in libasherah's session cache
+  struct BatchGroup {
+    std::shared_ptr<CobhanBufferNapi> partition_id;
+    std::vector<size_t> item_indices;
+  };
+
+  struct BatchState {
+    bool encrypt = true;
+    size_t max_threads = 1;
+    std::vector<BatchGroup> groups;
+    std::vector<BatchItem> items;
+    size_t failed_index = 0;
+  };
+
+  // A DataRowRecord as the separate fields of libasherah's Encrypt and
+  // Decrypt exports
+  struct RecordFields {
+    RecordFields(CobhanBufferNapi &&encrypted_data,
+                 CobhanBufferNapi &&encrypted_key,
+                 CobhanBufferNapi &&parent_key_id)
+        : encrypted_data(std::move(encrypted_data)),
+          encrypted_key(std::move(encrypted_key)),
+          parent_key_id(std::move(parent_key_id)) {}
+
+    CobhanBufferNapi encrypted_data;
+    CobhanBufferNapi encrypted_key;
+    CobhanBufferNapi parent_key_id;
+    GoInt64 created = 0;
+    GoInt64 parent_key_created = 0;
+  };
+
+  // Per-stream state shared by a Transform's transform/flush callbacks and
+  // any StreamWorker in flight.  Transform never calls transform again
+  // before the previous callback, so only one worker touches it at a time.
+  struct StreamState {
+    ~StreamState() {
+      if (plaintext) {
+        secure_wipe_memory(plaintext.get(), plaintext_len);
+      }
+    }
+
+    bool encrypt = true;
+    std::shared_ptr<CobhanBufferNapi> partition_id;
+    size_t chunk_size = StreamFraming::default_chunk_size;
+    uint64_t stream_id = 0;
+    uint64_t next_sequence = 0;
+    bool magic_done = false;
+    bool final_seen = false;
+    // Encrypt: plaintext carried over until a full chunk is available
+    std::unique_ptr<char[]> plaintext;
+    size_t plaintext_len = 0;
+    // Decrypt: ciphertext carried over until a whole frame is available
+    std::vector<char> ciphertext;
+  };
+
+  // The partition ID behind a partition() handle, marshaled once and shared
+  // by the handle's methods and any of their async calls in flight
+  struct PartitionHandle {
+    std::shared_ptr<CobhanBufferNapi> partition_id;
+    size_t partition_id_json_length;
+  };
+
+  using PartitionMethod = Napi::Value (Asherah::*)(const Napi::CallbackInfo &,
+                                                   const PartitionHandle &);
+
+  struct PartitionMethodEntry {
+    const char *name;
+    PartitionMethod method;
+    // get_metrics ID, as "partition.<name>"
+    void *metrics_id;
+  };
+
+  // Chunks per stream batch, which bounds the native memory a stream holds
+  // to about twice this many chunks whatever the size of a write()
+  static constexpr size_t max_stream_batch_items = 8;
+
+  // Prune collected handles from partition_handles once it grows past this
+  static constexpr size_t min_partition_handles_prune = 64;
+
   size_t est_intermediate_key_overhead = 0;
-  size_t maximum_stack_alloc_size = 2048;
+  size_t maximum_stack_alloc_size = AdaptiveStackCutoff::min_cutoff;
+  bool adaptive_stack_alloc = true;
+  AdaptiveStackCutoff stack_alloc_cutoff{AdaptiveStackCutoff::min_cutoff};
+
+  // This environment's part in the process-wide setup counted by SharedSetup
+  enum class SetupState { NotSetup, SettingUp, Ready, ShuttingDown };
+  SetupState setup_state = SetupState::NotSetup;
+  // Parsed from the config by BeginSetupAsherah, applied only once setup has
+  // succeeded so a rejected setup leaves nothing behind
+  struct SetupSettings {
+    size_t product_id_json_length = 0;
+    size_t service_name_json_length = 0;
+    bool decrypt_slabs = false;
+    size_t crypto_pool_size = 0;
+    size_t decrypt_cache_max_bytes = 0;
+    size_t decrypt_cache_duration = 0;
+  };
+  // Shared with setup and shutdown workers in flight
+  std::shared_ptr<SharedSetup::Claim> setup_claim;
 
   int32_t verbose_flag = 0;
+  bool decrypt_slabs_enabled = false;
+  OutputSlabAllocator output_slabs;
+  DecryptCache decrypt_cache;
+  // Runs *_async work when NativeThreadPoolSize is set; libuv's pool if null
+  std::unique_ptr<CryptoThreadPool> crypto_pool;
   Napi::FunctionReference log_hook;
+  Napi::FunctionReference transform_constructor;
+  // partition() handles by partition ID, held weakly so unused ones can be
+  // collected
+  std::unordered_map<std::string, Napi::ObjectReference> partition_handles;
+  size_t partition_handles_prune_at = min_partition_handles_prune;
+  std::vector<PartitionMethodEntry> partition_methods;
   LoggerNapi logger;
+  OperationMetrics metrics;
 
 #pragma region Published Node Addon Methods
 
@@ -57,11 +259,11 @@ private:
     Napi::HandleScope scope(env);
     try {
       Napi::String config_string;
-      size_t product_id_length;
-      size_t service_name_length;
+      std::string shared_config;
+      SetupSettings settings;
 
-      BeginSetupAsherah(env, __func__, info, config_string, product_id_length,
-                        service_name_length);
+      BeginSetupAsherah(env, __func__, info, config_string, shared_config,
+                        settings);
 
 #ifdef USE_SCOPED_ALLOCATE_BUFFER
       char *config_cbuffer;
@@ -77,8 +279,12 @@ private:
 #endif
 
       // extern GoInt32 SetupJson(void* configJson);
-      GoInt32 result = SetupJson(config);
-      EndSetupAsherah(env, result, product_id_length, service_name_length);
+      bool joined;
+      setup_claim = std::make_shared<SharedSetup::Claim>();
+      GoInt32 result = SharedSetup::Get().Acquire(
+          *setup_claim, shared_config, [&config] { return SetupJson(config); },
+          joined);
+      EndSetupAsherah(env, result, joined, settings);
     } catch (Napi::Error &e) {
       e.ThrowAsJavaScriptException();
       return;
@@ -93,16 +299,19 @@ private:
     Napi::HandleScope scope(env);
     try {
       Napi::String config_string;
-      size_t product_id_length;
-      size_t service_name_length;
+      std::string shared_config;
+      SetupSettings settings;
 
-      BeginSetupAsherah(env, __func__, info, config_string, product_id_length,
-                        service_name_length);
+      BeginSetupAsherah(env, __func__, info, config_string, shared_config,
+                        settings);
 
       CobhanBufferNapi config(env, config_string);
 
-      auto worker = new SetupAsherahWorker(env, this, config, product_id_length,
-                                           service_name_length);
+      setup_claim = std::make_shared<SharedSetup::Claim>();
+      auto worker =
+          new SetupAsherahWorker(env, this, config, std::move(shared_config),
+                                 setup_claim, settings);
+      setup_state = SetupState::SettingUp;
       worker->Queue();
       return worker->Promise();
     } catch (Napi::Error &e) {
@@ -119,8 +328,10 @@ private:
     Napi::HandleScope scope(env);
     try {
       BeginShutdownAsherah(env, __func__, info);
-      Shutdown();
-      EndShutdownAsherah(env);
+      // Let in-flight crypto finish before libasherah goes away
+      crypto_pool.reset();
+      bool torn_down = SharedSetup::Get().Release(*setup_claim, Shutdown);
+      EndShutdownAsherah(env, torn_down);
     } catch (Napi::Error &e) {
       e.ThrowAsJavaScriptException();
       return;
@@ -135,7 +346,9 @@ private:
     Napi::HandleScope scope(env);
     try {
       BeginShutdownAsherah(env, __func__, info);
-      auto worker = new ShutdownAsherahWorker(env, this);
+      // On libuv's pool, as the worker stops crypto_pool
+      auto worker = new ShutdownAsherahWorker(env, this, setup_claim,
+                                              std::move(crypto_pool));
       worker->Queue();
       return worker->Promise();
     } catch (Napi::Error &e) {
@@ -167,43 +380,19 @@ private:
                                                    partition_id_length);
       SCOPED_ALLOCATE_BUFFER(partition_id_cbuffer, partition_id_cbuffer_size,
                              maximum_stack_alloc_size, __func__);
-
-      char *input_cbuffer;
-      size_t input_cbuffer_size =
-          CobhanBufferNapi::ValueToAllocationSize(env, input_value);
-      SCOPED_ALLOCATE_BUFFER(input_cbuffer, input_cbuffer_size,
-                             maximum_stack_alloc_size, __func__);
-
       CobhanBufferNapi partition_id(env, partition_id_string,
                                     partition_id_cbuffer,
                                     partition_id_cbuffer_size);
-      CobhanBufferNapi input(env, input_value, input_cbuffer,
-                             input_cbuffer_size);
 #else
       CobhanBufferNapi partition_id(env, partition_id_string,
                                     partition_id_length);
-      CobhanBufferNapi input(env, input_value);
-#endif
-
-      size_t partition_id_data_len_bytes = partition_id.get_data_len_bytes();
-      size_t input_data_len_bytes = input.get_data_len_bytes();
-      size_t asherah_output_size_bytes = EstimateAsherahOutputSize(
-          input_data_len_bytes, partition_id_data_len_bytes);
-
-#ifdef USE_SCOPED_ALLOCATE_BUFFER
-      char *output_cobhan_buffer;
-      size_t output_size_bytes =
-          CobhanBuffer::DataSizeToAllocationSize(asherah_output_size_bytes);
-      SCOPED_ALLOCATE_BUFFER(output_cobhan_buffer, output_size_bytes,
-                             maximum_stack_alloc_size, __func__);
-      CobhanBufferNapi output(env, output_cobhan_buffer, output_size_bytes);
-#else
-      CobhanBufferNapi output(env, asherah_output_size_bytes);
 #endif
 
-      GoInt32 result = EncryptToJson(partition_id, input, output);
-
-      EndEncryptToJson(env, output, result, output_string);
+      output_string = EncryptWith(
+          env, __func__, partition_id,
+          AsherahOutputSize::JsonEscapedLength(
+              partition_id.get_data_ptr(), partition_id.get_data_len_bytes()),
+          input_value);
     } catch (Napi::Error &e) {
       e.ThrowAsJavaScriptException();
       return env.Undefined();
@@ -226,21 +415,12 @@ private:
       BeginEncryptToJson(env, __func__, info, partition_id_string, input_value,
                          partition_id_length);
 
-      CobhanBufferNapi partition_id(env, partition_id_string,
-                                    partition_id_length);
+      auto partition_id = std::make_shared<CobhanBufferNapi>(
+          env, partition_id_string, partition_id_length);
       CobhanBufferNapi input(env, input_value);
 
-      size_t partition_id_data_len_bytes = partition_id.get_data_len_bytes();
-      size_t input_data_len_bytes = input.get_data_len_bytes();
-      size_t asherah_output_size_bytes = EstimateAsherahOutputSize(
-          input_data_len_bytes, partition_id_data_len_bytes);
-
-      CobhanBufferNapi output(env, asherah_output_size_bytes);
-
-      auto worker =
-          new EncryptAsherahWorker(env, this, partition_id, input, output);
-      worker->Queue();
-      return worker->Promise();
+      return QueueEncrypt(env, partition_id, input,
+                          EstimateAsherahOutputSize(input, *partition_id));
     } catch (Napi::Error &e) {
       e.ThrowAsJavaScriptException();
       return env.Undefined();
@@ -253,7 +433,7 @@ private:
   Napi::Value DecryptSync(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
-    Napi::Object output_value;
+    Napi::Value output_value;
     try {
       Napi::String partition_id_string;
       Napi::Value input_value;
@@ -269,39 +449,16 @@ private:
                                                    partition_id_length);
       SCOPED_ALLOCATE_BUFFER(partition_id_cbuffer, partition_id_cbuffer_size,
                              maximum_stack_alloc_size, __func__);
-
-      char *input_cbuffer;
-      size_t input_cbuffer_size =
-          CobhanBufferNapi::ValueToAllocationSize(env, input_value);
-      SCOPED_ALLOCATE_BUFFER(input_cbuffer, input_cbuffer_size,
-                             maximum_stack_alloc_size, __func__);
-
       CobhanBufferNapi partition_id(env, partition_id_string,
                                     partition_id_cbuffer,
                                     partition_id_cbuffer_size);
-      CobhanBufferNapi input(env, input_value, input_cbuffer,
-                             input_cbuffer_size);
-
-      char *output_cobhan_buffer;
-      size_t output_size_bytes =
-          CobhanBuffer::DataSizeToAllocationSize(input.get_data_len_bytes());
-      SCOPED_ALLOCATE_BUFFER(output_cobhan_buffer, output_size_bytes,
-                             maximum_stack_alloc_size, __func__);
-      CobhanBufferNapi output(env, output_cobhan_buffer, output_size_bytes);
 #else
       CobhanBufferNapi partition_id(env, partition_id_string,
                                     partition_id_length);
-      CobhanBufferNapi input(env, input_value);
-      CobhanBufferNapi output(env, input.get_data_len_bytes());
 #endif
 
-      // extern GoInt32 DecryptFromJson(void* partitionIdPtr, void* jsonPtr,
-      // void* dataPtr);
-      GoInt32 result = DecryptFromJson(partition_id, input, output);
-
-      CheckResult(env, result);
-
-      output_value = output.ToBuffer(); // NOLINT(*-slicing)
+      output_value = DecryptWith<Napi::Buffer<unsigned char>>(
+          env, __func__, partition_id, input_value);
     } catch (Napi::Error &e) {
       e.ThrowAsJavaScriptException();
       return env.Undefined();
@@ -323,15 +480,11 @@ private:
       BeginDecryptFromJson(env, __func__, info, partition_id_string,
                            input_value, partition_id_length);
 
-      CobhanBufferNapi partition_id(env, partition_id_string,
-                                    partition_id_length);
+      auto partition_id = std::make_shared<CobhanBufferNapi>(
+          env, partition_id_string, partition_id_length);
       CobhanBufferNapi input(env, input_value);
-
-      CobhanBufferNapi output(env, input.get_data_len_bytes());
-      auto worker = new DecryptFromJsonWorker<Napi::Buffer<unsigned char>>(
-          env, this, partition_id, input, output);
-      worker->Queue();
-      return worker->Promise();
+      return QueueDecrypt<Napi::Buffer<unsigned char>>(env, partition_id,
+                                                       input);
     } catch (Napi::Error &e) {
       e.ThrowAsJavaScriptException();
       return env.Undefined();
@@ -344,7 +497,7 @@ private:
   Napi::Value DecryptStringSync(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
-    Napi::String output_string;
+    Napi::Value output_value;
     try {
       NapiUtils::RequireParameterCount(info, 2);
 
@@ -361,30 +514,16 @@ private:
                                                    partition_id_length);
       SCOPED_ALLOCATE_BUFFER(partition_id_cbuffer, partition_id_cbuffer_size,
                              maximum_stack_alloc_size, __func__);
-
-      char *input_cbuffer;
-      size_t input_cbuffer_size =
-          CobhanBufferNapi::ValueToAllocationSize(env, input_value);
-      SCOPED_ALLOCATE_BUFFER(input_cbuffer, input_cbuffer_size,
-                             maximum_stack_alloc_size, __func__);
-
       CobhanBufferNapi partition_id(env, partition_id_string,
                                     partition_id_cbuffer,
                                     partition_id_cbuffer_size);
-      CobhanBufferNapi input(env, input_value, input_cbuffer,
-                             input_cbuffer_size);
-
-      CobhanBufferNapi output(env, input.get_data_len_bytes());
 #else
       CobhanBufferNapi partition_id(env, partition_id_string,
                                     partition_id_length);
-      CobhanBufferNapi input(env, input_value);
-      CobhanBufferNapi output(env, input.get_data_len_bytes());
 #endif
 
-      GoInt32 result = DecryptFromJson(partition_id, input, output);
-
-      EndDecryptFromJson(env, output, result, output_string);
+      output_value =
+          DecryptWith<Napi::String>(env, __func__, partition_id, input_value);
     } catch (Napi::Error &e) {
       e.ThrowAsJavaScriptException();
       return env.Undefined();
@@ -392,7 +531,7 @@ private:
       Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
       return env.Undefined();
     }
-    return output_string;
+    return output_value;
   }
 
   Napi::Value DecryptStringAsync(const Napi::CallbackInfo &info) {
@@ -407,17 +546,10 @@ private:
       BeginDecryptFromJson(env, __func__, info, partition_id_string,
                            input_value, partition_id_length);
 
-      CobhanBufferNapi partition_id(env, partition_id_string,
-                                    partition_id_length);
+      auto partition_id = std::make_shared<CobhanBufferNapi>(
+          env, partition_id_string, partition_id_length);
       CobhanBufferNapi input(env, input_value);
-
-      CobhanBufferNapi output(env, input.get_data_len_bytes());
-
-      auto worker = new DecryptFromJsonWorker<Napi::String>(
-          env, this, partition_id, input, output);
-      worker->Queue();
-
-      return worker->Promise();
+      return QueueDecrypt<Napi::String>(env, partition_id, input);
     } catch (Napi::Error &e) {
       e.ThrowAsJavaScriptException();
       return env.Undefined();
@@ -427,71 +559,217 @@ private:
     }
   }
 
-  void SetEnv(const Napi::CallbackInfo &info) {
+  // Encrypts into a caller-provided Buffer at the given offset and returns
+  // the number of bytes the DRR needs.  If that is more than the space left
+  // in the Buffer nothing is written, so the caller can grow it and retry.
+  Napi::Value EncryptIntoSync(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
+    size_t required_bytes;
     try {
-      NapiUtils::RequireParameterCount(info, 1);
-      CobhanBufferNapi env_json(env, info[0]);
-      GoInt32 result = ::SetEnv(env_json);
+      Napi::String partition_id_string;
+      Napi::Value input_value;
+      size_t partition_id_length;
+      Napi::Buffer<unsigned char> output_buffer;
+      size_t output_offset;
+
+      BeginEncryptToJson(env, __func__, info, partition_id_string, input_value,
+                         partition_id_length, 4);
+      BeginOutputInto(env, __func__, info, output_buffer, output_offset);
+
+#ifdef USE_SCOPED_ALLOCATE_BUFFER
+      char *partition_id_cbuffer;
+      size_t partition_id_cbuffer_size =
+          CobhanBufferNapi::StringToAllocationSize(env, partition_id_string,
+                                                   partition_id_length);
+      SCOPED_ALLOCATE_BUFFER(partition_id_cbuffer, partition_id_cbuffer_size,
+                             maximum_stack_alloc_size, __func__);
+
+      char *input_cbuffer;
+      size_t input_cbuffer_size =
+          CobhanBufferNapi::ValueToAllocationSize(env, input_value);
+      RecordStackAllocSize(input_cbuffer_size);
+      SCOPED_ALLOCATE_BUFFER(input_cbuffer, input_cbuffer_size,
+                             maximum_stack_alloc_size, __func__);
+
+      CobhanBufferNapi partition_id(env, partition_id_string,
+                                    partition_id_cbuffer,
+                                    partition_id_cbuffer_size);
+      CobhanBufferNapi input(env, input_value, input_cbuffer,
+                             input_cbuffer_size);
+#else
+      CobhanBufferNapi partition_id(env, partition_id_string,
+                                    partition_id_length);
+      CobhanBufferNapi input(env, input_value);
+#endif
+
+      size_t asherah_output_size_bytes =
+          EstimateAsherahOutputSize(input, partition_id);
+
+#ifdef USE_SCOPED_ALLOCATE_BUFFER
+      char *output_cobhan_buffer;
+      size_t output_size_bytes =
+          CobhanBuffer::DataSizeToAllocationSize(asherah_output_size_bytes);
+      SCOPED_ALLOCATE_BUFFER(output_cobhan_buffer, output_size_bytes,
+                             maximum_stack_alloc_size, __func__);
+      CobhanBufferNapi output(env, output_cobhan_buffer, output_size_bytes);
+#else
+      CobhanBufferNapi output(env, asherah_output_size_bytes);
+#endif
+
+      GoInt32 result = CallWithOutputRetry(
+          env, EncryptToJson, partition_id, input, output,
+          AsherahOutputSize::EncryptRetrySize(asherah_output_size_bytes));
       CheckResult(env, result);
+
+      required_bytes = CopyOutputInto(output, output_buffer.Data(),
+                                      output_buffer.Length(), output_offset);
     } catch (Napi::Error &e) {
       e.ThrowAsJavaScriptException();
-      return;
+      return env.Undefined();
     } catch (const std::exception &e) {
       Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
-      return;
+      return env.Undefined();
     }
+
+    return Napi::Number::New(env, static_cast<double>(required_bytes));
   }
 
-  void SetMaxStackAllocItemSize(const Napi::CallbackInfo &info) {
+  Napi::Value EncryptIntoAsync(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
     try {
-      NapiUtils::RequireParameterCount(info, 1);
+      Napi::String partition_id_string;
+      Napi::Value input_value;
+      size_t partition_id_length;
+      Napi::Buffer<unsigned char> output_buffer;
+      size_t output_offset;
 
-      Napi::Number item_size = info[0].ToNumber();
-      int32_t value = item_size.Int32Value();
-      // Clamp to reasonable range without branching
-      constexpr int32_t MAX_STACK_SIZE = 1048576; // 1MB max
-      value = std::max(0, std::min(value, MAX_STACK_SIZE));
-      maximum_stack_alloc_size = static_cast<size_t>(value);
+      BeginEncryptToJson(env, __func__, info, partition_id_string, input_value,
+                         partition_id_length, 4);
+      BeginOutputInto(env, __func__, info, output_buffer, output_offset);
+
+      CobhanBufferNapi partition_id(env, partition_id_string,
+                                    partition_id_length);
+      CobhanBufferNapi input(env, input_value);
+
+      size_t asherah_output_size_bytes =
+          EstimateAsherahOutputSize(input, partition_id);
+      CobhanBufferNapi output(env, asherah_output_size_bytes);
+
+      auto worker = new OutputIntoWorker(
+          env, this, EncryptToJson, partition_id, input, output,
+          AsherahOutputSize::EncryptRetrySize(asherah_output_size_bytes),
+          output_buffer, output_offset);
+      worker->Queue(crypto_pool.get());
+      return worker->Promise();
     } catch (Napi::Error &e) {
       e.ThrowAsJavaScriptException();
-      return;
+      return env.Undefined();
     } catch (const std::exception &e) {
       Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
-      return;
+      return env.Undefined();
     }
   }
 
-  void SetSafetyPaddingOverhead(const Napi::CallbackInfo &info) {
+  // Decrypts into a caller-provided Buffer; same contract as EncryptIntoSync
+  Napi::Value DecryptIntoSync(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
+    size_t required_bytes;
     try {
-      NapiUtils::RequireParameterCount(info, 1);
+      Napi::String partition_id_string;
+      Napi::Value input_value;
+      size_t partition_id_length;
+      Napi::Buffer<unsigned char> output_buffer;
+      size_t output_offset;
 
-      // Napi::Number safety_padding_number = info[0].ToNumber();
-      // auto new_safety_padding_bytes = (size_t)
-      // safety_padding_number.Int32Value(); Safety padding size is now fixed -
-      // ignore the input set_safety_padding_bytes(new_safety_padding_bytes);
+      BeginDecryptFromJson(env, __func__, info, partition_id_string,
+                           input_value, partition_id_length, 4);
+      BeginOutputInto(env, __func__, info, output_buffer, output_offset);
+
+#ifdef USE_SCOPED_ALLOCATE_BUFFER
+      char *partition_id_cbuffer;
+      size_t partition_id_cbuffer_size =
+          CobhanBufferNapi::StringToAllocationSize(env, partition_id_string,
+                                                   partition_id_length);
+      SCOPED_ALLOCATE_BUFFER(partition_id_cbuffer, partition_id_cbuffer_size,
+                             maximum_stack_alloc_size, __func__);
+
+      char *input_cbuffer;
+      size_t input_cbuffer_size =
+          CobhanBufferNapi::ValueToAllocationSize(env, input_value);
+      RecordStackAllocSize(input_cbuffer_size);
+      SCOPED_ALLOCATE_BUFFER(input_cbuffer, input_cbuffer_size,
+                             maximum_stack_alloc_size, __func__);
+
+      CobhanBufferNapi partition_id(env, partition_id_string,
+                                    partition_id_cbuffer,
+                                    partition_id_cbuffer_size);
+      CobhanBufferNapi input(env, input_value, input_cbuffer,
+                             input_cbuffer_size);
+
+      char *output_cobhan_buffer;
+      size_t output_size_bytes = CobhanBuffer::DataSizeToAllocationSize(
+          RequireDecryptOutputSize(env, input));
+      SCOPED_ALLOCATE_BUFFER(output_cobhan_buffer, output_size_bytes,
+                             maximum_stack_alloc_size, __func__);
+      CobhanBufferNapi output(env, output_cobhan_buffer, output_size_bytes);
+#else
+      CobhanBufferNapi partition_id(env, partition_id_string,
+                                    partition_id_length);
+      CobhanBufferNapi input(env, input_value);
+      CobhanBufferNapi output(env, RequireDecryptOutputSize(env, input));
+#endif
+
+      GoInt32 result =
+          CallWithOutputRetry(env, DecryptAnyEnvelope, partition_id, input,
+                              output, input.get_data_len_bytes());
+      CheckResult(env, result);
+
+      required_bytes = CopyOutputInto(output, output_buffer.Data(),
+                                      output_buffer.Length(), output_offset);
+      output.secure_wipe_data();
     } catch (Napi::Error &e) {
       e.ThrowAsJavaScriptException();
-      return;
+      return env.Undefined();
     } catch (const std::exception &e) {
       Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
-      return;
+      return env.Undefined();
     }
+
+    return Napi::Number::New(env, static_cast<double>(required_bytes));
   }
 
-  Napi::Value
-  GetSetupStatus(const Napi::CallbackInfo
-                     &info) { // NOLINT(*-convert-member-functions-to-static)
+  Napi::Value DecryptIntoAsync(const Napi::CallbackInfo &info) {
     Napi::Env env = info.Env();
     Napi::HandleScope scope(env);
     try {
-      int32_t setup_status = setup_state.load(std::memory_order_acquire);
-      return Napi::Boolean::New(info.Env(), setup_status != 0);
+      Napi::String partition_id_string;
+      Napi::Value input_value;
+      size_t partition_id_length;
+      Napi::Buffer<unsigned char> output_buffer;
+      size_t output_offset;
+
+      BeginDecryptFromJson(env, __func__, info, partition_id_string,
+                           input_value, partition_id_length, 4);
+      BeginOutputInto(env, __func__, info, output_buffer, output_offset);
+
+      CobhanBufferNapi partition_id(env, partition_id_string,
+                                    partition_id_length);
+      CobhanBufferNapi input(env, input_value);
+      size_t output_data_size;
+      GoInt32 scan_result = ScanDecryptInput(input, output_data_size);
+      if (unlikely(scan_result < 0)) {
+        return RejectedPromise(env, scan_result);
+      }
+      CobhanBufferNapi output(env, output_data_size);
+
+      auto worker = new OutputIntoWorker(
+          env, this, DecryptAnyEnvelope, partition_id, input, output,
+          input.get_data_len_bytes(), output_buffer, output_offset);
+      worker->Queue(crypto_pool.get());
+      return worker->Promise();
     } catch (Napi::Error &e) {
       e.ThrowAsJavaScriptException();
       return env.Undefined();
@@ -501,11 +779,722 @@ private:
     }
   }
 
-  void SetLogHook(const Napi::CallbackInfo &info) {
+  // Encrypts every item of an Array with one call into the addon and returns
+  // an Array of DRR strings in the same order
+  Napi::Value EncryptBatchSync(const Napi::CallbackInfo &info) {
+    return BatchSync(info, __func__, true, false);
+  }
 
-    Napi::Env env = info.Env();
-    Napi::HandleScope scope(env);
-    try {
+  Napi::Value EncryptBatchAsync(const Napi::CallbackInfo &info) {
+    return BatchAsync(info, __func__, true, false);
+  }
+
+  // Decrypts every DRR of an Array with one call into the addon and returns
+  // an Array of Buffers in the same order
+  Napi::Value DecryptBatchSync(const Napi::CallbackInfo &info) {
+    return BatchSync(info, __func__, false, false);
+  }
+
+  Napi::Value DecryptBatchAsync(const Napi::CallbackInfo &info) {
+    return BatchAsync(info, __func__, false, false);
+  }
+
+  // Like the batch functions but takes [{partition, data}] spanning many
+  // partitions.  Partitions are processed in parallel on native threads.
+  Napi::Value EncryptManySync(const Napi::CallbackInfo &info) {
+    return BatchSync(info, __func__, true, true);
+  }
+
+  Napi::Value EncryptManyAsync(const Napi::CallbackInfo &info) {
+    return BatchAsync(info, __func__, true, true);
+  }
+
+  Napi::Value DecryptManySync(const Napi::CallbackInfo &info) {
+    return BatchSync(info, __func__, false, true);
+  }
+
+  Napi::Value DecryptManyAsync(const Napi::CallbackInfo &info) {
+    return BatchAsync(info, __func__, false, true);
+  }
+
+  // Like encrypt, but returns the DRR as an object with Buffer fields
+  // instead of a JSON string
+  Napi::Value EncryptRecordSync(const Napi::CallbackInfo &info) {
+    return EncryptFieldsSync(info, __func__, false);
+  }
+
+  Napi::Value EncryptRecordAsync(const Napi::CallbackInfo &info) {
+    return EncryptFieldsAsync(info, __func__, false);
+  }
+
+  // Like encrypt, but returns the DRR as a Buffer in the compact format of
+  // binary_envelope.h.  Every decrypt function accepts either format.
+  Napi::Value EncryptBinarySync(const Napi::CallbackInfo &info) {
+    return EncryptFieldsSync(info, __func__, true);
+  }
+
+  Napi::Value EncryptBinaryAsync(const Napi::CallbackInfo &info) {
+    return EncryptFieldsAsync(info, __func__, true);
+  }
+
+  Napi::Value EncryptFieldsSync(const Napi::CallbackInfo &info,
+                                const char *func_name, bool binary) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    Napi::Value output_value;
+    try {
+      Napi::String partition_id_string;
+      Napi::Value input_value;
+      size_t partition_id_length;
+      BeginEncryptToJson(env, func_name, info, partition_id_string,
+                         input_value, partition_id_length);
+
+      CobhanBufferNapi partition_id(env, partition_id_string,
+                                    partition_id_length);
+      CobhanBufferNapi input(env, input_value);
+      RecordFields fields = NewEncryptRecordFields(env, input, partition_id);
+
+      GoInt32 result = CallEncryptRecord(partition_id, input, fields);
+      output_value = EndEncryptFields(env, fields, result, binary);
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    return output_value;
+  }
+
+  Napi::Value EncryptFieldsAsync(const Napi::CallbackInfo &info,
+                                 const char *func_name, bool binary) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      Napi::String partition_id_string;
+      Napi::Value input_value;
+      size_t partition_id_length;
+      BeginEncryptToJson(env, func_name, info, partition_id_string,
+                         input_value, partition_id_length);
+
+      CobhanBufferNapi partition_id(env, partition_id_string,
+                                    partition_id_length);
+      CobhanBufferNapi input(env, input_value);
+      RecordFields fields = NewEncryptRecordFields(env, input, partition_id);
+
+      auto worker = new EncryptRecordWorker(env, this, partition_id, input,
+                                            fields, binary);
+      worker->Queue(crypto_pool.get());
+      return worker->Promise();
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  // Decrypts a record object as returned by encrypt_record
+  Napi::Value DecryptRecordSync(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    Napi::Buffer<unsigned char> output_buffer;
+    try {
+      Napi::String partition_id_string;
+      size_t partition_id_length;
+      BeginDecryptRecord(env, __func__, info, partition_id_string,
+                         partition_id_length);
+
+      CobhanBufferNapi partition_id(env, partition_id_string,
+                                    partition_id_length);
+      RecordFields fields = ParseRecordFields(env, __func__, info[1]);
+      CobhanBufferNapi output(env, EstimateDecryptRecordSize(fields));
+
+      GoInt32 result = CallDecryptRecord(partition_id, fields, output);
+      EndDecryptFromJson(env, output, result, output_buffer);
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    return output_buffer;
+  }
+
+  Napi::Value DecryptRecordAsync(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      Napi::String partition_id_string;
+      size_t partition_id_length;
+      BeginDecryptRecord(env, __func__, info, partition_id_string,
+                         partition_id_length);
+
+      CobhanBufferNapi partition_id(env, partition_id_string,
+                                    partition_id_length);
+      RecordFields fields = ParseRecordFields(env, __func__, info[1]);
+      CobhanBufferNapi output(env, EstimateDecryptRecordSize(fields));
+
+      auto worker =
+          new DecryptRecordWorker(env, this, partition_id, fields, output);
+      worker->Queue(crypto_pool.get());
+      return worker->Promise();
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  // Return stream.Transform instances that encrypt to / decrypt from the
+  // chunked format in stream_framing.h, holding at most a few chunks at once
+  Napi::Value CreateEncryptStream(const Napi::CallbackInfo &info) {
+    return CreateStream(info, __func__, true);
+  }
+
+  Napi::Value CreateDecryptStream(const Napi::CallbackInfo &info) {
+    return CreateStream(info, __func__, false);
+  }
+
+  // Returns a frozen object with the encrypt/decrypt methods bound to one
+  // partition ID, which is marshaled once here instead of on every call.
+  // Handles are interned: the same ID gets the same object for as long as
+  // it is reachable.
+  Napi::Value Partition(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      NapiUtils::RequireParameterCount(info, 1);
+
+      size_t partition_id_length;
+      Napi::String partition_id_string =
+          NapiUtils::RequireParameterStringWithLength(env, __func__, info[0],
+                                                      partition_id_length);
+      if (partition_id_length == 0) {
+        NapiUtils::ThrowException(env, std::string(__func__) +
+                                           ": Partition ID cannot be empty");
+      }
+
+      std::string key = partition_id_string.Utf8Value();
+      auto found = partition_handles.find(key);
+      if (found != partition_handles.end()) {
+        Napi::Object existing = found->second.Value();
+        if (likely(!existing.IsEmpty())) {
+          return existing;
+        }
+      }
+
+      auto handle = std::make_shared<PartitionHandle>();
+      handle->partition_id = std::make_shared<CobhanBufferNapi>(
+          env, partition_id_string, partition_id_length);
+      handle->partition_id_json_length = AsherahOutputSize::JsonEscapedLength(
+          handle->partition_id->get_data_ptr(),
+          handle->partition_id->get_data_len_bytes());
+
+      Napi::Object object = Napi::Object::New(env);
+      object.Set("id", partition_id_string);
+      for (const PartitionMethodEntry &entry : partition_methods) {
+        object.Set(entry.name,
+                   Napi::Function::New(
+                       env,
+                       [this, handle, entry](const Napi::CallbackInfo &info) {
+                         return CallPartitionMethod(info, entry, *handle);
+                       },
+                       entry.name));
+      }
+      object.Freeze();
+
+      PrunePartitionHandles();
+      partition_handles[std::move(key)] = Napi::Weak(object);
+      return object;
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  // Sync encrypt of input_value for encrypt, encrypt_string and partition
+  // handles.  The input and output are on the stack when small enough.
+  Napi::String EncryptWith(Napi::Env &env, const char *func_name,
+                           CobhanBufferNapi &partition_id,
+                           size_t partition_id_json_length,
+                           const Napi::Value &input_value) {
+#ifdef USE_SCOPED_ALLOCATE_BUFFER
+    char *input_cbuffer;
+    size_t input_cbuffer_size =
+        CobhanBufferNapi::ValueToAllocationSize(env, input_value);
+    RecordStackAllocSize(input_cbuffer_size);
+    SCOPED_ALLOCATE_BUFFER(input_cbuffer, input_cbuffer_size,
+                           maximum_stack_alloc_size, func_name);
+    CobhanBufferNapi input(env, input_value, input_cbuffer,
+                           input_cbuffer_size);
+#else
+    CobhanBufferNapi input(env, input_value);
+#endif
+
+    size_t asherah_output_size_bytes =
+        EstimateAsherahOutputSize(input, partition_id_json_length);
+
+#ifdef USE_SCOPED_ALLOCATE_BUFFER
+    char *output_cobhan_buffer;
+    size_t output_size_bytes =
+        CobhanBuffer::DataSizeToAllocationSize(asherah_output_size_bytes);
+    SCOPED_ALLOCATE_BUFFER(output_cobhan_buffer, output_size_bytes,
+                           maximum_stack_alloc_size, func_name);
+    CobhanBufferNapi output(env, output_cobhan_buffer, output_size_bytes);
+#else
+    CobhanBufferNapi output(env, asherah_output_size_bytes);
+#endif
+
+    GoInt32 result = CallWithOutputRetry(
+        env, EncryptToJson, partition_id, input, output,
+        AsherahOutputSize::EncryptRetrySize(asherah_output_size_bytes));
+
+    Napi::String output_string;
+    EndEncryptToJson(env, output, result, output_string);
+    return output_string;
+  }
+
+  // Sync decrypt of input_value for decrypt, decrypt_string and partition
+  // handles.  T is Napi::Buffer<unsigned char> for decrypt, Napi::String
+  // for decrypt_string.
+  template <typename T>
+  Napi::Value DecryptWith(Napi::Env &env, const char *func_name,
+                          CobhanBufferNapi &partition_id,
+                          const Napi::Value &input_value) {
+#ifdef USE_SCOPED_ALLOCATE_BUFFER
+    char *input_cbuffer;
+    size_t input_cbuffer_size =
+        CobhanBufferNapi::ValueToAllocationSize(env, input_value);
+    RecordStackAllocSize(input_cbuffer_size);
+    SCOPED_ALLOCATE_BUFFER(input_cbuffer, input_cbuffer_size,
+                           maximum_stack_alloc_size, func_name);
+    CobhanBufferNapi input(env, input_value, input_cbuffer,
+                           input_cbuffer_size);
+#else
+    CobhanBufferNapi input(env, input_value);
+#endif
+
+    std::string_view cached;
+    if (FindDecrypted(partition_id, input, cached)) {
+      return CachedResult<T>(env, cached);
+    }
+
+    if constexpr (std::is_same_v<T, Napi::Buffer<unsigned char>>) {
+      if (decrypt_slabs_enabled) {
+        auto slab_output = DecryptIntoSlab(env, partition_id, input);
+        CacheDecrypted(partition_id, input, BufferView(slab_output));
+        return slab_output;
+      }
+    }
+
+#ifdef USE_SCOPED_ALLOCATE_BUFFER
+    char *output_cobhan_buffer;
+    size_t output_size_bytes = CobhanBuffer::DataSizeToAllocationSize(
+        RequireDecryptOutputSize(env, input));
+    SCOPED_ALLOCATE_BUFFER(output_cobhan_buffer, output_size_bytes,
+                           maximum_stack_alloc_size, func_name);
+    CobhanBufferNapi output(env, output_cobhan_buffer, output_size_bytes);
+#else
+    CobhanBufferNapi output(env, RequireDecryptOutputSize(env, input));
+#endif
+
+    GoInt32 result =
+        CallWithOutputRetry(env, DecryptAnyEnvelope, partition_id, input,
+                            output, input.get_data_len_bytes());
+
+    T output_result;
+    EndDecryptFromJson(env, output, result, output_result);
+    CacheDecrypted(partition_id, input, DataView(output));
+    return output_result; // NOLINT(*-slicing)
+  }
+
+  // partition() handle methods: the same as the exported functions, minus
+  // the partition ID argument
+  Napi::Value PartitionEncrypt(const Napi::CallbackInfo &info,
+                               const PartitionHandle &handle) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      Napi::Value input_value = BeginPartitionCall(env, __func__, info);
+      return EncryptWith(env, __func__, *handle.partition_id,
+                         handle.partition_id_json_length, input_value);
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  Napi::Value PartitionEncryptAsync(const Napi::CallbackInfo &info,
+                                    const PartitionHandle &handle) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      CobhanBufferNapi input(env, BeginPartitionCall(env, __func__, info));
+      return QueueEncrypt(
+          env, handle.partition_id, input,
+          EstimateAsherahOutputSize(input, handle.partition_id_json_length));
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  // T is Napi::Buffer<unsigned char> for decrypt, Napi::String for
+  // decrypt_string
+  template <typename T>
+  Napi::Value PartitionDecrypt(const Napi::CallbackInfo &info,
+                               const PartitionHandle &handle) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      Napi::Value input_value = BeginPartitionCall(env, __func__, info);
+      return DecryptWith<T>(env, __func__, *handle.partition_id, input_value);
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  template <typename T>
+  Napi::Value PartitionDecryptAsync(const Napi::CallbackInfo &info,
+                                    const PartitionHandle &handle) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      CobhanBufferNapi input(env, BeginPartitionCall(env, __func__, info));
+      return QueueDecrypt<T>(env, handle.partition_id, input);
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  void SetEnv(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      NapiUtils::RequireParameterCount(info, 1);
+      CobhanBufferNapi env_json(env, info[0]);
+      GoInt32 result = ::SetEnv(env_json);
+      CheckResult(env, result);
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return;
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return;
+    }
+  }
+
+  // Returns a Buffer with the Cobhan header / canary space already reserved
+  // around it, so encrypt can pass it to libasherah without copying
+  Napi::Value Allocate(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      NapiUtils::RequireParameterCount(info, 1);
+
+      if (unlikely(!info[0].IsNumber())) {
+        NapiUtils::ThrowException(env, "allocate: Expected a Number");
+      }
+      int64_t size = info[0].As<Napi::Number>().Int64Value();
+      if (unlikely(size < 0)) {
+        NapiUtils::ThrowException(env, "allocate: Size cannot be negative");
+      }
+
+      return CobhanBufferNapi::AllocateHeaderReserved(
+          env, static_cast<size_t>(size));
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  void SetMaxStackAllocItemSize(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      NapiUtils::RequireParameterCount(info, 1);
+
+      Napi::Number item_size = info[0].ToNumber();
+      int32_t value = item_size.Int32Value();
+      if (value < 0) {
+        // Negative values hand the cutoff back to the adaptive sizing
+        adaptive_stack_alloc = true;
+        maximum_stack_alloc_size = stack_alloc_cutoff.Cutoff();
+        return;
+      }
+      // Clamp to reasonable range without branching
+      constexpr int32_t MAX_STACK_SIZE = 1048576; // 1MB max
+      value = std::min(value, MAX_STACK_SIZE);
+      adaptive_stack_alloc = false;
+      maximum_stack_alloc_size = static_cast<size_t>(value);
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return;
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return;
+    }
+  }
+
+  void SetSafetyPaddingOverhead(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      NapiUtils::RequireParameterCount(info, 1);
+
+      // Napi::Number safety_padding_number = info[0].ToNumber();
+      // auto new_safety_padding_bytes = (size_t)
+      // safety_padding_number.Int32Value(); Safety padding size is now fixed -
+      // ignore the input set_safety_padding_bytes(new_safety_padding_bytes);
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return;
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return;
+    }
+  }
+
+  Napi::Value
+  GetSetupStatus(const Napi::CallbackInfo
+                     &info) { // NOLINT(*-convert-member-functions-to-static)
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      return Napi::Boolean::New(info.Env(),
+                                setup_state == SetupState::Ready);
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  // Latency percentiles and error counts for every method called since
+  // startup, or since the last call that passed reset = true
+  Napi::Value GetMetrics(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      NapiUtils::RequireParameterCountRange(info, 0, 1);
+      bool reset = false;
+      if (info.Length() > 0 && !info[0].IsUndefined()) {
+        if (unlikely(!info[0].IsBoolean())) {
+          NapiUtils::ThrowException(env, "get_metrics: Expected a boolean");
+        }
+        reset = info[0].As<Napi::Boolean>().Value();
+      }
+      return metrics.ToObject(env, AsherahCobhanErrorToString, reset);
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  // Allocation, copy and output size estimate counters for the marshaling
+  // layer, process-wide
+  Napi::Value GetMarshalStats(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      NapiUtils::RequireParameterCountRange(info, 0, 1);
+      bool reset = false;
+      if (info.Length() > 0 && !info[0].IsUndefined()) {
+        if (unlikely(!info[0].IsBoolean())) {
+          NapiUtils::ThrowException(env,
+                                    "get_marshal_stats: Expected a boolean");
+        }
+        reset = info[0].As<Napi::Boolean>().Value();
+      }
+
+      using Counter = MarshalCounters::Counter;
+      auto number = [&](uint64_t value) {
+        return Napi::Number::New(env, static_cast<double>(value));
+      };
+      auto totals = [&](Napi::Object &object, const char *name,
+                        Counter counter) {
+        auto read = MarshalCounters::Read(counter, reset);
+        auto entry = Napi::Object::New(env);
+        entry.Set("count", number(read.count));
+        entry.Set("bytes", number(read.bytes));
+        object.Set(name, entry);
+      };
+      auto estimate = [&](bool encrypt) {
+        auto read = MarshalCounters::ReadEstimates(encrypt, reset);
+        auto entry = Napi::Object::New(env);
+        entry.Set("count", number(read.count));
+        entry.Set("estimated_bytes", number(read.estimated_bytes));
+        entry.Set("actual_bytes", number(read.actual_bytes));
+        entry.Set("ratio", Napi::Number::New(
+                               env, read.actual_bytes == 0
+                                        ? 0.0
+                                        : static_cast<double>(
+                                              read.estimated_bytes) /
+                                              read.actual_bytes));
+        entry.Set("retries", number(read.retries));
+        return entry;
+      };
+
+      auto allocations = Napi::Object::New(env);
+      totals(allocations, "stack", Counter::StackAllocation);
+      totals(allocations, "heap", Counter::HeapAllocation);
+      totals(allocations, "pooled", Counter::PooledAllocation);
+
+      auto copies = Napi::Object::New(env);
+      totals(copies, "in_string", Counter::CopyInString);
+      totals(copies, "in_buffer", Counter::CopyInBuffer);
+      totals(copies, "in_place", Counter::ZeroCopyIn);
+      totals(copies, "move", Counter::CopyMove);
+      totals(copies, "out_string", Counter::CopyOutString);
+      totals(copies, "out_buffer", Counter::CopyOutBuffer);
+      totals(copies, "out_into", Counter::CopyOutInto);
+      totals(copies, "out_slab", Counter::ZeroCopyOut);
+
+      auto estimates = Napi::Object::New(env);
+      estimates.Set("encrypt", estimate(true));
+      estimates.Set("decrypt", estimate(false));
+
+      auto result = Napi::Object::New(env);
+      result.Set("allocations", allocations);
+      result.Set("copies", copies);
+      result.Set("estimates", estimates);
+      return result;
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  // Hit, miss and eviction counts of the decrypt cache, since setup or
+  // since the last call that passed reset = true
+  Napi::Value GetDecryptCacheStats(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      NapiUtils::RequireParameterCountRange(info, 0, 1);
+      bool reset = false;
+      if (info.Length() > 0 && !info[0].IsUndefined()) {
+        if (unlikely(!info[0].IsBoolean())) {
+          NapiUtils::ThrowException(
+              env, "get_decrypt_cache_stats: Expected a boolean");
+        }
+        reset = info[0].As<Napi::Boolean>().Value();
+      }
+      DecryptCache::Stats stats = decrypt_cache.Read(reset);
+      Napi::Object result = Napi::Object::New(env);
+      result.Set("enabled", decrypt_cache.enabled());
+      result.Set("hits", static_cast<double>(stats.hits));
+      result.Set("misses", static_cast<double>(stats.misses));
+      result.Set("evictions", static_cast<double>(stats.evictions));
+      result.Set("expirations", static_cast<double>(stats.expirations));
+      result.Set("entries", static_cast<double>(stats.entries));
+      result.Set("bytes", static_cast<double>(stats.bytes));
+      return result;
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  // Starts (with an optional ring size per thread) or stops recording
+  // phase timings for dump_trace
+  void SetTraceEnabled(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      NapiUtils::RequireParameterCountRange(info, 1, 2);
+      if (unlikely(!info[0].IsBoolean())) {
+        NapiUtils::ThrowException(env,
+                                  "set_trace_enabled: Expected a boolean");
+      }
+      if (!info[0].As<Napi::Boolean>().Value()) {
+        PhaseTrace::Disable();
+        return;
+      }
+      size_t events_per_thread = PhaseTrace::default_events_per_thread;
+      if (info.Length() > 1 && !info[1].IsUndefined()) {
+        int32_t events = info[1].ToNumber().Int32Value();
+        if (unlikely(!info[1].IsNumber() || events <= 0)) {
+          NapiUtils::ThrowException(
+              env, "set_trace_enabled: Expected a positive events_per_thread");
+        }
+        events_per_thread = static_cast<size_t>(events);
+      }
+      PhaseTrace::Enable(events_per_thread);
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    }
+  }
+
+  // Chrome Trace Event JSON of the recorded phases, optionally clearing
+  // them
+  Napi::Value DumpTrace(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      NapiUtils::RequireParameterCountRange(info, 0, 1);
+      bool clear = false;
+      if (info.Length() > 0 && !info[0].IsUndefined()) {
+        if (unlikely(!info[0].IsBoolean())) {
+          NapiUtils::ThrowException(env, "dump_trace: Expected a boolean");
+        }
+        clear = info[0].As<Napi::Boolean>().Value();
+      }
+      return Napi::String::New(env, PhaseTrace::Dump(clear));
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  void SetLogHook(const Napi::CallbackInfo &info) {
+
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
       NapiUtils::RequireParameterCount(info, 1);
 
       if (unlikely(!info[0].IsFunction())) {
@@ -524,49 +1513,495 @@ private:
 
   void BeginSetupAsherah(const Napi::Env &env, const char *func_name,
                          const Napi::CallbackInfo &info,
-                         Napi::String &config_string, size_t &product_id_length,
-                         size_t &service_name_length) {
+                         Napi::String &config_string,
+                         std::string &shared_config,
+                         SetupSettings &settings) {
     RequireAsherahNotSetup(env, func_name);
 
     NapiUtils::RequireParameterCount(info, 1);
 
     Napi::Object config_json;
     NapiUtils::AsJsonObjectAndString(env, info[0], config_string, config_json);
+    shared_config = SharedConfig(env, config_json);
 
+    // Both end up JSON-escaped in the intermediate key ID of every DRR
     Napi::String product_id;
     NapiUtils::GetStringProperty(config_json, "ProductID", product_id);
-    product_id_length = NapiUtils::GetUtf8StringLength(env, product_id);
+    std::string product_id_utf8 = product_id.Utf8Value();
+    settings.product_id_json_length = AsherahOutputSize::JsonEscapedLength(
+        product_id_utf8.data(), product_id_utf8.size());
 
     Napi::String service_name;
     NapiUtils::GetStringProperty(config_json, "ServiceName", service_name);
-    service_name_length = NapiUtils::GetUtf8StringLength(env, service_name);
+    std::string service_name_utf8 = service_name.Utf8Value();
+    settings.service_name_json_length = AsherahOutputSize::JsonEscapedLength(
+        service_name_utf8.data(), service_name_utf8.size());
 
     bool verbose;
     NapiUtils::GetBooleanProperty(config_json, "Verbose", verbose, false);
     verbose_flag = verbose;
+    logger.set_verbose_flag(verbose);
 
     bool enable_canaries;
     NapiUtils::GetBooleanProperty(config_json, "EnableCanaries",
                                   enable_canaries, false);
     CobhanBuffer::SetCanariesEnabled(enable_canaries);
+
+    NapiUtils::GetBooleanProperty(config_json, "EnableDecryptSlabs",
+                                  settings.decrypt_slabs, false);
+
+    NapiUtils::GetSizeProperty(config_json, "NativeThreadPoolSize",
+                               settings.crypto_pool_size, 0,
+                               CryptoThreadPool::max_threads);
+
+    NapiUtils::GetSizeProperty(config_json, "DecryptCacheMaxBytes",
+                               settings.decrypt_cache_max_bytes, 0,
+                               max_decrypt_cache_bytes);
+    NapiUtils::GetSizeProperty(config_json, "DecryptCacheDuration",
+                               settings.decrypt_cache_duration,
+                               default_decrypt_cache_duration,
+                               max_decrypt_cache_duration);
+  }
+
+  void EndSetupAsherah(const Napi::Env &env, GoInt32 result, bool joined,
+                       const SetupSettings &settings) {
+    if (unlikely(result < 0)) {
+      setup_state = SetupState::NotSetup;
+      CheckResult(env, result);
+    }
+    setup_state = SetupState::Ready;
+
+    est_intermediate_key_overhead =
+        settings.product_id_json_length + settings.service_name_json_length;
+    decrypt_slabs_enabled = settings.decrypt_slabs;
+    decrypt_cache.Configure(
+        settings.decrypt_cache_max_bytes,
+        std::chrono::seconds(settings.decrypt_cache_duration));
+
+    if (settings.crypto_pool_size > 0) {
+      try {
+        crypto_pool.reset(
+            new CryptoThreadPool(env, settings.crypto_pool_size));
+      } catch (const std::system_error &e) {
+        // libasherah is already set up; carry on with libuv's pool
+        logger.error_log(__func__, std::string("Failed to start native "
+                                               "thread pool: ") +
+                                       e.what());
+      }
+    }
+
+    if (unlikely(logger.debug_enabled())) {
+      std::string message = joined ? "Setup complete (shared), "
+                                   : "Setup complete, ";
+      logger.debug_log(__func__,
+                       message + (crypto_pool
+                                      ? "native thread pool of " +
+                                            std::to_string(crypto_pool->size())
+                                      : "libuv thread pool"));
+    }
+  }
+
+  void BeginEncryptToJson(const Napi::Env &env, const char *func_name,
+                          const Napi::CallbackInfo &info,
+                          Napi::String &partition_id, Napi::Value &input,
+                          size_t &partition_id_length,
+                          size_t max_parameter_count = 2) {
+    RequireAsherahSetup(env, func_name);
+
+    NapiUtils::RequireParameterCountRange(info, 2, max_parameter_count);
+
+    partition_id = NapiUtils::RequireParameterStringWithLength(
+        env, func_name, info[0], partition_id_length);
+    input = NapiUtils::RequireParameterStringOrBuffer(env, func_name, info[1]);
+
+    if (partition_id_length == 0) {
+      NapiUtils::ThrowException(env, std::string(func_name) +
+                                         ": Partition ID cannot be empty");
+    }
+  }
+
+  void EndEncryptToJson(Napi::Env env, CobhanBufferNapi &output, GoInt32 result,
+                        Napi::String &output_string) {
+    CheckResult(env, result);
+
+    output_string = output.ToString();
+  }
+
+  [[maybe_unused]] void
+  EndEncryptToJson(Napi::Env env, CobhanBufferNapi &output, GoInt32 result,
+                   Napi::Buffer<unsigned char> &output_buffer) {
+    CheckResult(env, result);
+
+    output_buffer = output.ToBuffer();
+  }
+
+  void BeginDecryptFromJson(const Napi::Env &env, const char *func_name,
+                            const Napi::CallbackInfo &info,
+                            Napi::String &partition_id, Napi::Value &input,
+                            size_t &partition_id_length,
+                            size_t max_parameter_count = 2) {
+    RequireAsherahSetup(env, func_name);
+
+    NapiUtils::RequireParameterCountRange(info, 2, max_parameter_count);
+
+    partition_id = NapiUtils::RequireParameterStringWithLength(
+        env, func_name, info[0], partition_id_length);
+    input = NapiUtils::RequireParameterStringOrBuffer(env, func_name, info[1]);
+
+    if (partition_id_length == 0) {
+      NapiUtils::ThrowException(env, std::string(func_name) +
+                                         ": Partition ID cannot be empty");
+    }
+  }
+
+  void EndDecryptFromJson(Napi::Env &env, CobhanBufferNapi &output,
+                          GoInt32 result,
+                          Napi::Buffer<unsigned char> &output_buffer) {
+    CheckResult(env, result);
+
+    output_buffer = output.ToBuffer();
   }
 
-  void EndSetupAsherah(const Napi::Env &env, GoInt32 result,
-                       size_t product_id_length, size_t service_name_length) {
+  void EndDecryptFromJson(Napi::Env &env, CobhanBufferNapi &output,
+                          GoInt32 result, Napi::String &output_string) {
     CheckResult(env, result);
 
-    est_intermediate_key_overhead = product_id_length + service_name_length;
+    output_string = output.ToString();
+  }
+
+  // Parses the (outBuf, offset) arguments of the *_into functions
+  void BeginOutputInto(const Napi::Env &env, const char *func_name,
+                       const Napi::CallbackInfo &info,
+                       Napi::Buffer<unsigned char> &output_buffer,
+                       size_t &output_offset) {
+    output_buffer =
+        NapiUtils::RequireParameterBuffer(env, func_name, info[2]);
+    output_offset = NapiUtils::OptionalParameterSize(
+        env, func_name, info, 3, 0, output_buffer.Length());
+  }
+
+  Napi::Value BatchSync(const Napi::CallbackInfo &info, const char *func_name,
+                        bool encrypt, bool many) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    Napi::Array output_array;
+    try {
+      BatchState batch;
+      if (many) {
+        BeginMany(env, func_name, info, batch, encrypt);
+      } else {
+        BeginBatch(env, func_name, info, batch, encrypt);
+      }
+
+      GoInt32 result = RunBatch(env, batch);
+      output_array = EndBatch(env, func_name, batch, result);
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    return output_array;
+  }
+
+  Napi::Value BatchAsync(const Napi::CallbackInfo &info, const char *func_name,
+                         bool encrypt, bool many) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      BatchState batch;
+      if (many) {
+        BeginMany(env, func_name, info, batch, encrypt);
+      } else {
+        BeginBatch(env, func_name, info, batch, encrypt);
+      }
+
+      auto worker = new BatchWorker(env, this, func_name, batch);
+      worker->Queue(crypto_pool.get());
+      return worker->Promise();
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  // Validates (partitionId, items[]) and marshals every item and its output
+  // buffer in a single pass
+  void BeginBatch(const Napi::Env &env, const char *func_name,
+                  const Napi::CallbackInfo &info, BatchState &batch,
+                  bool encrypt) {
+    RequireAsherahSetup(env, func_name);
+
+    NapiUtils::RequireParameterCount(info, 2);
+
+    size_t partition_id_length;
+    Napi::String partition_id_string =
+        NapiUtils::RequireParameterStringWithLength(env, func_name, info[0],
+                                                    partition_id_length);
+    if (partition_id_length == 0) {
+      NapiUtils::ThrowException(env, std::string(func_name) +
+                                         ": Partition ID cannot be empty");
+    }
+    Napi::Array input_array =
+        NapiUtils::RequireParameterArray(env, func_name, info[1]);
+
+    batch.encrypt = encrypt;
+    batch.groups.emplace_back();
+    batch.groups[0].partition_id = std::make_shared<CobhanBufferNapi>(
+        env, partition_id_string, partition_id_length);
+
+    uint32_t count = input_array.Length();
+    batch.items.reserve(count);
+    batch.groups[0].item_indices.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+      AddBatchItem(env, func_name, batch, 0, input_array.Get(i));
+    }
+  }
+
+  // Validates ([{partition, data}]) and groups the items by partition ID
+  void BeginMany(const Napi::Env &env, const char *func_name,
+                 const Napi::CallbackInfo &info, BatchState &batch,
+                 bool encrypt) {
+    RequireAsherahSetup(env, func_name);
+
+    NapiUtils::RequireParameterCount(info, 1);
+
+    Napi::Array input_array =
+        NapiUtils::RequireParameterArray(env, func_name, info[0]);
+
+    batch.encrypt = encrypt;
+    batch.max_threads = DefaultParallelism();
+
+    std::unordered_map<std::string, size_t> group_by_partition;
+    uint32_t count = input_array.Length();
+    batch.items.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+      Napi::Value element = input_array.Get(i);
+      if (unlikely(!element.IsObject())) {
+        NapiUtils::ThrowException(env, std::string(func_name) + ": item " +
+                                           std::to_string(i) +
+                                           ": Expected an Object");
+      }
+      Napi::Object object = element.As<Napi::Object>();
+
+      size_t partition_id_length;
+      Napi::String partition_id_string =
+          NapiUtils::RequireParameterStringWithLength(
+              env, func_name, object.Get("partition"), partition_id_length);
+      if (partition_id_length == 0) {
+        NapiUtils::ThrowException(env, std::string(func_name) + ": item " +
+                                           std::to_string(i) +
+                                           ": Partition ID cannot be empty");
+      }
+
+      auto inserted = group_by_partition.emplace(
+          partition_id_string.Utf8Value(), batch.groups.size());
+      if (inserted.second) {
+        batch.groups.emplace_back();
+        batch.groups.back().partition_id = std::make_shared<CobhanBufferNapi>(
+            env, partition_id_string, partition_id_length);
+      }
+
+      AddBatchItem(env, func_name, batch, inserted.first->second,
+                   object.Get("data"));
+    }
+  }
+
+  void AddBatchItem(const Napi::Env &env, const char *func_name,
+                    BatchState &batch, size_t group_index,
+                    const Napi::Value &input_value) {
+    CobhanBufferNapi input(env, NapiUtils::RequireParameterStringOrBuffer(
+                                    env, func_name, input_value));
+    AddBatchInput(env, batch, group_index, std::move(input));
+  }
+
+  // Sizes the output buffer for input and appends both to the group
+  void AddBatchInput(const Napi::Env &env, BatchState &batch,
+                     size_t group_index, CobhanBufferNapi &&input) {
+    auto &group = batch.groups[group_index];
+    size_t output_size_bytes;
+    size_t retry_output_size;
+    GoInt32 scan_result = 0;
+    if (batch.encrypt) {
+      output_size_bytes = EstimateAsherahOutputSize(input, *group.partition_id);
+      retry_output_size =
+          AsherahOutputSize::EncryptRetrySize(output_size_bytes);
+    } else {
+      scan_result = ScanDecryptInput(input, output_size_bytes);
+      retry_output_size = input.get_data_len_bytes();
+    }
+    CobhanBufferNapi output(env, output_size_bytes);
+
+    group.item_indices.push_back(batch.items.size());
+    batch.items.emplace_back(std::move(input), std::move(output),
+                             retry_output_size);
+    // RunBatch reports a rejected item in index order like any other failure
+    batch.items.back().result = scan_result;
+  }
+
+  // Runs each partition group in order, with groups spread over up to
+  // batch.max_threads threads.  Returns the result of the lowest-indexed
+  // failing item, with batch.failed_index set, or 0.  After a failure only
+  // items before it are still attempted, so the reported item is the same
+  // however the groups were scheduled.
+  static GoInt32 RunBatch(const Napi::Env &env, BatchState &batch) {
+    CobhanFunction function =
+        batch.encrypt ? EncryptToJson : DecryptAnyEnvelope;
+    const size_t no_failure = batch.items.size();
+    std::atomic<size_t> first_failed_index{no_failure};
+
+    ParallelFor(batch.groups.size(), batch.max_threads, [&](size_t g) {
+      auto &group = batch.groups[g];
+      for (size_t index : group.item_indices) {
+        // Indices within a group ascend, so the rest can be skipped too
+        if (unlikely(index >
+                     first_failed_index.load(std::memory_order_relaxed))) {
+          return;
+        }
+        auto &item = batch.items[index];
+        if (likely(item.result >= 0)) {
+          item.result = CallWithOutputRetry(env, function, *group.partition_id,
+                                            item.input, item.output,
+                                            item.retry_output_size);
+        }
+        if (unlikely(item.result < 0)) {
+          size_t current = first_failed_index.load(std::memory_order_relaxed);
+          while (index < current &&
+                 !first_failed_index.compare_exchange_weak(
+                     current, index, std::memory_order_relaxed)) {
+          }
+          return;
+        }
+      }
+    });
+
+    size_t failed_index = first_failed_index.load(std::memory_order_relaxed);
+    if (likely(failed_index == no_failure)) {
+      return 0;
+    }
+    batch.failed_index = failed_index;
+    return batch.items[failed_index].result;
+  }
 
-    auto old_setup_state = setup_state.exchange(1, std::memory_order_acq_rel);
-    if (unlikely(old_setup_state != 0)) {
+  Napi::Array EndBatch(const Napi::Env &env, const char *func_name,
+                       BatchState &batch, GoInt32 result) {
+    if (unlikely(result < 0)) {
+      OperationMetrics::RecordError(result);
       NapiUtils::ThrowException(
-          env, "EndSetupAsherah: lost race to mark setup_state?!");
+          env, std::string(func_name) + ": item " +
+                   std::to_string(batch.failed_index) + ": " +
+                   AsherahCobhanErrorToString(result));
+    }
+
+    Napi::Array output_array = Napi::Array::New(env, batch.items.size());
+    for (size_t i = 0; i < batch.items.size(); i++) {
+      auto &output = batch.items[i].output;
+      if (batch.encrypt) {
+        output_array.Set(static_cast<uint32_t>(i), output.ToString());
+      } else {
+        output_array.Set(static_cast<uint32_t>(i), output.ToBuffer());
+      }
     }
+    return output_array;
   }
 
-  void BeginEncryptToJson(const Napi::Env &env, const char *func_name,
+  // Output buffers for Encrypt, sized from the plaintext and key ID lengths
+  RecordFields NewEncryptRecordFields(const Napi::Env &env,
+                                      const CobhanBuffer &input,
+                                      const CobhanBuffer &partition_id) const {
+    return RecordFields(
+        CobhanBufferNapi(env, AsherahOutputSize::EncryptedDataSize(
+                                  input.get_data_len_bytes())),
+        CobhanBufferNapi(env, AsherahOutputSize::encrypted_key_bytes),
+        CobhanBufferNapi(env, AsherahOutputSize::ParentKeyIdSize(
+                                  partition_id.get_data_len_bytes(),
+                                  est_intermediate_key_overhead)));
+  }
+
+  // extern GoInt32 Encrypt(void* partitionIdPtr, void* dataPtr,
+  // void* outputEncryptedDataPtr, void* outputEncryptedKeyPtr,
+  // void* outputCreatedPtr, void* outputParentKeyIdPtr,
+  // void* outputParentKeyCreatedPtr);
+  static GoInt32 CallEncryptRecord(CobhanBufferNapi &partition_id,
+                                   CobhanBufferNapi &input,
+                                   RecordFields &fields) {
+    PhaseTrace::Span trace("asherah", PhaseTrace::CurrentOp());
+    return Encrypt(partition_id, input, fields.encrypted_data,
+                   fields.encrypted_key, &fields.created, fields.parent_key_id,
+                   &fields.parent_key_created);
+  }
+
+  // extern GoInt32 Decrypt(void* partitionIdPtr, void* encryptedDataPtr,
+  // void* encryptedKeyPtr, GoInt64 created, void* parentKeyIdPtr,
+  // GoInt64 parentKeyCreated, void* outputDecryptedDataPtr);
+  static GoInt32 CallDecryptRecord(CobhanBufferNapi &partition_id,
+                                   RecordFields &fields,
+                                   CobhanBufferNapi &output) {
+    PhaseTrace::Span trace("asherah", PhaseTrace::CurrentOp());
+    return Decrypt(partition_id, fields.encrypted_data, fields.encrypted_key,
+                   fields.created, fields.parent_key_id,
+                   fields.parent_key_created, output);
+  }
+
+  [[nodiscard]] static size_t
+  EstimateDecryptRecordSize(const RecordFields &fields) {
+    size_t encrypted_len = fields.encrypted_data.get_data_len_bytes();
+    return encrypted_len > AsherahOutputSize::aead_overhead_bytes
+               ? encrypted_len - AsherahOutputSize::aead_overhead_bytes
+               : 0;
+  }
+
+  Napi::Value EndEncryptFields(const Napi::Env &env, RecordFields &fields,
+                               GoInt32 result, bool binary) {
+    CheckResult(env, result);
+    if (binary) {
+      return EndEncryptBinary(env, fields);
+    }
+
+    Napi::Object parent_key_meta = Napi::Object::New(env);
+    parent_key_meta.Set("KeyId", fields.parent_key_id.ToString());
+    parent_key_meta.Set(
+        "Created",
+        Napi::Number::New(env, static_cast<double>(fields.parent_key_created)));
+
+    Napi::Object key = Napi::Object::New(env);
+    key.Set("Created",
+            Napi::Number::New(env, static_cast<double>(fields.created)));
+    key.Set("Key", fields.encrypted_key.ToBuffer());
+    key.Set("ParentKeyMeta", parent_key_meta);
+
+    Napi::Object record = Napi::Object::New(env);
+    record.Set("Key", key);
+    record.Set("Data", fields.encrypted_data.ToBuffer());
+    return record;
+  }
+
+  static Napi::Buffer<char> EndEncryptBinary(const Napi::Env &env,
+                                             const RecordFields &fields) {
+    BinaryEnvelope::Fields envelope;
+    envelope.created = fields.created;
+    envelope.parent_key_created = fields.parent_key_created;
+    envelope.key_id = fields.parent_key_id.get_data_ptr();
+    envelope.key_id_len = fields.parent_key_id.get_data_len_bytes();
+    envelope.encrypted_key = fields.encrypted_key.get_data_ptr();
+    envelope.encrypted_key_len = fields.encrypted_key.get_data_len_bytes();
+    envelope.data = fields.encrypted_data.get_data_ptr();
+    envelope.data_len = fields.encrypted_data.get_data_len_bytes();
+
+    auto output =
+        Napi::Buffer<char>::New(env, BinaryEnvelope::EncodedSize(envelope));
+    BinaryEnvelope::Write(output.Data(), envelope);
+    return output;
+  }
+
+  void BeginDecryptRecord(const Napi::Env &env, const char *func_name,
                           const Napi::CallbackInfo &info,
-                          Napi::String &partition_id, Napi::Value &input,
+                          Napi::String &partition_id,
                           size_t &partition_id_length) {
     RequireAsherahSetup(env, func_name);
 
@@ -574,73 +2009,460 @@ private:
 
     partition_id = NapiUtils::RequireParameterStringWithLength(
         env, func_name, info[0], partition_id_length);
-    input = NapiUtils::RequireParameterStringOrBuffer(env, func_name, info[1]);
-
     if (partition_id_length == 0) {
       NapiUtils::ThrowException(env, std::string(func_name) +
                                          ": Partition ID cannot be empty");
     }
   }
 
-  void EndEncryptToJson(Napi::Env env, CobhanBufferNapi &output, GoInt32 result,
-                        Napi::String &output_string) {
-    CheckResult(env, result);
-
-    output_string = output.ToString();
+  // Copies the fields of {Data, Key: {Created, Key, ParentKeyMeta:
+  // {KeyId, Created}}} into Cobhan buffers
+  RecordFields ParseRecordFields(const Napi::Env &env, const char *func_name,
+                                 const Napi::Value &value) {
+    Napi::Object record = RequireRecordObject(env, func_name, value, "record");
+    Napi::Object key =
+        RequireRecordObject(env, func_name, record.Get("Key"), "record.Key");
+    Napi::Object parent_key_meta =
+        RequireRecordObject(env, func_name, key.Get("ParentKeyMeta"),
+                            "record.Key.ParentKeyMeta");
+
+    Napi::Buffer<unsigned char> data =
+        NapiUtils::RequireParameterBuffer(env, func_name, record.Get("Data"));
+    Napi::Buffer<unsigned char> encrypted_key =
+        NapiUtils::RequireParameterBuffer(env, func_name, key.Get("Key"));
+    Napi::String parent_key_id = NapiUtils::RequireParameterString(
+        env, func_name, parent_key_meta.Get("KeyId"));
+
+    RecordFields fields(CobhanBufferNapi(env, data),
+                        CobhanBufferNapi(env, encrypted_key),
+                        CobhanBufferNapi(env, parent_key_id));
+    fields.created = RequireRecordTimestamp(env, func_name, key.Get("Created"),
+                                            "record.Key.Created");
+    fields.parent_key_created =
+        RequireRecordTimestamp(env, func_name, parent_key_meta.Get("Created"),
+                               "record.Key.ParentKeyMeta.Created");
+    return fields;
+  }
+
+  static Napi::Object RequireRecordObject(const Napi::Env &env,
+                                          const char *func_name,
+                                          const Napi::Value &value,
+                                          const char *name) {
+    if (unlikely(!value.IsObject())) {
+      NapiUtils::ThrowException(env, std::string(func_name) + ": Expected " +
+                                         name + " to be an Object");
+    }
+    return value.As<Napi::Object>();
+  }
+
+  static GoInt64 RequireRecordTimestamp(const Napi::Env &env,
+                                        const char *func_name,
+                                        const Napi::Value &value,
+                                        const char *name) {
+    if (unlikely(!value.IsNumber())) {
+      NapiUtils::ThrowException(env, std::string(func_name) + ": Expected " +
+                                         name + " to be a Number");
+    }
+    return value.As<Napi::Number>().Int64Value();
+  }
+
+  Napi::Value CreateStream(const Napi::CallbackInfo &info,
+                           const char *func_name, bool encrypt) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    try {
+      RequireAsherahSetup(env, func_name);
+
+      NapiUtils::RequireParameterCountRange(info, 1, encrypt ? 2 : 1);
+
+      size_t partition_id_length;
+      Napi::String partition_id_string =
+          NapiUtils::RequireParameterStringWithLength(env, func_name, info[0],
+                                                      partition_id_length);
+      if (partition_id_length == 0) {
+        NapiUtils::ThrowException(env, std::string(func_name) +
+                                           ": Partition ID cannot be empty");
+      }
+
+      auto state = std::make_shared<StreamState>();
+      state->encrypt = encrypt;
+      state->partition_id = std::make_shared<CobhanBufferNapi>(
+          env, partition_id_string, partition_id_length);
+      if (encrypt) {
+        state->chunk_size = RequireStreamChunkSize(env, func_name, info);
+        state->stream_id = StreamFraming::NewStreamId();
+        state->plaintext.reset(new char[state->chunk_size]);
+      }
+
+      Napi::Object options = Napi::Object::New(env);
+      options.Set("transform",
+                  Napi::Function::New(
+                      env,
+                      [this, state](const Napi::CallbackInfo &info) {
+                        StreamCallback(info, state, false);
+                      },
+                      "transform"));
+      options.Set("flush", Napi::Function::New(
+                               env,
+                               [this, state](const Napi::CallbackInfo &info) {
+                                 StreamCallback(info, state, true);
+                               },
+                               "flush"));
+      return GetTransformConstructor(env, func_name).New({options});
+    } catch (Napi::Error &e) {
+      e.ThrowAsJavaScriptException();
+      return env.Undefined();
+    } catch (const std::exception &e) {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  // Parses the optional { chunkSize } argument of createEncryptStream
+  size_t RequireStreamChunkSize(const Napi::Env &env, const char *func_name,
+                                const Napi::CallbackInfo &info) {
+    if (info.Length() < 2 || info[1].IsUndefined() || info[1].IsNull()) {
+      return StreamFraming::default_chunk_size;
+    }
+    if (unlikely(!info[1].IsObject())) {
+      NapiUtils::ThrowException(env, std::string(func_name) +
+                                         ": Expected options Object");
+    }
+    Napi::Value chunk_size = info[1].As<Napi::Object>().Get("chunkSize");
+    if (chunk_size.IsUndefined()) {
+      return StreamFraming::default_chunk_size;
+    }
+    if (unlikely(!chunk_size.IsNumber())) {
+      NapiUtils::ThrowException(env, std::string(func_name) +
+                                         ": chunkSize must be a Number");
+    }
+    int64_t value = chunk_size.As<Napi::Number>().Int64Value();
+    if (unlikely(value < static_cast<int64_t>(StreamFraming::min_chunk_size) ||
+                 value > static_cast<int64_t>(StreamFraming::max_chunk_size))) {
+      NapiUtils::ThrowException(
+          env, std::string(func_name) + ": chunkSize must be between " +
+                   std::to_string(StreamFraming::min_chunk_size) + " and " +
+                   std::to_string(StreamFraming::max_chunk_size));
+    }
+    return static_cast<size_t>(value);
+  }
+
+  // stream.Transform, looked up once.  Addons have no require(), and CJS
+  // and ESM callers alike are covered by process.getBuiltinModule (Node
+  // 20.16+ and 22.3+).
+  Napi::Function GetTransformConstructor(const Napi::Env &env,
+                                         const char *func_name) {
+    if (likely(!transform_constructor.IsEmpty())) {
+      return transform_constructor.Value();
+    }
+
+    Napi::Object process = env.Global().Get("process").As<Napi::Object>();
+    Napi::Value get_builtin_module = process.Get("getBuiltinModule");
+    if (unlikely(!get_builtin_module.IsFunction())) {
+      NapiUtils::ThrowException(
+          env, std::string(func_name) +
+                   ": Streams need process.getBuiltinModule (Node 20.16+)");
+    }
+    Napi::Value stream_module = get_builtin_module.As<Napi::Function>().Call(
+        process, {Napi::String::New(env, "stream")});
+
+    Napi::Value transform;
+    if (stream_module.IsObject()) {
+      transform = stream_module.As<Napi::Object>().Get("Transform");
+    }
+    if (unlikely(transform.IsEmpty() || !transform.IsFunction())) {
+      NapiUtils::ThrowException(env, std::string(func_name) +
+                                         ": Unable to load stream.Transform");
+    }
+    transform_constructor = Napi::Persistent(transform.As<Napi::Function>());
+    return transform_constructor.Value();
+  }
+
+  // Transform's transform(chunk, encoding, callback) and flush(callback).
+  // Errors are passed to the callback so the stream emits 'error'.
+  void StreamCallback(const Napi::CallbackInfo &info,
+                      const std::shared_ptr<StreamState> &state, bool flush) {
+    Napi::Env env = info.Env();
+    Napi::HandleScope scope(env);
+    const char *func_name = StreamName(*state);
+    Napi::Function callback = info[flush ? 0 : 2].As<Napi::Function>();
+    try {
+      RequireAsherahSetup(env, func_name);
+
+      Napi::Buffer<unsigned char> input;
+      if (!flush) {
+        input = NapiUtils::RequireParameterBuffer(env, func_name, info[0]);
+      }
+      QueueStreamBatch(env, state, info.This().As<Napi::Object>(), callback,
+                       input, 0, flush);
+    } catch (Napi::Error &e) {
+      callback.Call({e.Value()});
+    } catch (const std::exception &e) {
+      callback.Call({Napi::Error::New(env, e.what()).Value()});
+    }
+  }
+
+  // Queues the next batch of at most max_stream_batch_items chunks of input,
+  // starting at offset.  Each completed batch queues the next, and callback
+  // is only called once all of input has been through, so a large write()
+  // holds the writer back instead of being marshaled all at once.
+  void QueueStreamBatch(const Napi::Env &env,
+                        const std::shared_ptr<StreamState> &state,
+                        const Napi::Object &stream,
+                        const Napi::Function &callback,
+                        const Napi::Buffer<unsigned char> &input,
+                        size_t offset, bool flush) {
+    const char *func_name = StreamName(*state);
+    BatchState batch;
+    batch.encrypt = state->encrypt;
+    batch.groups.emplace_back();
+    batch.groups[0].partition_id = state->partition_id;
+
+    if (flush) {
+      BeginStreamFlush(env, func_name, *state, batch);
+    } else {
+      const char *data = reinterpret_cast<const char *>(input.Data()) + offset;
+      size_t len = input.Length() - offset;
+      offset += state->encrypt
+                    ? AddEncryptChunks(env, *state, batch, data, len)
+                    : AddDecryptFrames(env, func_name, *state, batch, data,
+                                       len);
+    }
+
+    if (batch.items.empty()) {
+      callback.Call({env.Null()});
+      return;
+    }
+    auto worker = new StreamWorker(this, state, batch, stream, callback,
+                                   input, offset);
+    CryptoThreadPool::Queue(crypto_pool.get(), env, worker);
+  }
+
+  // Cuts data into chunk_size chunks, carrying any remainder over to the
+  // next call, until the batch is full.  Whole chunks are copied straight
+  // from data.  Returns the number of bytes of data used.
+  size_t AddEncryptChunks(const Napi::Env &env, StreamState &state,
+                          BatchState &batch, const char *data, size_t len) {
+    size_t used = 0;
+    while (used < len && batch.items.size() < max_stream_batch_items) {
+      if (state.plaintext_len == 0 && len - used >= state.chunk_size) {
+        AddEncryptChunk(env, state, batch, data + used, state.chunk_size,
+                        false);
+        used += state.chunk_size;
+        continue;
+      }
+
+      size_t take =
+          std::min(len - used, state.chunk_size - state.plaintext_len);
+      std::memcpy(state.plaintext.get() + state.plaintext_len, data + used,
+                  take);
+      state.plaintext_len += take;
+      used += take;
+      if (state.plaintext_len == state.chunk_size) {
+        AddEncryptChunk(env, state, batch, state.plaintext.get(),
+                        state.plaintext_len, false);
+        secure_wipe_memory(state.plaintext.get(), state.plaintext_len);
+        state.plaintext_len = 0;
+      }
+    }
+    return used;
+  }
+
+  void AddEncryptChunk(const Napi::Env &env, StreamState &state,
+                       BatchState &batch, const char *data, size_t len,
+                       bool final) {
+    CobhanBufferNapi input(env, StreamFraming::chunk_header_size + len);
+    StreamFraming::WriteChunkHeader(
+        input.get_data_ptr(), {state.stream_id, state.next_sequence++, final});
+    if (len > 0) {
+      std::memcpy(input.get_data_ptr() + StreamFraming::chunk_header_size,
+                  data, len);
+    }
+    AddBatchInput(env, batch, 0, std::move(input));
   }
 
-  [[maybe_unused]] void
-  EndEncryptToJson(Napi::Env env, CobhanBufferNapi &output, GoInt32 result,
-                   Napi::Buffer<unsigned char> &output_buffer) {
-    CheckResult(env, result);
+  // Queues whole frames from data until the batch is full.  Frames are
+  // copied straight from data; only one split across writes is assembled
+  // in state.ciphertext.  Returns the number of bytes of data used.
+  size_t AddDecryptFrames(const Napi::Env &env, const char *func_name,
+                          StreamState &state, BatchState &batch,
+                          const char *data, size_t len) {
+    constexpr size_t prefix_size = StreamFraming::length_prefix_size;
+    auto &pending = state.ciphertext;
+    size_t used = 0;
+    // Moves up to want bytes of data into pending
+    auto carry = [&](size_t want) {
+      size_t take = std::min(want, len - used);
+      pending.insert(pending.end(), data + used, data + used + take);
+      used += take;
+    };
+
+    if (!state.magic_done) {
+      carry(StreamFraming::magic_size - pending.size());
+      if (pending.size() < StreamFraming::magic_size) {
+        return used;
+      }
+      if (unlikely(!StreamFraming::HasMagic(pending.data()))) {
+        NapiUtils::ThrowException(env, std::string(func_name) +
+                                           ": Not an Asherah stream");
+      }
+      pending.clear();
+      state.magic_done = true;
+    }
 
-    output_buffer = output.ToBuffer();
-  }
+    while (batch.items.size() < max_stream_batch_items) {
+      if (pending.empty() && len - used >= prefix_size) {
+        size_t frame_len = RequireFrameLength(env, func_name, data + used);
+        if (len - used - prefix_size >= frame_len) {
+          AddDecryptFrame(env, batch, data + used + prefix_size, frame_len);
+          used += prefix_size + frame_len;
+          continue;
+        }
+      }
 
-  void BeginDecryptFromJson(const Napi::Env &env, const char *func_name,
-                            const Napi::CallbackInfo &info,
-                            Napi::String &partition_id, Napi::Value &input,
-                            size_t &partition_id_length) {
-    RequireAsherahSetup(env, func_name);
+      // Frame split across writes
+      if (pending.size() < prefix_size) {
+        carry(prefix_size - pending.size());
+        if (pending.size() < prefix_size) {
+          break;
+        }
+      }
+      size_t frame_len = RequireFrameLength(env, func_name, pending.data());
+      carry(prefix_size + frame_len - pending.size());
+      if (pending.size() < prefix_size + frame_len) {
+        break;
+      }
+      AddDecryptFrame(env, batch, pending.data() + prefix_size, frame_len);
+      pending.clear();
+    }
+    return used;
+  }
 
-    NapiUtils::RequireParameterCount(info, 2);
+  void AddDecryptFrame(const Napi::Env &env, BatchState &batch,
+                       const char *frame, size_t frame_len) {
+    CobhanBufferNapi input(env, frame_len);
+    std::memcpy(input.get_data_ptr(), frame, frame_len);
+    AddBatchInput(env, batch, 0, std::move(input));
+  }
 
-    partition_id = NapiUtils::RequireParameterStringWithLength(
-        env, func_name, info[0], partition_id_length);
-    input = NapiUtils::RequireParameterStringOrBuffer(env, func_name, info[1]);
+  static size_t RequireFrameLength(const Napi::Env &env, const char *func_name,
+                                   const char *length_prefix) {
+    size_t frame_len = StreamFraming::ReadLengthPrefix(length_prefix);
+    if (unlikely(frame_len == 0 ||
+                 frame_len > StreamFraming::max_frame_size)) {
+      NapiUtils::ThrowException(env, std::string(func_name) +
+                                         ": Invalid frame length " +
+                                         std::to_string(frame_len));
+    }
+    return frame_len;
+  }
 
-    if (partition_id_length == 0) {
+  void BeginStreamFlush(const Napi::Env &env, const char *func_name,
+                        StreamState &state, BatchState &batch) {
+    if (state.encrypt) {
+      // The final chunk may be empty; it's what marks the end of the stream
+      AddEncryptChunk(env, state, batch, state.plaintext.get(),
+                      state.plaintext_len, true);
+      secure_wipe_memory(state.plaintext.get(), state.plaintext_len);
+      state.plaintext_len = 0;
+    } else if (unlikely(!state.final_seen || !state.ciphertext.empty())) {
       NapiUtils::ThrowException(env, std::string(func_name) +
-                                         ": Partition ID cannot be empty");
+                                         ": Stream is truncated");
     }
   }
 
-  void EndDecryptFromJson(Napi::Env &env, CobhanBufferNapi &output,
-                          GoInt32 result,
-                          Napi::Buffer<unsigned char> &output_buffer) {
-    CheckResult(env, result);
+  // Pushes the results of a stream batch: frames for encrypt, plaintext
+  // for decrypt after checking each chunk is the next one of this stream
+  void EndStreamBatch(const Napi::Env &env, StreamState &state,
+                      BatchState &batch, GoInt32 result,
+                      const Napi::Object &stream) {
+    const char *func_name = StreamName(state);
+    if (unlikely(result < 0)) {
+      NapiUtils::ThrowException(env, std::string(func_name) + ": " +
+                                         AsherahCobhanErrorToString(result));
+    }
 
-    output_buffer = output.ToBuffer();
-  }
+    Napi::Function push = stream.Get("push").As<Napi::Function>();
+    if (state.encrypt) {
+      if (!state.magic_done) {
+        push.Call(stream, {Napi::Buffer<char>::Copy(
+                              env, StreamFraming::magic,
+                              StreamFraming::magic_size)});
+        state.magic_done = true;
+      }
+      for (auto &item : batch.items) {
+        size_t drr_len = item.output.get_data_len_bytes();
+        auto frame = Napi::Buffer<char>::New(
+            env, StreamFraming::length_prefix_size + drr_len);
+        StreamFraming::WriteLengthPrefix(frame.Data(),
+                                         static_cast<uint32_t>(drr_len));
+        std::memcpy(frame.Data() + StreamFraming::length_prefix_size,
+                    item.output.get_data_ptr(), drr_len);
+        push.Call(stream, {frame});
+      }
+      return;
+    }
 
-  void EndDecryptFromJson(Napi::Env &env, CobhanBufferNapi &output,
-                          GoInt32 result, Napi::String &output_string) {
-    CheckResult(env, result);
+    for (auto &item : batch.items) {
+      const char *plaintext = item.output.get_data_ptr();
+      size_t plaintext_len = item.output.get_data_len_bytes();
+      StreamFraming::ChunkHeader header;
+      if (unlikely(!StreamFraming::ReadChunkHeader(plaintext, plaintext_len,
+                                                   header))) {
+        NapiUtils::ThrowException(env, std::string(func_name) +
+                                           ": Malformed chunk");
+      }
+      if (unlikely(state.final_seen)) {
+        NapiUtils::ThrowException(env, std::string(func_name) +
+                                           ": Data after final chunk");
+      }
+      if (state.next_sequence == 0) {
+        state.stream_id = header.stream_id;
+      } else if (unlikely(header.stream_id != state.stream_id)) {
+        NapiUtils::ThrowException(env, std::string(func_name) +
+                                           ": Chunk from another stream");
+      }
+      if (unlikely(header.sequence != state.next_sequence)) {
+        NapiUtils::ThrowException(env, std::string(func_name) +
+                                           ": Chunk out of sequence");
+      }
+      state.next_sequence++;
+      state.final_seen = header.final;
+
+      if (plaintext_len > StreamFraming::chunk_header_size) {
+        size_t data_len = plaintext_len - StreamFraming::chunk_header_size;
+        push.Call(stream,
+                  {Napi::Buffer<char>::Copy(
+                      env, plaintext + StreamFraming::chunk_header_size,
+                      data_len)});
+      }
+      item.output.secure_wipe_data();
+    }
+  }
 
-    output_string = output.ToString();
+  static const char *StreamName(const StreamState &state) {
+    return state.encrypt ? "encrypt stream" : "decrypt stream";
   }
 
   void BeginShutdownAsherah(const Napi::Env &env, const char *func_name,
                             const Napi::CallbackInfo &info) {
     RequireAsherahSetup(env, func_name);
     NapiUtils::RequireParameterCount(info, 0);
+
+    // Wipes every cached plaintext; decrypts still in flight aren't cached
+    decrypt_cache.Configure(0, {});
+    setup_state = SetupState::ShuttingDown;
   }
 
-  void EndShutdownAsherah(Napi::Env &env) {
-    auto old_setup_state = setup_state.exchange(0, std::memory_order_acq_rel);
-    if (unlikely(old_setup_state == 0)) {
-      NapiUtils::ThrowException(
-          env, "EndShutdownAsherah: lost race to mark setup_state?!");
+  // libasherah itself is only shut down when torn_down, by the last
+  // environment to leave
+  void EndShutdownAsherah(const Napi::Env &, bool torn_down) {
+    setup_state = SetupState::NotSetup;
+    setup_claim.reset();
+    if (unlikely(logger.debug_enabled())) {
+      logger.debug_log(__func__,
+                       torn_down ? "Shut down libasherah"
+                                 : "Left setup still used by other threads");
     }
   }
 
@@ -651,39 +2473,54 @@ private:
   class SetupAsherahWorker : public AsherahAsyncWorker<GoInt32> {
   public:
     SetupAsherahWorker(Napi::Env env, Asherah *instance,
-                       CobhanBufferNapi &config, size_t product_id_length,
-                       size_t service_name_length)
+                       CobhanBufferNapi &config, std::string shared_config,
+                       std::shared_ptr<SharedSetup::Claim> claim,
+                       const SetupSettings &settings)
         : AsherahAsyncWorker<GoInt32>(env, instance), config(std::move(config)),
-          product_id_length(product_id_length),
-          service_name_length(service_name_length) {}
+          shared_config(std::move(shared_config)), claim(std::move(claim)),
+          settings(settings) {}
 
-    GoInt32 ExecuteTask() override { return SetupJson(config); }
+    GoInt32 ExecuteTask() override {
+      return SharedSetup::Get().Acquire(
+          *claim, shared_config, [this] { return SetupJson(config); }, joined);
+    }
 
     Napi::Value OnOKTask(Napi::Env &env) override {
-      asherah->EndSetupAsherah(env, result, product_id_length,
-                               service_name_length);
+      asherah->EndSetupAsherah(env, result, joined, settings);
       return env.Undefined();
     }
 
+    // Joining with a different config
+    Napi::Value OnErrorTask(Napi::Env &,
+                            Napi::Error const &error) override {
+      asherah->setup_state = SetupState::NotSetup;
+      return error.Value();
+    }
+
   private:
     CobhanBufferNapi config;
-    size_t product_id_length;
-    size_t service_name_length;
+    std::string shared_config;
+    // Also held by the environment, which may go away before this completes
+    std::shared_ptr<SharedSetup::Claim> claim;
+    bool joined = false;
+    SetupSettings settings;
   };
 
   class EncryptAsherahWorker : public AsherahAsyncWorker<GoInt32> {
   public:
     EncryptAsherahWorker(const Napi::Env &env, Asherah *instance,
-                         CobhanBufferNapi &partition_id,
-                         CobhanBufferNapi &input, CobhanBufferNapi &output)
+                         std::shared_ptr<CobhanBufferNapi> partition_id,
+                         CobhanBufferNapi &input, CobhanBufferNapi &output,
+                         size_t retry_output_size)
         : AsherahAsyncWorker(env, instance),
           partition_id(std::move(partition_id)), input(std::move(input)),
-          output(std::move(output)) {}
+          output(std::move(output)), retry_output_size(retry_output_size) {}
 
     // extern GoInt32 EncryptToJson(void* partitionIdPtr, void* dataPtr,
     // void* jsonPtr);
     GoInt32 ExecuteTask() override {
-      return EncryptToJson(partition_id, input, output);
+      return CallWithOutputRetry(Env(), EncryptToJson, *partition_id, input,
+                                 output, retry_output_size);
     }
 
     Napi::Value OnOKTask(Napi::Env &env) override {
@@ -693,65 +2530,558 @@ private:
     }
 
   private:
-    CobhanBufferNapi partition_id;
+    // Shared with a partition handle, if the call came through one
+    std::shared_ptr<CobhanBufferNapi> partition_id;
     CobhanBufferNapi input;
     CobhanBufferNapi output;
+    size_t retry_output_size;
   };
 
   template <typename T>
   class DecryptFromJsonWorker : public AsherahAsyncWorker<GoInt32> {
   public:
     DecryptFromJsonWorker(const Napi::Env &env, Asherah *instance,
-                          CobhanBufferNapi &partition_id,
+                          std::shared_ptr<CobhanBufferNapi> partition_id,
                           CobhanBufferNapi &input, CobhanBufferNapi &output)
         : AsherahAsyncWorker(env, instance),
           partition_id(std::move(partition_id)), input(std::move(input)),
           output(std::move(output)) {}
 
     GoInt32 ExecuteTask() override {
-      return DecryptFromJson(partition_id, input, output);
+      // The DRR itself is always large enough to hold its plaintext
+      return CallWithOutputRetry(Env(), DecryptAnyEnvelope, *partition_id,
+                                 input, output, input.get_data_len_bytes());
     }
 
     Napi::Value OnOKTask(Napi::Env &env) override {
       T output_result;
       asherah->EndDecryptFromJson(env, output, result, output_result);
+      asherah->CacheDecrypted(*partition_id, input, DataView(output));
       return output_result; // NOLINT(*-slicing)
     }
 
+  private:
+    std::shared_ptr<CobhanBufferNapi> partition_id;
+    CobhanBufferNapi input;
+    CobhanBufferNapi output;
+  };
+
+  // Runs EncryptToJson or DecryptFromJson and copies the result into a
+  // caller-provided Buffer from the worker thread
+  class OutputIntoWorker : public AsherahAsyncWorker<GoInt32> {
+  public:
+    OutputIntoWorker(const Napi::Env &env, Asherah *instance,
+                     CobhanFunction function, CobhanBufferNapi &partition_id,
+                     CobhanBufferNapi &input, CobhanBufferNapi &output,
+                     size_t retry_output_size,
+                     Napi::Buffer<unsigned char> &output_buffer,
+                     size_t output_offset)
+        : AsherahAsyncWorker(env, instance), function(function),
+          partition_id(std::move(partition_id)), input(std::move(input)),
+          output(std::move(output)), retry_output_size(retry_output_size),
+          output_data(output_buffer.Data()),
+          output_length(output_buffer.Length()), output_offset(output_offset),
+          pinned_output_buffer(Napi::Persistent(
+              output_buffer.As<Napi::Object>())) {}
+
+    GoInt32 ExecuteTask() override {
+      GoInt32 function_result = CallWithOutputRetry(
+          Env(), function, partition_id, input, output, retry_output_size);
+      if (function_result >= 0) {
+        required_bytes = CopyOutputInto(output, output_data, output_length,
+                                        output_offset);
+        // Don't leave plaintext behind in the intermediate buffer
+        output.secure_wipe_data();
+      }
+      return function_result;
+    }
+
+    Napi::Value OnOKTask(Napi::Env &env) override {
+      asherah->CheckResult(env, result);
+      return Napi::Number::New(env, static_cast<double>(required_bytes));
+    }
+
+  private:
+    CobhanFunction function;
+    CobhanBufferNapi partition_id;
+    CobhanBufferNapi input;
+    CobhanBufferNapi output;
+    size_t retry_output_size;
+    unsigned char *output_data;
+    size_t output_length;
+    size_t output_offset;
+    size_t required_bytes = 0;
+    // Keeps the caller's Buffer alive until the worker has written to it
+    Napi::ObjectReference pinned_output_buffer;
+  };
+
+  // Decrypts into memory reserved from an OutputSlabAllocator and resolves
+  // with a view of it
+  class DecryptToSlabWorker : public AsherahAsyncWorker<GoInt32> {
+  public:
+    DecryptToSlabWorker(const Napi::Env &env, Asherah *instance,
+                        std::shared_ptr<CobhanBufferNapi> partition_id,
+                        CobhanBufferNapi &input, CobhanBufferNapi &output,
+                        const OutputSlabAllocator::Reservation &reservation)
+        : AsherahAsyncWorker(env, instance),
+          partition_id(std::move(partition_id)), input(std::move(input)),
+          output(std::move(output)), output_cbuffer(reservation.cbuffer),
+          output_allocation_size(reservation.allocation_size),
+          pinned_backing(Napi::Persistent(
+              reservation.backing.As<Napi::Object>())) {}
+
+    GoInt32 ExecuteTask() override {
+      PhaseTrace::Span trace("asherah", PhaseTrace::CurrentOp());
+      return DecryptAnyEnvelope(*partition_id, input, output);
+    }
+
+    Napi::Value OnOKTask(Napi::Env &env) override {
+      auto reservation = OutputSlabAllocator::Restore(
+          pinned_backing.Value().As<Napi::Buffer<unsigned char>>(),
+          output_cbuffer, output_allocation_size);
+      size_t output_max_data_size = output.get_max_data_size();
+      size_t output_len_bytes = output.get_data_len_bytes();
+      {
+        // Verifies the canaries now, before Commit or Abandon wipes them
+        CobhanBufferNapi released(std::move(output));
+      }
+      if (unlikely(result < 0)) {
+        asherah->output_slabs.Abandon(reservation);
+        asherah->CheckResult(env, result);
+      }
+      MarshalCounters::RecordEstimate(false, output_max_data_size,
+                                      output_len_bytes, false);
+      auto output_buffer =
+          asherah->output_slabs.Commit(env, reservation, output_len_bytes);
+      asherah->CacheDecrypted(*partition_id, input, BufferView(output_buffer));
+      return output_buffer;
+    }
+
+  private:
+    std::shared_ptr<CobhanBufferNapi> partition_id;
+    CobhanBufferNapi input;
+    CobhanBufferNapi output;
+    char *output_cbuffer;
+    size_t output_allocation_size;
+    Napi::ObjectReference pinned_backing;
+  };
+
+  // Runs a whole encrypt/decrypt batch in a single Execute
+  class BatchWorker : public AsherahAsyncWorker<GoInt32> {
+  public:
+    BatchWorker(const Napi::Env &env, Asherah *instance, const char *func_name,
+                BatchState &batch)
+        : AsherahAsyncWorker(env, instance), func_name(func_name),
+          batch(std::move(batch)) {}
+
+    GoInt32 ExecuteTask() override { return RunBatch(Env(), batch); }
+
+    Napi::Value OnOKTask(Napi::Env &env) override {
+      return asherah->EndBatch(env, func_name, batch, result);
+    }
+
+  private:
+    const char *func_name;
+    BatchState batch;
+  };
+
+  class EncryptRecordWorker : public AsherahAsyncWorker<GoInt32> {
+  public:
+    EncryptRecordWorker(const Napi::Env &env, Asherah *instance,
+                        CobhanBufferNapi &partition_id, CobhanBufferNapi &input,
+                        RecordFields &fields, bool binary)
+        : AsherahAsyncWorker(env, instance),
+          partition_id(std::move(partition_id)), input(std::move(input)),
+          fields(std::move(fields)), binary(binary) {}
+
+    GoInt32 ExecuteTask() override {
+      return CallEncryptRecord(partition_id, input, fields);
+    }
+
+    Napi::Value OnOKTask(Napi::Env &env) override {
+      return asherah->EndEncryptFields(env, fields, result, binary);
+    }
+
   private:
     CobhanBufferNapi partition_id;
     CobhanBufferNapi input;
+    RecordFields fields;
+    bool binary;
+  };
+
+  class DecryptRecordWorker : public AsherahAsyncWorker<GoInt32> {
+  public:
+    DecryptRecordWorker(const Napi::Env &env, Asherah *instance,
+                        CobhanBufferNapi &partition_id, RecordFields &fields,
+                        CobhanBufferNapi &output)
+        : AsherahAsyncWorker(env, instance),
+          partition_id(std::move(partition_id)), fields(std::move(fields)),
+          output(std::move(output)) {}
+
+    GoInt32 ExecuteTask() override {
+      return CallDecryptRecord(partition_id, fields, output);
+    }
+
+    Napi::Value OnOKTask(Napi::Env &env) override {
+      Napi::Buffer<unsigned char> output_buffer;
+      asherah->EndDecryptFromJson(env, output, result, output_buffer);
+      return output_buffer;
+    }
+
+  private:
+    CobhanBufferNapi partition_id;
+    RecordFields fields;
     CobhanBufferNapi output;
   };
 
+  // Runs a stream batch and completes the Transform callback rather than a
+  // promise
+  class StreamWorker : public CryptoThreadPool::Task {
+  public:
+    // input is the rest of the write() being processed, if any, with
+    // next_offset where the next batch starts
+    StreamWorker(Asherah *instance, const std::shared_ptr<StreamState> &state,
+                 BatchState &batch, const Napi::Object &stream,
+                 const Napi::Function &callback,
+                 const Napi::Buffer<unsigned char> &input, size_t next_offset)
+        : asherah(instance), state(state), batch(std::move(batch)),
+          next_offset(next_offset), stream_ref(Napi::Persistent(stream)),
+          callback_ref(Napi::Persistent(callback)) {
+      if (!input.IsEmpty() && next_offset < input.Length()) {
+        input_ref = Napi::Persistent(input);
+      }
+    }
+
+    void Run() override {
+      try {
+        result = RunBatch(stream_ref.Env(), batch);
+      } catch (const std::exception &e) {
+        error_message = e.what();
+        failed = true;
+      }
+    }
+
+    void Complete(Napi::Env env) override {
+      {
+        Napi::HandleScope scope(env);
+        Napi::Value error = env.Null();
+        try {
+          if (unlikely(failed)) {
+            NapiUtils::ThrowException(env, error_message);
+          }
+          asherah->EndStreamBatch(env, *state, batch, result,
+                                  stream_ref.Value());
+          if (!input_ref.IsEmpty()) {
+            // The callback passes to the next batch
+            asherah->QueueStreamBatch(env, state, stream_ref.Value(),
+                                      callback_ref.Value(), input_ref.Value(),
+                                      next_offset, false);
+            delete this;
+            return;
+          }
+        } catch (Napi::Error &e) {
+          error = e.Value();
+        } catch (const std::exception &e) {
+          error = Napi::Error::New(env, e.what()).Value();
+        }
+        Napi::Function callback = callback_ref.Value();
+        delete this;
+        callback.Call({error});
+      }
+    }
+
+  private:
+    Asherah *asherah;
+    std::shared_ptr<StreamState> state;
+    BatchState batch;
+    size_t next_offset;
+    Napi::Reference<Napi::Buffer<unsigned char>> input_ref;
+    GoInt32 result = 0;
+    bool failed = false;
+    std::string error_message;
+    Napi::ObjectReference stream_ref;
+    Napi::FunctionReference callback_ref;
+  };
+
   class ShutdownAsherahWorker : public AsherahAsyncWorker<GoInt32> {
   public:
-    using AsherahAsyncWorker::AsherahAsyncWorker;
+    ShutdownAsherahWorker(Napi::Env env, Asherah *instance,
+                          std::shared_ptr<SharedSetup::Claim> claim,
+                          std::unique_ptr<CryptoThreadPool> crypto_pool)
+        : AsherahAsyncWorker<GoInt32>(env, instance), claim(std::move(claim)),
+          crypto_pool(std::move(crypto_pool)) {}
 
     // extern void Shutdown();
     GoInt32 ExecuteTask() override {
-      Shutdown();
+      // Let in-flight crypto finish before libasherah goes away, joining the
+      // pool's threads here rather than on the JS thread
+      if (crypto_pool) {
+        crypto_pool->Stop();
+      }
+      torn_down = SharedSetup::Get().Release(*claim, Shutdown);
       return 0;
     }
 
     Napi::Value OnOKTask(Napi::Env &env) override {
-      asherah->EndShutdownAsherah(env);
+      asherah->EndShutdownAsherah(env, torn_down);
       return env.Undefined();
     }
+
+  private:
+    std::shared_ptr<SharedSetup::Claim> claim;
+    // Destroyed with the worker, back on the JS thread
+    std::unique_ptr<CryptoThreadPool> crypto_pool;
+    bool torn_down = false;
   };
 
 #pragma endregion AsyncWorkers
 
 #pragma region Helpers
 
+  // Registers method under name, timed for get_metrics
+  template <Napi::Value (Asherah::*method)(const Napi::CallbackInfo &)>
+  Napi::ClassPropertyDescriptor<Asherah> Measured(const char *name) {
+    return InstanceMethod(name, &Asherah::Measure<method>, napi_default,
+                          metrics.Add(name));
+  }
+
+  template <void (Asherah::*method)(const Napi::CallbackInfo &)>
+  Napi::ClassPropertyDescriptor<Asherah> Measured(const char *name) {
+    return InstanceMethod(name, &Asherah::Measure<method>, napi_default,
+                          metrics.Add(name));
+  }
+
+  // The payload, where there is one, is always the second argument
+  template <Napi::Value (Asherah::*method)(const Napi::CallbackInfo &)>
+  Napi::Value Measure(const Napi::CallbackInfo &info) {
+    OperationMetrics::Scope operation(metrics, info.Data(),
+                                      MeasuredSizeClass(info));
+    PhaseTrace::Phase trace(metrics.Name(info.Data()), PhaseTrace::NewOp());
+    return (this->*method)(info);
+  }
+
+  template <void (Asherah::*method)(const Napi::CallbackInfo &)>
+  void Measure(const Napi::CallbackInfo &info) {
+    OperationMetrics::Scope operation(metrics, info.Data(),
+                                      MeasuredSizeClass(info));
+    PhaseTrace::Phase trace(metrics.Name(info.Data()), PhaseTrace::NewOp());
+    (this->*method)(info);
+  }
+
+  static size_t MeasuredSizeClass(const Napi::CallbackInfo &info) {
+    return info.Length() > 1 ? OperationMetrics::SizeClass(info[1]) : 0;
+  }
+
   void CheckResult(const Napi::Env &env, GoInt32 result) {
     if (unlikely(result < 0)) {
+      OperationMetrics::RecordError(result);
       NapiUtils::ThrowException(env, AsherahCobhanErrorToString(result));
     }
   }
 
+  // Queues an *_async encrypt of input, which it takes over
+  Napi::Value QueueEncrypt(const Napi::Env &env,
+                           std::shared_ptr<CobhanBufferNapi> partition_id,
+                           CobhanBufferNapi &input,
+                           size_t asherah_output_size_bytes) {
+    CobhanBufferNapi output(env, asherah_output_size_bytes);
+    auto worker = new EncryptAsherahWorker(
+        env, this, std::move(partition_id), input, output,
+        AsherahOutputSize::EncryptRetrySize(asherah_output_size_bytes));
+    worker->Queue(crypto_pool.get());
+    return worker->Promise();
+  }
+
+  // Queues an *_async decrypt of input, which it takes over, unless the
+  // decrypt cache already has the answer
+  template <typename T>
+  Napi::Value QueueDecrypt(const Napi::Env &env,
+                           std::shared_ptr<CobhanBufferNapi> partition_id,
+                           CobhanBufferNapi &input) {
+    std::string_view cached;
+    if (FindDecrypted(*partition_id, input, cached)) {
+      return ResolvedPromise(env, CachedResult<T>(env, cached));
+    }
+
+    size_t output_data_size;
+    GoInt32 scan_result = ScanDecryptInput(input, output_data_size);
+    if (unlikely(scan_result < 0)) {
+      return RejectedPromise(env, scan_result);
+    }
+
+    if constexpr (std::is_same_v<T, Napi::Buffer<unsigned char>>) {
+      if (decrypt_slabs_enabled) {
+        size_t output_allocation_size =
+            CobhanBuffer::DataSizeToAllocationSize(input.get_data_len_bytes());
+        auto reservation = output_slabs.Reserve(env, output_allocation_size);
+        CobhanBufferNapi output(env, reservation.cbuffer,
+                                output_allocation_size, true);
+        auto worker =
+            new DecryptToSlabWorker(env, this, std::move(partition_id), input,
+                                    output, reservation);
+        worker->Queue(crypto_pool.get());
+        return worker->Promise();
+      }
+    }
+
+    CobhanBufferNapi output(env, output_data_size);
+    auto worker = new DecryptFromJsonWorker<T>(
+        env, this, std::move(partition_id), input, output);
+    worker->Queue(crypto_pool.get());
+    return worker->Promise();
+  }
+
+  void DefinePartitionMethods() {
+    partition_methods = {
+        {"encrypt", &Asherah::PartitionEncrypt,
+         metrics.Add("partition.encrypt")},
+        {"encrypt_async", &Asherah::PartitionEncryptAsync,
+         metrics.Add("partition.encrypt_async")},
+        {"decrypt", &Asherah::PartitionDecrypt<Napi::Buffer<unsigned char>>,
+         metrics.Add("partition.decrypt")},
+        {"decrypt_async",
+         &Asherah::PartitionDecryptAsync<Napi::Buffer<unsigned char>>,
+         metrics.Add("partition.decrypt_async")},
+        {"decrypt_string", &Asherah::PartitionDecrypt<Napi::String>,
+         metrics.Add("partition.decrypt_string")},
+        {"decrypt_string_async", &Asherah::PartitionDecryptAsync<Napi::String>,
+         metrics.Add("partition.decrypt_string_async")},
+    };
+  }
+
+  // Timed like Measure; the payload is the only argument
+  Napi::Value CallPartitionMethod(const Napi::CallbackInfo &info,
+                                  const PartitionMethodEntry &entry,
+                                  const PartitionHandle &handle) {
+    OperationMetrics::Scope operation(
+        metrics, entry.metrics_id,
+        info.Length() > 0 ? OperationMetrics::SizeClass(info[0]) : 0);
+    PhaseTrace::Phase trace(metrics.Name(entry.metrics_id),
+                            PhaseTrace::NewOp());
+    return (this->*entry.method)(info, handle);
+  }
+
+  Napi::Value BeginPartitionCall(const Napi::Env &env, const char *func_name,
+                                 const Napi::CallbackInfo &info) {
+    RequireAsherahSetup(env, func_name);
+    NapiUtils::RequireParameterCount(info, 1);
+    return NapiUtils::RequireParameterStringOrBuffer(env, func_name, info[0]);
+  }
+
+  // The settings libasherah itself is set up with, as sorted name=JSON
+  // lines, so environments joining the shared setup can be checked against
+  // it.  Settings the addon applies per environment are left out.
+  static std::string SharedConfig(const Napi::Env &env,
+                                  const Napi::Object &config_json) {
+    static constexpr const char *addon_settings[] = {
+        "Verbose",
+        "EnableCanaries",
+        "EnableDecryptSlabs",
+        "NativeThreadPoolSize",
+        "DecryptCacheMaxBytes",
+        "DecryptCacheDuration",
+    };
+    Napi::Function stringify = env.Global()
+                                   .Get("JSON")
+                                   .As<Napi::Object>()
+                                   .Get("stringify")
+                                   .As<Napi::Function>();
+
+    std::vector<std::string> settings;
+    Napi::Array names = config_json.GetPropertyNames();
+    for (uint32_t i = 0; i < names.Length(); i++) {
+      std::string name = names.Get(i).As<Napi::String>().Utf8Value();
+      auto is_name = [&name](const char *setting) { return name == setting; };
+      if (std::any_of(std::begin(addon_settings), std::end(addon_settings),
+                      is_name)) {
+        continue;
+      }
+      Napi::Value value = config_json.Get(name);
+      if (value.IsUndefined() || value.IsNull()) {
+        continue;
+      }
+      settings.push_back(
+          name + "=" + stringify.Call({value}).As<Napi::String>().Utf8Value());
+    }
+    std::sort(settings.begin(), settings.end());
+
+    std::string shared_config;
+    for (const std::string &setting : settings) {
+      shared_config.append(setting).push_back('\n');
+    }
+    return shared_config;
+  }
+
+  // Drops entries for handles that have been collected, amortized by
+  // letting the map double between passes
+  void PrunePartitionHandles() {
+    if (likely(partition_handles.size() < partition_handles_prune_at)) {
+      return;
+    }
+    for (auto it = partition_handles.begin(); it != partition_handles.end();) {
+      if (it->second.Value().IsEmpty()) {
+        it = partition_handles.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    partition_handles_prune_at =
+        std::max(min_partition_handles_prune, 2 * partition_handles.size());
+  }
+
+  // Decrypts straight into a V8 slab and returns a view of the plaintext
+  Napi::Buffer<unsigned char> DecryptIntoSlab(const Napi::Env &env,
+                                              CobhanBufferNapi &partition_id,
+                                              CobhanBufferNapi &input) {
+    size_t output_data_size = RequireDecryptOutputSize(env, input);
+    size_t estimated_data_size = output_data_size;
+    for (;;) {
+      size_t output_allocation_size =
+          CobhanBuffer::DataSizeToAllocationSize(output_data_size);
+      auto reservation = output_slabs.Reserve(env, output_allocation_size);
+
+      GoInt32 result;
+      size_t output_len_bytes;
+      {
+        // Scoped so the canaries are verified before the space can be reused
+        CobhanBufferNapi output(env, reservation.cbuffer,
+                                output_allocation_size, true);
+        PhaseTrace::Span trace("asherah", PhaseTrace::CurrentOp());
+        result = DecryptAnyEnvelope(partition_id, input, output);
+        output_len_bytes = output.get_data_len_bytes();
+      }
+
+      if (likely(result >= 0)) {
+        bool retried = output_data_size != estimated_data_size;
+        MarshalCounters::RecordEstimate(false, estimated_data_size,
+                                        output_len_bytes, retried);
+        return output_slabs.Commit(env, reservation, output_len_bytes);
+      }
+      output_slabs.Abandon(reservation);
+      if (result != -3 || output_data_size >= input.get_data_len_bytes()) {
+        CheckResult(env, result);
+      }
+      // See CallWithOutputRetry
+      output_data_size = input.get_data_len_bytes();
+    }
+  }
+
+  // Copies output into dest at dest_offset if it fits and returns the number
+  // of bytes it needs either way
+  static size_t CopyOutputInto(const CobhanBuffer &output,
+                               unsigned char *dest, size_t dest_length,
+                               size_t dest_offset) {
+    size_t output_len_bytes = output.get_data_len_bytes();
+    if (output_len_bytes <= dest_length - dest_offset) {
+      std::memcpy(dest + dest_offset, output.get_data_ptr(), output_len_bytes);
+      MarshalCounters::Add(MarshalCounters::Counter::CopyOutInto,
+                           output_len_bytes);
+    }
+    return output_len_bytes;
+  }
+
   void RequireAsherahSetup(const Napi::Env &env, const char *func_name) {
-    if (unlikely(setup_state.load(std::memory_order_acquire) == 0)) {
+    if (unlikely(setup_state != SetupState::Ready)) {
       NapiUtils::ThrowException(
           env,
           std::string(func_name) + ": RequireAsherahSetup: setup() not called");
@@ -759,35 +3089,218 @@ private:
   }
 
   void RequireAsherahNotSetup(const Napi::Env &env, const char *func_name) {
-    if (unlikely(setup_state.load(std::memory_order_acquire) != 0)) {
+    if (unlikely(setup_state != SetupState::NotSetup)) {
       NapiUtils::ThrowException(
           env, std::string(func_name) +
                    ": RequireAsherahNotSetup: setup() already called");
     }
   }
 
+  // Feeds the adaptive stack cutoff unless set_max_stack_alloc_item_size has
+  // pinned it to a fixed value
+  __attribute__((always_inline)) inline void
+  RecordStackAllocSize(size_t allocation_size) {
+    if (adaptive_stack_alloc && stack_alloc_cutoff.Record(allocation_size)) {
+      maximum_stack_alloc_size = stack_alloc_cutoff.Cutoff();
+    }
+  }
+
   [[nodiscard]] __attribute__((always_inline)) inline size_t
-  EstimateAsherahOutputSize(size_t data_byte_len,
-                            size_t partition_byte_len) const {
-    const size_t est_encryption_overhead = 48;
-    const size_t est_envelope_overhead = 185;
-    const double base64_overhead = 1.34;
+  EstimateAsherahOutputSize(const CobhanBuffer &input,
+                            const CobhanBuffer &partition_id) const {
+    return EstimateAsherahOutputSize(
+        input, AsherahOutputSize::JsonEscapedLength(
+                   partition_id.get_data_ptr(),
+                   partition_id.get_data_len_bytes()));
+  }
+
+  [[nodiscard]] size_t
+  EstimateAsherahOutputSize(const CobhanBuffer &input,
+                            size_t partition_id_json_length) const {
+    return AsherahOutputSize::EncryptOutputSize(input.get_data_len_bytes(),
+                                                partition_id_json_length,
+                                                est_intermediate_key_overhead);
+  }
 
-    // Only check for overflow if suspiciously large (> 1TB)
-    if (unlikely(data_byte_len > 1099511627776ULL)) {
-      if (data_byte_len > SIZE_MAX / 2) {
-        throw std::invalid_argument("Data size too large for encryption");
+  // Sizes the plaintext of a DRR or binary envelope.  Input libasherah
+  // would reject as malformed fails here, on the calling thread, with the
+  // error it would have returned, and without a trip through cgo.
+  [[nodiscard]] static GoInt32 ScanDecryptInput(const CobhanBuffer &input,
+                                                size_t &output_data_size) {
+    const char *data = input.get_data_ptr();
+    size_t len = input.get_data_len_bytes();
+    output_data_size = 0;
+
+    if (unlikely(BinaryEnvelope::HasMagic(data, len))) {
+      BinaryEnvelope::Fields envelope;
+      if (unlikely(!BinaryEnvelope::Parse(data, len, envelope))) {
+        return invalid_binary_envelope;
       }
+      output_data_size = PlaintextSize(envelope.data_len);
+      return 0;
+    }
+
+    DrrScanner::Fields fields;
+    switch (DrrScanner::Scan(data, len, fields)) {
+    case DrrScanner::Result::Invalid:
+      return json_decode_failed;
+    case DrrScanner::Result::Valid:
+      if (likely(fields.data.data != nullptr)) {
+        output_data_size = PlaintextSize(
+            Base64::DecodedLength(fields.data.data, fields.data.len));
+        return 0;
+      }
+      break;
+    case DrrScanner::Result::Unknown:
+      break;
+    }
+    output_data_size = AsherahOutputSize::DecryptOutputSize(data, len);
+    return 0;
+  }
+
+  size_t RequireDecryptOutputSize(const Napi::Env &env,
+                                  const CobhanBuffer &input) {
+    size_t output_data_size;
+    CheckResult(env, ScanDecryptInput(input, output_data_size));
+    return output_data_size;
+  }
+
+  static constexpr size_t PlaintextSize(size_t ciphertext_len) {
+    return ciphertext_len > AsherahOutputSize::aead_overhead_bytes
+               ? ciphertext_len - AsherahOutputSize::aead_overhead_bytes
+               : 0;
+  }
+
+  // Settles an *_async call that failed before any work was queued
+  static Napi::Value RejectedPromise(const Napi::Env &env, GoInt32 result) {
+    OperationMetrics::RecordError(result);
+    Napi::Promise::Deferred deferred(env);
+    deferred.Reject(
+        Napi::Error::New(env, AsherahCobhanErrorToString(result)).Value());
+    return deferred.Promise();
+  }
+
+  // Settles an *_async call answered without queueing any work
+  static Napi::Value ResolvedPromise(const Napi::Env &env,
+                                     const Napi::Value &value) {
+    Napi::Promise::Deferred deferred(env);
+    deferred.Resolve(value);
+    return deferred.Promise();
+  }
+
+  static std::string_view DataView(const CobhanBuffer &buffer) {
+    return {buffer.get_data_ptr(), buffer.get_data_len_bytes()};
+  }
+
+  static std::string_view
+  BufferView(const Napi::Buffer<unsigned char> &buffer) {
+    return {reinterpret_cast<const char *>(buffer.Data()), buffer.Length()};
+  }
+
+  bool FindDecrypted(const CobhanBuffer &partition_id,
+                     const CobhanBuffer &input, std::string_view &plaintext) {
+    return decrypt_cache.enabled() &&
+           decrypt_cache.Find(DataView(partition_id), DataView(input),
+                              plaintext);
+  }
+
+  void CacheDecrypted(const CobhanBuffer &partition_id,
+                      const CobhanBuffer &input, std::string_view plaintext) {
+    if (decrypt_cache.enabled()) {
+      decrypt_cache.Insert(DataView(partition_id), DataView(input), plaintext);
+    }
+  }
+
+  static Napi::Buffer<unsigned char> CachedBuffer(const Napi::Env &env,
+                                                  std::string_view plaintext) {
+    MarshalCounters::Add(MarshalCounters::Counter::CopyOutBuffer,
+                         plaintext.size());
+    return Napi::Buffer<unsigned char>::Copy(
+        env, reinterpret_cast<const unsigned char *>(plaintext.data()),
+        plaintext.size());
+  }
+
+  static Napi::String CachedString(const Napi::Env &env,
+                                   std::string_view plaintext) {
+    MarshalCounters::Add(MarshalCounters::Counter::CopyOutString,
+                         plaintext.size());
+    return Napi::String::New(env, plaintext.data(), plaintext.size());
+  }
+
+  template <typename T>
+  static T CachedResult(const Napi::Env &env, std::string_view plaintext) {
+    if constexpr (std::is_same_v<T, Napi::String>) {
+      return CachedString(env, plaintext);
+    } else {
+      return CachedBuffer(env, plaintext);
+    }
+  }
+
+  // extern GoInt32 DecryptFromJson(void* partitionIdPtr, void* jsonPtr,
+  // void* dataPtr);
+  // Same signature, but also accepts a binary envelope, which it takes
+  // apart and passes to Decrypt
+  static GoInt32 DecryptAnyEnvelope(void *partition_id, void *input,
+                                    void *output) {
+    int32_t input_len;
+    std::memcpy(&input_len, input, sizeof(input_len));
+    const char *envelope =
+        static_cast<const char *>(input) + CobhanBuffer::HeaderSizeBytes();
+    if (likely(input_len < 0 ||
+               !BinaryEnvelope::HasMagic(envelope,
+                                         static_cast<size_t>(input_len)))) {
+      return DecryptFromJson(partition_id, input, output);
+    }
+
+    BinaryEnvelope::Fields fields;
+    if (unlikely(!BinaryEnvelope::Parse(
+            envelope, static_cast<size_t>(input_len), fields))) {
+      return invalid_binary_envelope;
     }
+    CobhanBuffer encrypted_data(fields.data_len);
+    CopyIntoCobhanBuffer(encrypted_data, fields.data, fields.data_len);
+    CobhanBuffer encrypted_key(fields.encrypted_key_len);
+    CopyIntoCobhanBuffer(encrypted_key, fields.encrypted_key,
+                         fields.encrypted_key_len);
+    CobhanBuffer parent_key_id(fields.key_id_len);
+    CopyIntoCobhanBuffer(parent_key_id, fields.key_id, fields.key_id_len);
+
+    return Decrypt(partition_id, encrypted_data, encrypted_key,
+                   fields.created, parent_key_id, fields.parent_key_created,
+                   output);
+  }
 
-    // Add one rather than using std::ceil to round up
-    size_t est_data_byte_len =
-        size_t(double(data_byte_len + est_encryption_overhead) *
-               base64_overhead) +
-        1;
+  static void CopyIntoCobhanBuffer(CobhanBuffer &dest, const char *data,
+                                   size_t len) {
+    if (len > 0) {
+      std::memcpy(dest.get_data_ptr(), data, len);
+    }
+  }
 
-    return est_envelope_overhead + est_intermediate_key_overhead +
-           partition_byte_len + est_data_byte_len;
+  // libasherah returns -3 if the output buffer is too small.  The estimates
+  // above should never be short, but if they are retry once into a heap
+  // buffer of retry_data_size bytes rather than failing the call.
+  static GoInt32 CallWithOutputRetry(const Napi::Env &env,
+                                     CobhanFunction function,
+                                     CobhanBufferNapi &partition_id,
+                                     CobhanBufferNapi &input,
+                                     CobhanBufferNapi &output,
+                                     size_t retry_data_size) {
+    PhaseTrace::Span trace("asherah", PhaseTrace::CurrentOp());
+    size_t estimated_data_size = output.get_max_data_size();
+    GoInt32 result = function(partition_id, input, output);
+    bool retried = false;
+    if (unlikely(result == -3 && retry_data_size > estimated_data_size)) {
+      output = CobhanBufferNapi(env, retry_data_size);
+      result = function(partition_id, input, output);
+      retried = true;
+    }
+    if (likely(result >= 0)) {
+      MarshalCounters::RecordEstimate(function == EncryptToJson,
+                                      estimated_data_size,
+                                      output.get_data_len_bytes(), retried);
+    }
+    return result;
   }
 
   __attribute__((always_inline)) static inline const char *
@@ -825,6 +3338,8 @@ private:
       return "Asherah error: Decrypt operation failed";
     case -105:
       return "Asherah error: Invalid configuration";
+    case invalid_binary_envelope:
+      return "Asherah error: Invalid binary envelope";
     default:
       return "Unknown error";
     }
@@ -1,6 +1,8 @@
 // noinspection JSUnusedGlobalSymbols,DuplicatedCode
 
 /// <reference types="node" />
+import type { Transform } from "stream";
+
 export type AsherahConfig = {
     /** The name of this service (Required) */
     readonly ServiceName: string;
@@ -44,25 +46,189 @@ export type AsherahConfig = {
     readonly DisableZeroCopy: boolean | null;
     /** Enable canary buffer corruption checks (default: false) */
     readonly EnableCanaries: boolean | null;
+    /** Return decrypt output as views of pooled ArrayBuffer slabs instead of copies (default: false) */
+    readonly EnableDecryptSlabs?: boolean | null;
+    /** Run *_async work on this many dedicated native threads instead of libuv's thread pool, settling completions in batches (default: 0, use libuv) */
+    readonly NativeThreadPoolSize?: number | null;
+    /** Cache decrypted plaintext in memory, up to this many bytes (default: 0, off) */
+    readonly DecryptCacheMaxBytes?: number | null;
+    /** Seconds a cached plaintext stays valid (default: 60) */
+    readonly DecryptCacheDuration?: number | null;
+};
+
+/** An item for encrypt_many/decrypt_many: data is the plaintext or the DRR respectively */
+export type AsherahBatchItem = {
+    readonly partition: string;
+    readonly data: Buffer | string;
+};
+
+/** A DataRowRecord with binary fields, as returned by encrypt_record */
+export type AsherahRecord = {
+    readonly Key: {
+        readonly Created: number;
+        /** The encrypted data key */
+        readonly Key: Buffer;
+        readonly ParentKeyMeta: {
+            readonly KeyId: string;
+            readonly Created: number;
+        };
+    };
+    /** The encrypted data */
+    readonly Data: Buffer;
+};
+
+/** Options for createEncryptStream */
+export type AsherahStreamOptions = {
+    /** Plaintext bytes per encrypted chunk (Default 65536, 1024 to 16777216) */
+    readonly chunkSize?: number;
+};
+
+/** Wall time in nanoseconds of the calls in one payload size class */
+export type AsherahLatencyStats = {
+    readonly count: number;
+    readonly min: number;
+    readonly mean: number;
+    readonly p50: number;
+    readonly p90: number;
+    readonly p99: number;
+    readonly p999: number;
+    readonly max: number;
+};
+
+/** Per-method call metrics, keyed by method name, as returned by get_metrics */
+export type AsherahMetrics = {
+    readonly [method: string]: {
+        readonly calls: number;
+        /** Failure counts keyed by error message */
+        readonly errors: { readonly [message: string]: number };
+        /** Keyed by payload size class: none, 256B, 4KB, 64KB, 1MB or large */
+        readonly sizes: { readonly [sizeClass: string]: AsherahLatencyStats };
+    };
+};
+
+/** Number of events and bytes involved */
+export type AsherahMarshalTotals = {
+    readonly count: number;
+    readonly bytes: number;
+};
+
+/** How the output buffers sized before calling Asherah compared to the output */
+export type AsherahEstimateStats = {
+    readonly count: number;
+    readonly estimated_bytes: number;
+    readonly actual_bytes: number;
+    /** estimated_bytes / actual_bytes */
+    readonly ratio: number;
+    /** Calls whose estimate was too small and had to be retried */
+    readonly retries: number;
+};
+
+/** Process-wide marshaling counters, as returned by get_marshal_stats */
+export type AsherahMarshalStats = {
+    readonly allocations: {
+        readonly stack: AsherahMarshalTotals;
+        readonly heap: AsherahMarshalTotals;
+        readonly pooled: AsherahMarshalTotals;
+    };
+    readonly copies: {
+        readonly in_string: AsherahMarshalTotals;
+        readonly in_buffer: AsherahMarshalTotals;
+        /** allocate() Buffers passed to Asherah without a copy */
+        readonly in_place: AsherahMarshalTotals;
+        /** Stack buffers copied to the heap for async calls */
+        readonly move: AsherahMarshalTotals;
+        readonly out_string: AsherahMarshalTotals;
+        readonly out_buffer: AsherahMarshalTotals;
+        readonly out_into: AsherahMarshalTotals;
+        /** Slab-allocated results returned without a copy */
+        readonly out_slab: AsherahMarshalTotals;
+    };
+    readonly estimates: {
+        readonly encrypt: AsherahEstimateStats;
+        readonly decrypt: AsherahEstimateStats;
+    };
+};
+
+/** Decrypt cache counters, as returned by get_decrypt_cache_stats */
+export type AsherahDecryptCacheStats = {
+    readonly enabled: boolean;
+    readonly hits: number;
+    readonly misses: number;
+    /** Entries evicted to stay within DecryptCacheMaxBytes */
+    readonly evictions: number;
+    /** Entries found past DecryptCacheDuration */
+    readonly expirations: number;
+    readonly entries: number;
+    readonly bytes: number;
+};
+
+/** Methods bound to one partition ID, as returned by partition */
+export type AsherahPartition = {
+    readonly id: string;
+    encrypt(data: Buffer | string): string;
+    encrypt_async(data: Buffer | string): Promise<string>;
+    decrypt(dataRowRecord: Buffer | string): Buffer;
+    decrypt_async(dataRowRecord: Buffer | string): Promise<Buffer>;
+    decrypt_string(dataRowRecord: Buffer | string): string;
+    decrypt_string_async(dataRowRecord: Buffer | string): Promise<string>;
 };
 
-/** Callback function type for log hook */
+/**
+ * Callback function type for log hook, called in batches on the event loop.
+ * Exceptions it throws are caught and reported through process.emitWarning
+ * (type AsherahLogHookWarning); the rest of the batch is still delivered.
+ */
 export type LogHookCallback = (level: number, message: string) => void;
 
+/** True when the addon was built against the null-crypto stub (ASHERAH_STUB=1), which does not encrypt */
+export declare const is_stub: boolean;
 export declare function setup(config: AsherahConfig): void;
 export declare function setup_async(config: AsherahConfig): Promise<void>;
 export declare function shutdown(): void;
 export declare function shutdown_async(): Promise<void>;
-export declare function decrypt(partitionId: string, dataRowRecord: string): Buffer;
-export declare function decrypt_async(partitionId: string, dataRowRecord: string): Promise<Buffer>;
+export declare function decrypt(partitionId: string, dataRowRecord: string | Buffer): Buffer;
+export declare function decrypt_async(partitionId: string, dataRowRecord: string | Buffer): Promise<Buffer>;
 export declare function encrypt(partitionId: string, data: Buffer): string;
 export declare function encrypt_async(partitionId: string, data: Buffer): Promise<string>;
-export declare function decrypt_string(partitionId: string, dataRowRecord: string): string;
-export declare function decrypt_string_async(partitionId: string, dataRowRecord: string): Promise<string>;
+export declare function decrypt_string(partitionId: string, dataRowRecord: string | Buffer): string;
+export declare function decrypt_string_async(partitionId: string, dataRowRecord: string | Buffer): Promise<string>;
 export declare function encrypt_string(partitionId: string, data: string): string;
 export declare function encrypt_string_async(partitionId: string, data: string): Promise<string>;
+export declare function encrypt_into(partitionId: string, data: Buffer | string, output: Buffer, offset?: number): number;
+export declare function encrypt_into_async(partitionId: string, data: Buffer | string, output: Buffer, offset?: number): Promise<number>;
+export declare function decrypt_into(partitionId: string, dataRowRecord: Buffer | string, output: Buffer, offset?: number): number;
+export declare function decrypt_into_async(partitionId: string, dataRowRecord: Buffer | string, output: Buffer, offset?: number): Promise<number>;
+export declare function encrypt_batch(partitionId: string, data: (Buffer | string)[]): string[];
+export declare function encrypt_batch_async(partitionId: string, data: (Buffer | string)[]): Promise<string[]>;
+export declare function decrypt_batch(partitionId: string, dataRowRecords: (Buffer | string)[]): Buffer[];
+export declare function decrypt_batch_async(partitionId: string, dataRowRecords: (Buffer | string)[]): Promise<Buffer[]>;
+export declare function encrypt_many(items: AsherahBatchItem[]): string[];
+export declare function encrypt_many_async(items: AsherahBatchItem[]): Promise<string[]>;
+export declare function decrypt_many(items: AsherahBatchItem[]): Buffer[];
+export declare function decrypt_many_async(items: AsherahBatchItem[]): Promise<Buffer[]>;
+export declare function encrypt_record(partitionId: string, data: Buffer | string): AsherahRecord;
+export declare function encrypt_record_async(partitionId: string, data: Buffer | string): Promise<AsherahRecord>;
+export declare function encrypt_binary(partitionId: string, data: Buffer | string): Buffer;
+export declare function encrypt_binary_async(partitionId: string, data: Buffer | string): Promise<Buffer>;
+export declare function decrypt_record(partitionId: string, record: AsherahRecord): Buffer;
+export declare function decrypt_record_async(partitionId: string, record: AsherahRecord): Promise<Buffer>;
+export declare function partition(partitionId: string): AsherahPartition;
+export declare function createEncryptStream(partitionId: string, options?: AsherahStreamOptions): Transform;
+export declare function createDecryptStream(partitionId: string): Transform;
+/**
+ * Largest buffer the sync functions put on the stack.  Sizes at or above it
+ * go to the heap.  A non-negative value pins the cutoff (up to 1MB); a
+ * negative value returns to the default adaptive cutoff, which follows recent
+ * payload sizes between 2KB and 64KB.
+ */
 export declare function set_max_stack_alloc_item_size(max_item_size: number): void;
 export declare function set_safety_padding_overhead(safety_padding_overhead: number): void;
 export declare function set_log_hook(logHook: LogHookCallback): void;
 export declare function get_setup_status(): boolean;
+export declare function get_metrics(reset?: boolean): AsherahMetrics;
+export declare function get_marshal_stats(reset?: boolean): AsherahMarshalStats;
+export declare function get_decrypt_cache_stats(reset?: boolean): AsherahDecryptCacheStats;
+export declare function set_trace_enabled(enabled: boolean, events_per_thread?: number): void;
+export declare function dump_trace(clear?: boolean): string;
 export declare function setenv(environment: string): void;
+export declare function allocate(size: number): Buffer;
@@ -1,23 +1,41 @@
 #ifndef ASHERAH_ASYNC_WORKER_H
 #define ASHERAH_ASYNC_WORKER_H
 
+#include "crypto_thread_pool.h"
+#include "operation_metrics.h"
+#include "phase_trace.h"
 #include <napi.h>
 #include <stdexcept>
+#include <string>
 
 class Asherah;
 
+// Promise-returning async task.  Runs on a CryptoThreadPool when given one
+// and on libuv's pool otherwise.
 template <typename ResultType>
-class AsherahAsyncWorker : public Napi::AsyncWorker {
+class AsherahAsyncWorker : public CryptoThreadPool::Task {
 public:
   Napi::Promise Promise() { return deferred.Promise(); }
 
   AsherahAsyncWorker(Napi::Env env, Asherah *instance)
-      : Napi::AsyncWorker(env), asherah(instance), deferred(env) {}
+      : task_env(env), asherah(instance), deferred(env),
+        operation(OperationMetrics::TakeCurrent()),
+        trace_op(PhaseTrace::CurrentOp()) {}
+
+  void Queue(CryptoThreadPool *pool = nullptr) {
+    if (unlikely(trace_op != 0)) {
+      queued_ns = PhaseTrace::Clock::Now().wall_ns;
+    }
+    CryptoThreadPool::Queue(pool, task_env, this);
+  }
 
 protected:
+  Napi::Env task_env;
   Asherah *asherah;
   ResultType result;
 
+  Napi::Env Env() const { return task_env; }
+
   virtual ResultType ExecuteTask() = 0;
   virtual Napi::Value OnOKTask(Napi::Env &env) = 0;
   virtual Napi::Value OnErrorTask(Napi::Env &, Napi::Error const &error) {
@@ -26,34 +44,46 @@ protected:
 
 private:
   Napi::Promise::Deferred deferred;
+  // Timed until the Promise settles
+  OperationMetrics::Operation operation;
+  uint64_t trace_op;
+  int64_t queued_ns = 0;
+  bool failed = false;
+  std::string error_message;
 
-  void Execute() final {
+  void Run() final {
+    PhaseTrace::RecordWait("queued", trace_op, queued_ns);
+    PhaseTrace::Phase phase("execute", trace_op);
     try {
       result = ExecuteTask();
     } catch (const std::exception &ex) {
-      SetError(ex.what());
+      failed = true;
+      error_message = ex.what();
     }
   }
 
-  void OnOK() final {
-    Napi::Env env = Env();
-    Napi::HandleScope scope(env);
-    try {
-      auto value = OnOKTask(env);
-      deferred.Resolve(value);
-    } catch (const std::exception &e) {
-      deferred.Reject(Napi::Error::New(Env(), e.what()).Value());
-    }
-  }
-
-  void OnError(Napi::Error const &error) final {
-    Napi::Env env = Env();
-    Napi::HandleScope scope(Env());
-    try {
-      deferred.Reject(OnErrorTask(env, error));
-    } catch (const std::exception &e) {
-      deferred.Reject(Napi::Error::New(Env(), e.what()).Value());
+  void Complete(Napi::Env env) final {
+    {
+      Napi::HandleScope scope(env);
+      OperationMetrics::Scope operation_scope(std::move(operation));
+      PhaseTrace::Phase phase("complete", trace_op);
+      if (failed) {
+        Napi::Error error = Napi::Error::New(env, error_message);
+        try {
+          deferred.Reject(OnErrorTask(env, error));
+        } catch (const std::exception &e) {
+          deferred.Reject(Napi::Error::New(env, e.what()).Value());
+        }
+      } else {
+        try {
+          auto value = OnOKTask(env);
+          deferred.Resolve(value);
+        } catch (const std::exception &e) {
+          deferred.Reject(Napi::Error::New(env, e.what()).Value());
+        }
+      }
     }
+    delete this;
   }
 };
 
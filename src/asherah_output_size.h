@@ -0,0 +1,168 @@
+#ifndef ASHERAH_OUTPUT_SIZE_H
+#define ASHERAH_OUTPUT_SIZE_H
+
+#include "hints.h" // for unlikely
+#include <cstddef> // for size_t
+#include <cstring> // for std::memcmp
+
+/*
+  Integer sizing of libasherah outputs so Cobhan output buffers can be
+  allocated at (or just above) the size actually written.
+
+  An encrypted DataRowRecord from EncryptToJson looks like:
+
+    {"Key":{"Created":N,"Key":"<b64>","ParentKeyMeta":
+      {"KeyId":"_IK_<partition>_<service>_<product>","Created":N}},
+     "Data":"<b64>"}
+
+  where Data is AES-256-GCM output (nonce + ciphertext + tag) and Key is the
+  data key encrypted the same way by the intermediate key.
+*/
+class AsherahOutputSize {
+public:
+  static constexpr size_t Base64EncodedLength(size_t data_len_bytes) {
+    return ((data_len_bytes + 2) / 3) * 4;
+  }
+
+  // Length of a UTF-8 string once escaped by Go's encoding/json.  Strings
+  // handed to libasherah come from V8 and are always valid UTF-8; the worst
+  // case multi-byte expansion is U+2028/U+2029 (3 bytes -> 6).
+  static size_t JsonEscapedLength(const char *data, size_t len) {
+    size_t escaped_len = 0;
+    for (size_t i = 0; i < len; i++) {
+      auto c = static_cast<unsigned char>(data[i]);
+      if (likely(c >= 0x20 && c < 0x80)) {
+        switch (c) {
+        case '"':
+        case '\\':
+          escaped_len += 2;
+          break;
+        case '<':
+        case '>':
+        case '&':
+          escaped_len += 6; // as \u003c
+          break;
+        default:
+          escaped_len += 1;
+        }
+      } else if (c < 0x20) {
+        escaped_len += (c == '\n' || c == '\r' || c == '\t') ? 2 : 6;
+      } else {
+        escaped_len += 2;
+      }
+    }
+    return escaped_len;
+  }
+
+  // Size of the DRR EncryptToJson produces for data_len_bytes of plaintext.
+  // key_id_escaped_len is the escaped length of service name + product ID.
+  static size_t EncryptOutputSize(size_t data_len_bytes,
+                                  size_t partition_escaped_len,
+                                  size_t key_id_escaped_len) {
+    return envelope_fixed_bytes + 2 * max_timestamp_digits +
+           Base64EncodedLength(encrypted_key_bytes) + partition_escaped_len +
+           key_id_escaped_len +
+           Base64EncodedLength(data_len_bytes + aead_overhead_bytes);
+  }
+
+  // Used if libasherah still reports the output buffer is too small, e.g. a
+  // future envelope format with extra fields
+  static size_t EncryptRetrySize(size_t estimated_size) {
+    return estimated_size * 2 + retry_slack_bytes;
+  }
+
+  // Plaintext size for a DRR, from the length of its base64 "Data" value.
+  // Falls back to the DRR length (always large enough) if the DRR doesn't
+  // look like one; libasherah reports the real error.
+  static size_t DecryptOutputSize(const char *drr, size_t drr_len) {
+    size_t data_len;
+    size_t padding;
+    if (unlikely(!FindDataValue(drr, drr_len, data_len, padding))) {
+      return drr_len;
+    }
+    // Escapes only make the raw value longer than the base64 it decodes to,
+    // so this never undershoots
+    size_t decoded_len = (data_len / 4) * 3 + ((data_len % 4) * 3) / 4;
+    decoded_len = decoded_len > padding ? decoded_len - padding : 0;
+    return decoded_len > aead_overhead_bytes
+               ? decoded_len - aead_overhead_bytes
+               : 0;
+  }
+
+  // Encrypt returns the DRR fields separately and unencoded
+  static constexpr size_t EncryptedDataSize(size_t data_len_bytes) {
+    return data_len_bytes + aead_overhead_bytes;
+  }
+
+  // "_IK_<partition>_<service>_<product>", plus room for a region suffix
+  static constexpr size_t ParentKeyIdSize(size_t partition_len,
+                                          size_t key_id_escaped_len) {
+    return partition_len + key_id_escaped_len + key_id_fixed_bytes;
+  }
+
+  static constexpr size_t aead_overhead_bytes = 12 + 16; // GCM nonce + tag
+  static constexpr size_t encrypted_key_bytes = 32 + aead_overhead_bytes;
+
+private:
+  static constexpr size_t key_id_fixed_bytes = 6 + 64;
+  static constexpr size_t max_timestamp_digits = 20; // int64 with sign
+  // Structural JSON including an optional "Revoked":true, and the _IK_ and
+  // separator characters of the key ID
+  static constexpr size_t envelope_fixed_bytes = 100;
+  static constexpr size_t retry_slack_bytes = 4096;
+
+  // Finds the top level "Data" string value.  Inside JSON strings quotes are
+  // always escaped, so an unescaped "Data" followed by a colon is the key.
+  static bool FindDataValue(const char *drr, size_t drr_len, size_t &data_len,
+                            size_t &padding) {
+    static constexpr char key[] = "\"Data\"";
+    static constexpr size_t key_len = sizeof(key) - 1;
+    if (drr_len < key_len) {
+      return false;
+    }
+
+    for (size_t i = 0; i + key_len <= drr_len; i++) {
+      if (drr[i] != '"' || std::memcmp(drr + i, key, key_len) != 0 ||
+          (i > 0 && drr[i - 1] == '\\')) {
+        continue;
+      }
+
+      size_t pos = SkipWhitespace(drr, drr_len, i + key_len);
+      if (pos >= drr_len || drr[pos] != ':') {
+        continue;
+      }
+      pos = SkipWhitespace(drr, drr_len, pos + 1);
+      if (pos >= drr_len || drr[pos] != '"') {
+        return false;
+      }
+
+      size_t start = pos + 1;
+      size_t end = start;
+      while (end < drr_len && drr[end] != '"') {
+        end += drr[end] == '\\' ? 2 : 1;
+      }
+      if (end >= drr_len) {
+        return false;
+      }
+
+      data_len = end - start;
+      padding = 0;
+      while (padding < 2 && end - padding > start &&
+             drr[end - padding - 1] == '=') {
+        padding++;
+      }
+      return true;
+    }
+    return false;
+  }
+
+  static size_t SkipWhitespace(const char *drr, size_t drr_len, size_t pos) {
+    while (pos < drr_len && (drr[pos] == ' ' || drr[pos] == '\t' ||
+                             drr[pos] == '\n' || drr[pos] == '\r')) {
+      pos++;
+    }
+    return pos;
+  }
+};
+
+#endif // ASHERAH_OUTPUT_SIZE_H
@@ -0,0 +1,616 @@
+#include "base64.h"
+#include "hints.h" // for likely, unlikely
+#include <cstdint> // for uint8_t, uint32_t
+
+#if defined(__x86_64__)
+#define BASE64_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define BASE64_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+constexpr char encode_table[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+constexpr uint8_t invalid_char = 0xff;
+
+struct DecodeTable {
+  uint8_t values[256] = {};
+
+  constexpr DecodeTable() {
+    for (auto &value : values) {
+      value = invalid_char;
+    }
+    for (uint8_t i = 0; i < 64; i++) {
+      values[static_cast<uint8_t>(encode_table[i])] = i;
+    }
+  }
+};
+
+constexpr DecodeTable decode_table;
+
+// Bulk kernels process a prefix of the input and return how much of it they
+// consumed; the scalar code does the rest.  Decode and validate kernels
+// always leave the last group, the only one that may be padded, to it.
+struct Kernels {
+  size_t (*encode)(const uint8_t *src, size_t len, char *dest);
+  size_t (*decode)(const char *src, size_t len, uint8_t *dest, bool &valid);
+  size_t (*validate)(const char *src, size_t len, bool &valid);
+};
+
+#pragma region Scalar
+
+size_t EncodeBulkScalar(const uint8_t *, size_t, char *) { return 0; }
+
+size_t DecodeBulkScalar(const char *, size_t, uint8_t *, bool &) { return 0; }
+
+size_t ValidateBulkScalar(const char *, size_t, bool &) { return 0; }
+
+void EncodeScalar(const uint8_t *src, size_t len, char *dest) {
+  size_t i = 0;
+  for (; i + 3 <= len; i += 3) {
+    uint32_t group = (static_cast<uint32_t>(src[i]) << 16) |
+                     (static_cast<uint32_t>(src[i + 1]) << 8) | src[i + 2];
+    dest[0] = encode_table[group >> 18];
+    dest[1] = encode_table[(group >> 12) & 0x3f];
+    dest[2] = encode_table[(group >> 6) & 0x3f];
+    dest[3] = encode_table[group & 0x3f];
+    dest += 4;
+  }
+
+  size_t remaining = len - i;
+  if (remaining == 0) {
+    return;
+  }
+  uint32_t group = static_cast<uint32_t>(src[i]) << 16;
+  if (remaining == 2) {
+    group |= static_cast<uint32_t>(src[i + 1]) << 8;
+  }
+  dest[0] = encode_table[group >> 18];
+  dest[1] = encode_table[(group >> 12) & 0x3f];
+  dest[2] = remaining == 2 ? encode_table[(group >> 6) & 0x3f] : '=';
+  dest[3] = '=';
+}
+
+// Decodes one group of four characters, the last of which may be padded.
+// Returns the number of bytes it decodes to, or 0 if it's invalid.
+size_t DecodeGroup(const char *src, bool last, uint32_t &group) {
+  size_t padding = 0;
+  if (last && src[3] == '=') {
+    padding = src[2] == '=' ? 2 : 1;
+  }
+
+  group = 0;
+  for (size_t j = 0; j < 4 - padding; j++) {
+    uint8_t value = decode_table.values[static_cast<uint8_t>(src[j])];
+    if (unlikely(value == invalid_char)) {
+      return 0;
+    }
+    group |= static_cast<uint32_t>(value) << (18 - 6 * j);
+  }
+  return 3 - padding;
+}
+
+bool DecodeScalar(const char *src, size_t len, uint8_t *dest) {
+  for (size_t i = 0; i < len; i += 4) {
+    uint32_t group;
+    size_t decoded_len = DecodeGroup(src + i, i + 4 == len, group);
+    if (unlikely(decoded_len == 0)) {
+      return false;
+    }
+    for (size_t j = 0; j < decoded_len; j++) {
+      *dest++ = static_cast<uint8_t>(group >> (16 - 8 * j));
+    }
+  }
+  return true;
+}
+
+bool ValidateScalar(const char *src, size_t len) {
+  for (size_t i = 0; i < len; i += 4) {
+    uint32_t group;
+    if (unlikely(DecodeGroup(src + i, i + 4 == len, group) == 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#pragma endregion Scalar
+
+#ifdef BASE64_X86
+#pragma region SSE4.1 and AVX2
+
+// Both x86 kernels follow Wojciech Muła's base64 SIMD algorithms: a byte
+// shuffle and two multiplies to split 3 bytes into 4 sextets, and pshufb
+// lookups on the high and low nibble of each character to translate and
+// validate.  The AVX2 versions run the same steps on two 128-bit lanes.
+
+__attribute__((target("sse4.1"))) inline __m128i
+EncodeSextetsSse(__m128i in) {
+  in = _mm_shuffle_epi8(
+      in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  __m128i sextets = _mm_or_si128(t1, t3);
+
+  __m128i offset_index = _mm_subs_epu8(sextets, _mm_set1_epi8(51));
+  __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), sextets);
+  offset_index =
+      _mm_or_si128(offset_index, _mm_and_si128(less, _mm_set1_epi8(13)));
+  __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                  '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                  '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                  '/' - 63, 'A', 0, 0);
+  return _mm_add_epi8(_mm_shuffle_epi8(offsets, offset_index), sextets);
+}
+
+// Translates characters to sextets.  Returns false if any is invalid.
+__attribute__((target("sse4.1"))) inline bool DecodeSextetsSse(__m128i in,
+                                                               __m128i &out) {
+  __m128i high_nibble =
+      _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+  __m128i low_nibble = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+
+  __m128i shifts = _mm_shuffle_epi8(
+      _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0),
+      high_nibble);
+  __m128i is_slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+  shifts = _mm_blendv_epi8(shifts, _mm_set1_epi8(16), is_slash);
+
+  // Bit n of mask[low nibble] is set if (n << 4 | low nibble) is valid
+  __m128i masks = _mm_shuffle_epi8(
+      _mm_setr_epi8(static_cast<char>(0xa8), static_cast<char>(0xf8),
+                    static_cast<char>(0xf8), static_cast<char>(0xf8),
+                    static_cast<char>(0xf8), static_cast<char>(0xf8),
+                    static_cast<char>(0xf8), static_cast<char>(0xf8),
+                    static_cast<char>(0xf8), static_cast<char>(0xf8),
+                    static_cast<char>(0xf0), 0x54, 0x50, 0x50, 0x50, 0x54),
+      low_nibble);
+  __m128i bits = _mm_shuffle_epi8(
+      _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40,
+                    static_cast<char>(0x80), 0, 0, 0, 0, 0, 0, 0, 0),
+      high_nibble);
+  __m128i invalid =
+      _mm_cmpeq_epi8(_mm_and_si128(masks, bits), _mm_setzero_si128());
+  if (unlikely(_mm_movemask_epi8(invalid) != 0)) {
+    return false;
+  }
+  out = _mm_add_epi8(in, shifts);
+  return true;
+}
+
+// Packs 16 sextets into 12 bytes at the bottom of the register
+__attribute__((target("sse4.1"))) inline __m128i PackSextetsSse(__m128i in) {
+  __m128i pairs = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+  __m128i packed = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+  return _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                                14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("sse4.1"))) size_t
+EncodeBulkSse41(const uint8_t *src, size_t len, char *dest) {
+  size_t i = 0;
+  // 16 byte loads of which 12 are used
+  for (; len - i >= 16; i += 12) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest), EncodeSextetsSse(in));
+    dest += 16;
+  }
+  return i;
+}
+
+__attribute__((target("sse4.1"))) size_t
+DecodeBulkSse41(const char *src, size_t len, uint8_t *dest, bool &valid) {
+  size_t i = 0;
+  // 16 byte stores of which 12 are used; at least 8 more characters (4
+  // bytes of output) always follow, so the extra 4 bytes stay in bounds
+  for (; len - i >= 24; i += 16) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i sextets;
+    if (unlikely(!DecodeSextetsSse(in, sextets))) {
+      valid = false;
+      return i;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest),
+                     PackSextetsSse(sextets));
+    dest += 12;
+  }
+  return i;
+}
+
+__attribute__((target("sse4.1"))) size_t
+ValidateBulkSse41(const char *src, size_t len, bool &valid) {
+  size_t i = 0;
+  for (; len - i > 16; i += 16) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i sextets;
+    if (unlikely(!DecodeSextetsSse(in, sextets))) {
+      valid = false;
+      return i;
+    }
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) inline __m256i EncodeSextetsAvx2(__m256i in) {
+  in = _mm256_shuffle_epi8(
+      in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                           1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+  __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+  __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+  __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+  __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+  __m256i sextets = _mm256_or_si256(t1, t3);
+
+  __m256i offset_index = _mm256_subs_epu8(sextets, _mm256_set1_epi8(51));
+  __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), sextets);
+  offset_index = _mm256_or_si256(offset_index,
+                                 _mm256_and_si256(less, _mm256_set1_epi8(13)));
+  __m256i offsets = _mm256_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  return _mm256_add_epi8(_mm256_shuffle_epi8(offsets, offset_index), sextets);
+}
+
+__attribute__((target("avx2"))) inline bool DecodeSextetsAvx2(__m256i in,
+                                                              __m256i &out) {
+  __m256i high_nibble =
+      _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+  __m256i low_nibble = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+
+  __m256i shifts = _mm256_shuffle_epi8(
+      _mm256_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0,
+                       0, 0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0,
+                       0, 0),
+      high_nibble);
+  __m256i is_slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+  shifts = _mm256_blendv_epi8(shifts, _mm256_set1_epi8(16), is_slash);
+
+  const char m0 = static_cast<char>(0xa8);
+  const char m1 = static_cast<char>(0xf8);
+  const char m10 = static_cast<char>(0xf0);
+  __m256i masks = _mm256_shuffle_epi8(
+      _mm256_setr_epi8(m0, m1, m1, m1, m1, m1, m1, m1, m1, m1, m10, 0x54, 0x50,
+                       0x50, 0x50, 0x54, m0, m1, m1, m1, m1, m1, m1, m1, m1,
+                       m1, m10, 0x54, 0x50, 0x50, 0x50, 0x54),
+      low_nibble);
+  const char b7 = static_cast<char>(0x80);
+  __m256i bits = _mm256_shuffle_epi8(
+      _mm256_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, b7, 0, 0, 0,
+                       0, 0, 0, 0, 0, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40,
+                       b7, 0, 0, 0, 0, 0, 0, 0, 0),
+      high_nibble);
+  __m256i invalid =
+      _mm256_cmpeq_epi8(_mm256_and_si256(masks, bits), _mm256_setzero_si256());
+  if (unlikely(_mm256_movemask_epi8(invalid) != 0)) {
+    return false;
+  }
+  out = _mm256_add_epi8(in, shifts);
+  return true;
+}
+
+// Packs 32 sextets into 24 contiguous bytes
+__attribute__((target("avx2"))) inline __m256i PackSextetsAvx2(__m256i in) {
+  __m256i pairs = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+  __m256i packed = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+  packed = _mm256_shuffle_epi8(
+      packed,
+      _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                       2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  return _mm256_permutevar8x32_epi32(
+      packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+}
+
+__attribute__((target("avx2"))) size_t
+EncodeBulkAvx2(const uint8_t *src, size_t len, char *dest) {
+  size_t i = 0;
+  // Two 16 byte loads per iteration, 12 bytes of each used
+  for (; len - i >= 28; i += 24) {
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i high =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 12));
+    __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest),
+                        EncodeSextetsAvx2(in));
+    dest += 32;
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) size_t
+DecodeBulkAvx2(const char *src, size_t len, uint8_t *dest, bool &valid) {
+  size_t i = 0;
+  // 32 byte stores of which 24 are used; at least 16 more characters (10
+  // bytes of output) always follow
+  for (; len - i >= 48; i += 32) {
+    __m256i in =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    __m256i sextets;
+    if (unlikely(!DecodeSextetsAvx2(in, sextets))) {
+      valid = false;
+      return i;
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest),
+                        PackSextetsAvx2(sextets));
+    dest += 24;
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) size_t
+ValidateBulkAvx2(const char *src, size_t len, bool &valid) {
+  size_t i = 0;
+  for (; len - i > 32; i += 32) {
+    __m256i in =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    __m256i sextets;
+    if (unlikely(!DecodeSextetsAvx2(in, sextets))) {
+      valid = false;
+      return i;
+    }
+  }
+  return i;
+}
+
+#pragma endregion SSE4.1 and AVX2
+#endif // BASE64_X86
+
+#ifdef BASE64_NEON
+#pragma region NEON
+
+// NEON has de-interleaving loads and 64 byte table lookups, so each lane of
+// a vld3/vld4 holds one position of every group and no shuffles are needed.
+
+// Sextet + 1 for each of the 128 ASCII characters, 0 if invalid, split
+// into the two 64 entry tables vqtbl4q_u8 can index
+struct NeonDecodeTables {
+  uint8_t low[64] = {};
+  uint8_t high[64] = {};
+
+  constexpr NeonDecodeTables() {
+    for (size_t c = 0; c < 128; c++) {
+      uint8_t value = decode_table.values[c];
+      uint8_t entry = value == invalid_char ? 0 : value + 1;
+      if (c < 64) {
+        low[c] = entry;
+      } else {
+        high[c - 64] = entry;
+      }
+    }
+  }
+};
+
+constexpr NeonDecodeTables neon_decode_tables;
+
+inline uint8x16x4_t LoadTable(const uint8_t *table) {
+  uint8x16x4_t result;
+  result.val[0] = vld1q_u8(table);
+  result.val[1] = vld1q_u8(table + 16);
+  result.val[2] = vld1q_u8(table + 32);
+  result.val[3] = vld1q_u8(table + 48);
+  return result;
+}
+
+// Translates 64 characters to sextets.  Returns false if any is invalid.
+inline bool DecodeSextetsNeon(const char *src, uint8x16x4_t &sextets) {
+  const uint8x16x4_t low_table = LoadTable(neon_decode_tables.low);
+  const uint8x16x4_t high_table = LoadTable(neon_decode_tables.high);
+  uint8x16x4_t in = vld4q_u8(reinterpret_cast<const uint8_t *>(src));
+  uint8x16_t invalid = vdupq_n_u8(0);
+  for (int k = 0; k < 4; k++) {
+    // Out of range indices look up 0, so at most one table matches
+    uint8x16_t low = vqtbl4q_u8(low_table, in.val[k]);
+    uint8x16_t high =
+        vqtbl4q_u8(high_table, vsubq_u8(in.val[k], vdupq_n_u8(64)));
+    uint8x16_t entry = vorrq_u8(low, high);
+    invalid = vorrq_u8(invalid, vceqq_u8(entry, vdupq_n_u8(0)));
+    sextets.val[k] = vsubq_u8(entry, vdupq_n_u8(1));
+  }
+  return vmaxvq_u8(invalid) == 0;
+}
+
+size_t EncodeBulkNeon(const uint8_t *src, size_t len, char *dest) {
+  const uint8x16x4_t table =
+      LoadTable(reinterpret_cast<const uint8_t *>(encode_table));
+  const uint8x16_t mask = vdupq_n_u8(0x3f);
+  size_t i = 0;
+  for (; len - i >= 48; i += 48) {
+    uint8x16x3_t in = vld3q_u8(src + i);
+    uint8x16x4_t out;
+    out.val[0] = vshrq_n_u8(in.val[0], 2);
+    out.val[1] = vandq_u8(
+        vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask);
+    out.val[2] = vandq_u8(
+        vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask);
+    out.val[3] = vandq_u8(in.val[2], mask);
+    for (int k = 0; k < 4; k++) {
+      out.val[k] = vqtbl4q_u8(table, out.val[k]);
+    }
+    vst4q_u8(reinterpret_cast<uint8_t *>(dest), out);
+    dest += 64;
+  }
+  return i;
+}
+
+size_t DecodeBulkNeon(const char *src, size_t len, uint8_t *dest,
+                      bool &valid) {
+  size_t i = 0;
+  for (; len - i > 64; i += 64) {
+    uint8x16x4_t sextets;
+    if (unlikely(!DecodeSextetsNeon(src + i, sextets))) {
+      valid = false;
+      return i;
+    }
+    uint8x16x3_t out;
+    out.val[0] = vorrq_u8(vshlq_n_u8(sextets.val[0], 2),
+                          vshrq_n_u8(sextets.val[1], 4));
+    out.val[1] = vorrq_u8(vshlq_n_u8(sextets.val[1], 4),
+                          vshrq_n_u8(sextets.val[2], 2));
+    out.val[2] = vorrq_u8(vshlq_n_u8(sextets.val[2], 6), sextets.val[3]);
+    vst3q_u8(dest, out);
+    dest += 48;
+  }
+  return i;
+}
+
+size_t ValidateBulkNeon(const char *src, size_t len, bool &valid) {
+  size_t i = 0;
+  for (; len - i > 64; i += 64) {
+    uint8x16x4_t sextets;
+    if (unlikely(!DecodeSextetsNeon(src + i, sextets))) {
+      valid = false;
+      return i;
+    }
+  }
+  return i;
+}
+
+#pragma endregion NEON
+#endif // BASE64_NEON
+
+const Kernels &KernelsFor(Base64::Kernel kernel) {
+  static const Kernels scalar{EncodeBulkScalar, DecodeBulkScalar,
+                              ValidateBulkScalar};
+  if (!Base64::Supported(kernel)) {
+    return scalar;
+  }
+  switch (kernel) {
+#ifdef BASE64_X86
+  case Base64::Kernel::Sse41: {
+    static const Kernels sse41{EncodeBulkSse41, DecodeBulkSse41,
+                               ValidateBulkSse41};
+    return sse41;
+  }
+  case Base64::Kernel::Avx2: {
+    static const Kernels avx2{EncodeBulkAvx2, DecodeBulkAvx2,
+                              ValidateBulkAvx2};
+    return avx2;
+  }
+#endif
+#ifdef BASE64_NEON
+  case Base64::Kernel::Neon: {
+    static const Kernels neon{EncodeBulkNeon, DecodeBulkNeon,
+                              ValidateBulkNeon};
+    return neon;
+  }
+#endif
+  default:
+    return scalar;
+  }
+}
+
+Base64::Kernel DetectKernel() {
+#ifdef BASE64_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return Base64::Kernel::Avx2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return Base64::Kernel::Sse41;
+  }
+#endif
+#ifdef BASE64_NEON
+  return Base64::Kernel::Neon;
+#endif
+  return Base64::Kernel::Scalar;
+}
+
+} // namespace
+
+size_t Base64::DecodedLength(const char *src, size_t len) {
+  if (len < 4) {
+    return 0;
+  }
+  size_t padding = 0;
+  if (src[len - 1] == '=') {
+    padding = src[len - 2] == '=' ? 2 : 1;
+  }
+  return (len / 4) * 3 - padding;
+}
+
+Base64::Kernel Base64::ActiveKernel() {
+  static const Kernel kernel = DetectKernel();
+  return kernel;
+}
+
+const char *Base64::KernelName(Kernel kernel) {
+  switch (kernel) {
+  case Kernel::Sse41:
+    return "sse4.1";
+  case Kernel::Avx2:
+    return "avx2";
+  case Kernel::Neon:
+    return "neon";
+  default:
+    return "scalar";
+  }
+}
+
+bool Base64::Supported(Kernel kernel) {
+  switch (kernel) {
+  case Kernel::Scalar:
+    return true;
+#ifdef BASE64_X86
+  case Kernel::Sse41:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.1");
+  case Kernel::Avx2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+#ifdef BASE64_NEON
+  case Kernel::Neon:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+void Base64::Encode(const char *src, size_t len, char *dest) {
+  Encode(ActiveKernel(), src, len, dest);
+}
+
+bool Base64::Decode(const char *src, size_t len, char *dest) {
+  return Decode(ActiveKernel(), src, len, dest);
+}
+
+bool Base64::Validate(const char *src, size_t len) {
+  return Validate(ActiveKernel(), src, len);
+}
+
+void Base64::Encode(Kernel kernel, const char *src, size_t len, char *dest) {
+  auto bytes = reinterpret_cast<const uint8_t *>(src);
+  size_t consumed = KernelsFor(kernel).encode(bytes, len, dest);
+  EncodeScalar(bytes + consumed, len - consumed, dest + consumed / 3 * 4);
+}
+
+bool Base64::Decode(Kernel kernel, const char *src, size_t len, char *dest) {
+  if (unlikely(len % 4 != 0)) {
+    return false;
+  }
+  auto bytes = reinterpret_cast<uint8_t *>(dest);
+  bool valid = true;
+  size_t consumed = KernelsFor(kernel).decode(src, len, bytes, valid);
+  if (unlikely(!valid)) {
+    return false;
+  }
+  return DecodeScalar(src + consumed, len - consumed,
+                      bytes + consumed / 4 * 3);
+}
+
+bool Base64::Validate(Kernel kernel, const char *src, size_t len) {
+  if (unlikely(len % 4 != 0)) {
+    return false;
+  }
+  bool valid = true;
+  size_t consumed = KernelsFor(kernel).validate(src, len, valid);
+  return likely(valid) && ValidateScalar(src + consumed, len - consumed);
+}
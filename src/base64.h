@@ -0,0 +1,49 @@
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <cstddef> // for size_t
+
+/*
+  Standard (RFC 4648, padded) base64 for the native marshaling code, e.g.
+  the Key and Data fields of a JSON DataRowRecord.
+
+  The bulk of each call runs in a vector kernel picked once at startup from
+  the CPU's features (AVX2 or SSE4.1 on x86-64, NEON on arm64); the scalar
+  code handles the tail and any CPU without them.  Every kernel produces
+  byte-identical results to the scalar one.
+*/
+class Base64 {
+public:
+  enum class Kernel { Scalar, Sse41, Avx2, Neon };
+
+  static constexpr size_t EncodedLength(size_t len) {
+    return ((len + 2) / 3) * 4;
+  }
+
+  // Exact decoded length of well-formed input, from its length and padding
+  static size_t DecodedLength(const char *src, size_t len);
+
+  // Writes EncodedLength(len) bytes to dest
+  static void Encode(const char *src, size_t len, char *dest);
+
+  // Writes DecodedLength(src, len) bytes to dest.  Returns false, with dest
+  // partially written, unless src is well-formed padded base64.
+  static bool Decode(const char *src, size_t len, char *dest);
+
+  // Same check as Decode without writing anything
+  static bool Validate(const char *src, size_t len);
+
+  // The kernel used by the functions above
+  static Kernel ActiveKernel();
+
+  static const char *KernelName(Kernel kernel);
+
+  // Explicit kernel versions, for tests and benchmarks.  Kernels the CPU
+  // doesn't support fall back to Scalar.
+  static void Encode(Kernel kernel, const char *src, size_t len, char *dest);
+  static bool Decode(Kernel kernel, const char *src, size_t len, char *dest);
+  static bool Validate(Kernel kernel, const char *src, size_t len);
+  static bool Supported(Kernel kernel);
+};
+
+#endif // BASE64_H
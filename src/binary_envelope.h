@@ -0,0 +1,141 @@
+#ifndef BINARY_ENVELOPE_H
+#define BINARY_ENVELOPE_H
+
+#include <cstddef> // for size_t
+#include <cstdint> // for int64_t, uint64_t
+#include <cstring> // for std::memcmp, std::memcpy
+
+/*
+  Compact alternative to the JSON DataRowRecord, written by encrypt_binary
+  and recognised by every decrypt function:
+
+    envelope := magic created parent_key_created key_id encrypted_key data
+    magic    := 0x00 'A' 'E' 0x01 (format version)
+    created, parent_key_created := varint
+    key_id, encrypted_key, data := varint length, bytes
+
+  Varints are unsigned LEB128 of the int64 bit pattern.  Ciphertext and the
+  encrypted key are stored raw rather than base64 encoded.  A JSON document
+  can't start with a NUL byte, so the two formats can't be confused.
+*/
+class BinaryEnvelope {
+public:
+  static constexpr char magic[] = {'\0', 'A', 'E', '\x01'};
+  static constexpr size_t magic_size = sizeof(magic);
+  static constexpr size_t max_varint_size = 10;
+
+  struct Fields {
+    int64_t created = 0;
+    int64_t parent_key_created = 0;
+    const char *key_id = nullptr;
+    size_t key_id_len = 0;
+    const char *encrypted_key = nullptr;
+    size_t encrypted_key_len = 0;
+    const char *data = nullptr;
+    size_t data_len = 0;
+  };
+
+  static bool HasMagic(const char *envelope, size_t len) {
+    return len >= magic_size &&
+           std::memcmp(envelope, magic, magic_size) == 0;
+  }
+
+  static size_t EncodedSize(const Fields &fields) {
+    return magic_size + VarintSize(static_cast<uint64_t>(fields.created)) +
+           VarintSize(static_cast<uint64_t>(fields.parent_key_created)) +
+           VarintSize(fields.key_id_len) + fields.key_id_len +
+           VarintSize(fields.encrypted_key_len) + fields.encrypted_key_len +
+           VarintSize(fields.data_len) + fields.data_len;
+  }
+
+  // Writes EncodedSize(fields) bytes to dest
+  static void Write(char *dest, const Fields &fields) {
+    std::memcpy(dest, magic, magic_size);
+    dest += magic_size;
+    dest = WriteVarint(dest, static_cast<uint64_t>(fields.created));
+    dest = WriteVarint(dest, static_cast<uint64_t>(fields.parent_key_created));
+    dest = WriteBytes(dest, fields.key_id, fields.key_id_len);
+    dest = WriteBytes(dest, fields.encrypted_key, fields.encrypted_key_len);
+    WriteBytes(dest, fields.data, fields.data_len);
+  }
+
+  // Points fields into envelope.  Fails unless the whole envelope is
+  // exactly one well-formed record.
+  static bool Parse(const char *envelope, size_t len, Fields &fields) {
+    if (!HasMagic(envelope, len)) {
+      return false;
+    }
+    const char *pos = envelope + magic_size;
+    const char *end = envelope + len;
+    uint64_t created;
+    uint64_t parent_key_created;
+    if (!ReadVarint(pos, end, created) ||
+        !ReadVarint(pos, end, parent_key_created) ||
+        !ReadBytes(pos, end, fields.key_id, fields.key_id_len) ||
+        !ReadBytes(pos, end, fields.encrypted_key, fields.encrypted_key_len) ||
+        !ReadBytes(pos, end, fields.data, fields.data_len)) {
+      return false;
+    }
+    fields.created = static_cast<int64_t>(created);
+    fields.parent_key_created = static_cast<int64_t>(parent_key_created);
+    return pos == end;
+  }
+
+  static size_t VarintSize(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+      value >>= 7;
+      size++;
+    }
+    return size;
+  }
+
+private:
+  static char *WriteVarint(char *dest, uint64_t value) {
+    while (value >= 0x80) {
+      *dest++ = static_cast<char>((value & 0x7f) | 0x80);
+      value >>= 7;
+    }
+    *dest++ = static_cast<char>(value);
+    return dest;
+  }
+
+  static char *WriteBytes(char *dest, const char *bytes, size_t len) {
+    dest = WriteVarint(dest, len);
+    if (len > 0) {
+      std::memcpy(dest, bytes, len);
+    }
+    return dest + len;
+  }
+
+  static bool ReadVarint(const char *&pos, const char *end, uint64_t &value) {
+    value = 0;
+    for (size_t i = 0; i < max_varint_size && pos < end; i++) {
+      auto byte = static_cast<uint8_t>(*pos++);
+      // The tenth byte only has room for the top bit
+      if (i == max_varint_size - 1 && byte > 1) {
+        return false;
+      }
+      value |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static bool ReadBytes(const char *&pos, const char *end, const char *&bytes,
+                        size_t &len) {
+    uint64_t value;
+    if (!ReadVarint(pos, end, value) ||
+        value > static_cast<uint64_t>(end - pos)) {
+      return false;
+    }
+    bytes = pos;
+    len = static_cast<size_t>(value);
+    pos += len;
+    return true;
+  }
+};
+
+#endif // BINARY_ENVELOPE_H
@@ -1,6 +1,7 @@
 #ifndef COBHAN_BUFFER_H
 #define COBHAN_BUFFER_H
 
+#include <atomic>    // for std::atomic
 #include <cstdint>   // for int32_t
 #include <cstring>   // for std::memcpy
 #include <iostream>  // for std::terminate
@@ -8,25 +9,21 @@
 #include <sstream>   // for std::ostringstream
 #include <stdexcept> // for std::runtime_error, std::invalid_argument
 #include <string>    // for std::string
+#include "cobhan_buffer_pool.h" // for CobhanBufferPool, secure_wipe_memory
 #include "hints.h"   // for unlikely
-
-#ifdef _WIN32
-#include <windows.h> // for SecureZeroMemory
-#else
-#include <string.h>  // for explicit_bzero
-#endif
+#include "marshal_counters.h" // for MarshalCounters
 
 class CobhanBuffer {
 public:
-  // Used for requesting a new heap-based buffer allocation that can handle
-  // data_len_bytes of data
+  // Used for requesting a new pooled heap-based buffer allocation that can
+  // handle data_len_bytes of data
   explicit CobhanBuffer(size_t data_len_bytes) {
     if (data_len_bytes > max_int32_size) {
       throw std::invalid_argument(
           "CobhanBuffer(size_t): Requested data length exceeds maximum allowable size (2GB limit)");
     }
     allocation_size = DataSizeToAllocationSize(data_len_bytes);
-    cbuffer = new char[allocation_size];
+    cbuffer = CobhanBufferPool::Acquire(allocation_size, pool_capacity);
     ownership = true;
     initialize(data_len_bytes);
   }
@@ -34,7 +31,15 @@ public:
   // Used for passing a stack-based buffer allocation that hasn't been
   // initialized yet
   explicit CobhanBuffer(char *cbuffer, size_t allocation_size)
-      : cbuffer(cbuffer), allocation_size(allocation_size), ownership(false) {
+      : CobhanBuffer(cbuffer, allocation_size, false) {}
+
+  // Used for wrapping memory we don't own.  A borrowed buffer is guaranteed
+  // by the caller to outlive any object it is moved into (e.g. a pinned JS
+  // ArrayBuffer), so moves hand over the pointer instead of copying the
+  // contents to the heap.
+  explicit CobhanBuffer(char *cbuffer, size_t allocation_size, bool borrowed)
+      : cbuffer(cbuffer), allocation_size(allocation_size), ownership(false),
+        borrowed(borrowed) {
     if (allocation_size > max_int32_size) {
       throw std::invalid_argument(
           "CobhanBuffer(char*, size_t): Allocation size exceeds maximum allowable size (2GB limit)");
@@ -63,20 +68,11 @@ public:
 
   [[nodiscard]] size_t get_data_len_bytes() const { return *data_len_ptr; }
 
+  [[nodiscard]] size_t get_max_data_size() const { return max_data_size; }
+
   void secure_wipe_data() {
     if (data_ptr && get_data_len_bytes() > 0) {
-#ifdef _WIN32
-      // Windows secure zero
-      SecureZeroMemory(data_ptr, get_data_len_bytes());
-#elif defined(__linux__) && defined(__GLIBC__)
-      // Linux with glibc has explicit_bzero
-      explicit_bzero(data_ptr, get_data_len_bytes());
-#else
-      // Fallback - volatile to prevent optimization
-      volatile char *p = data_ptr;
-      size_t len = get_data_len_bytes();
-      while (len--) *p++ = 0;
-#endif
+      secure_wipe_memory(data_ptr, get_data_len_bytes());
     }
   }
 
@@ -107,6 +103,9 @@ public:
     return debug_output.str();
   }
 
+  // Offset of the data from the start of the allocation
+  static constexpr size_t HeaderSizeBytes() { return cobhan_header_size_bytes; }
+
   static size_t DataSizeToAllocationSize(size_t data_len_bytes) {
     size_t allocation =
         data_len_bytes + cobhan_header_size_bytes +
@@ -137,7 +136,7 @@ public:
 
 protected:
   void verify_canaries() const {
-    if (!canaries_enabled_) {
+    if (!canaries_enabled) {
       return;
     }
     if (*canary1_ptr != 0) {
@@ -164,9 +163,9 @@ protected:
 
   [[nodiscard]] bool is_valid() const { return cbuffer != nullptr; }
 
-  [[nodiscard]] size_t get_allocation_size() const { return allocation_size; }
+  [[nodiscard]] bool is_borrowed() const { return borrowed; }
 
-  [[nodiscard]] size_t get_max_data_size() const { return max_data_size; }
+  [[nodiscard]] size_t get_allocation_size() const { return allocation_size; }
 
   void set_data_len_bytes(size_t data_len_bytes) {
     if (data_len_bytes > max_int32_size) {
@@ -213,8 +212,10 @@ private:
     // Reserved for future use
     *reserved_ptr = 0;
 
-    // Write canary values
-    if (canaries_enabled_) {
+    // Write canary values.  The setting is captured per buffer, so buffers
+    // in flight keep their own whatever a later setup changes it to.
+    canaries_enabled = canaries_default.load(std::memory_order_relaxed);
+    if (canaries_enabled) {
       *canary1_ptr = 0;
       *canary2_ptr = canary_constant;
     }
@@ -223,23 +224,28 @@ private:
   void moveFrom(CobhanBuffer &&other) {
     other.verify_canaries();
 
-    if (other.ownership) {
-      // Transfer ownership of the existing buffer
+    if (other.ownership || other.borrowed) {
+      // Transfer ownership of the existing buffer (or the borrowed pointer)
       cbuffer = other.cbuffer;
       allocation_size = other.allocation_size;
+      pool_capacity = other.pool_capacity;
       max_data_size = other.max_data_size;
-      ownership = true;
+      ownership = other.ownership;
+      borrowed = other.borrowed;
       data_ptr = other.data_ptr;
       data_len_ptr = other.data_len_ptr;
       canary1_ptr = other.canary1_ptr;
       canary2_ptr = other.canary2_ptr;
+      canaries_enabled = other.canaries_enabled;
 
       // Reset the other object to prevent it from deallocating the buffer
       // or dereferencing pointers into memory we now own
       other.cbuffer = nullptr;
       other.allocation_size = 0;
+      other.pool_capacity = 0;
       other.max_data_size = 0;
       other.ownership = false;
+      other.borrowed = false;
       other.data_ptr = nullptr;
       other.data_len_ptr = nullptr;
       other.canary1_ptr = nullptr;
@@ -252,36 +258,46 @@ private:
             "CobhanBuffer::moveFrom: Allocation size exceeds maximum allowable size (2GB limit)");
       }
 
-      cbuffer = new char[allocation_size];
+      cbuffer = CobhanBufferPool::Acquire(allocation_size, pool_capacity);
       std::memcpy(cbuffer, other.cbuffer, allocation_size);
+      MarshalCounters::Add(MarshalCounters::Counter::CopyMove,
+                           *other.data_len_ptr);
       ownership = true;
+      borrowed = false;
       initialize(*other.data_len_ptr);
     }
   }
 
   void cleanup() {
     if (ownership) {
-      delete[] cbuffer;
+      CobhanBufferPool::Release(cbuffer, pool_capacity, allocation_size);
     }
     cbuffer = nullptr;
     allocation_size = 0;
+    pool_capacity = 0;
   }
 
   char *cbuffer = nullptr;
   size_t allocation_size = 0;
+  size_t pool_capacity = 0; // Size of the pooled block when ownership is true
   size_t max_data_size = 0;
   bool ownership = false;
+  bool borrowed = false;
   int32_t *data_len_ptr = nullptr;
   char *data_ptr = nullptr;
   int32_t *canary1_ptr = nullptr;
   int32_t *canary2_ptr = nullptr;
+  bool canaries_enabled = false;
 
-  static inline bool canaries_enabled_ = false;
+  // For buffers created from now on; setup may run on any worker_thread
+  static inline std::atomic<bool> canaries_default{false};
 
 public:
-  static void SetCanariesEnabled(bool enabled) { canaries_enabled_ = enabled; }
+  static void SetCanariesEnabled(bool enabled) {
+    canaries_default.store(enabled, std::memory_order_relaxed);
+  }
 
-private:
+protected:
   static constexpr int32_t canary_constant = static_cast<int32_t>(0xdeadbeef);
   static constexpr size_t cobhan_header_size_bytes =
       sizeof(int32_t) * 2; // 2x int32_t headers
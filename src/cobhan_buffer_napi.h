@@ -2,6 +2,7 @@
 #define COBHAN_BUFFER_NAPI_H
 
 #include "cobhan_buffer.h"
+#include "marshal_counters.h"
 #include "napi_utils.h"
 #include <napi.h>
 #include <stdexcept>
@@ -25,21 +26,15 @@ public:
                             const Napi::Buffer<unsigned char> &napiBuffer)
       : CobhanBuffer(napiBuffer.ByteLength()), env(env) {
     std::memcpy(get_data_ptr(), napiBuffer.Data(), napiBuffer.ByteLength());
+    MarshalCounters::Add(MarshalCounters::Counter::CopyInBuffer,
+                         napiBuffer.ByteLength());
   }
 
-  // Constructor from Napi::Value
+  // Constructor from Napi::Value.  Buffers returned by AllocateHeaderReserved
+  // are used in place rather than copied.
   explicit CobhanBufferNapi(const Napi::Env &env, const Napi::Value &napiValue)
-      : CobhanBuffer(ValueToDataSize(env, napiValue)), env(env) {
-    if (napiValue.IsString()) {
-      copy_from_string(napiValue.As<Napi::String>());
-    } else if (napiValue.IsBuffer()) {
-      auto napiBuffer = napiValue.As<Napi::Buffer<unsigned char>>();
-      std::memcpy(get_data_ptr(), napiBuffer.Data(), napiBuffer.Length());
-    } else {
-      NapiUtils::ThrowException(
-          env, "Expected a Napi::String or Napi::Buffer<unsigned "
-               "char> as the value.");
-    }
+      : CobhanBuffer(ValueToCobhanBuffer(env, napiValue)), env(env) {
+    copy_from_value(napiValue);
   }
 
   // Constructor from a Napi::String to an externally allocated buffer
@@ -48,6 +43,8 @@ public:
                    size_t allocation_size)
       : CobhanBuffer(cbuffer, allocation_size), env(env) {
     std::memcpy(get_data_ptr(), napiBuffer.Data(), napiBuffer.Length());
+    MarshalCounters::Add(MarshalCounters::Counter::CopyInBuffer,
+                         napiBuffer.Length());
   }
 
   // Constructor from a Napi::String to an externally allocated buffer
@@ -57,21 +54,13 @@ public:
     copy_from_string(napiString);
   }
 
-  // Constructor from a Napi::String to an externally allocated buffer
+  // Constructor from a Napi::Value to an externally allocated buffer.
+  // Buffers returned by AllocateHeaderReserved are used in place, in which
+  // case ValueToAllocationSize returned 0 and cbuffer is ignored.
   CobhanBufferNapi(const Napi::Env &env, const Napi::Value &napiValue,
                    char *cbuffer, size_t allocation_size)
-      : CobhanBuffer(cbuffer, allocation_size), env(env) {
-    if (napiValue.IsString()) {
-      copy_from_string(napiValue.As<Napi::String>());
-    } else if (napiValue.IsBuffer()) {
-      auto napiBuffer = napiValue.As<Napi::Buffer<unsigned char>>();
-      std::memcpy(get_data_ptr(), napiBuffer.Data(), napiBuffer.Length());
-    } else {
-      NapiUtils::ThrowException(
-          env, "Expected a Napi::String or Napi::Buffer<unsigned "
-               "char> as the value.");
-    }
-  }
+      : CobhanBufferNapi(env, napiValue,
+                         PlaceValue(napiValue, cbuffer, allocation_size)) {}
 
   // Constructor from size_t representing data length in bytes (not allocation
   // size)
@@ -84,18 +73,63 @@ public:
                             size_t allocation_size)
       : CobhanBuffer(cbuffer, allocation_size), env(env) {}
 
+  // Constructor from externally allocated memory that outlives this object
+  // (see CobhanBuffer's borrowed constructor)
+  explicit CobhanBufferNapi(const Napi::Env &env, char *cbuffer,
+                            size_t allocation_size, bool borrowed)
+      : CobhanBuffer(cbuffer, allocation_size, borrowed), env(env) {}
+
   // Move constructor
   CobhanBufferNapi(CobhanBufferNapi &&other) noexcept
-      : CobhanBuffer(std::move(other)), env(other.env) {}
+      : CobhanBuffer(std::move(other)), env(other.env),
+        pinned_value(std::move(other.pinned_value)) {}
 
   // Move assignment operator
   CobhanBufferNapi &operator=(CobhanBufferNapi &&other) noexcept {
     if (this != &other) {
       CobhanBuffer::operator=(std::move(other));
+      pinned_value = std::move(other.pinned_value);
     }
     return *this;
   }
 
+  // Allocates a Napi::Buffer of data_len_bytes whose backing ArrayBuffer
+  // already has room for the Cobhan header in front of the data and the
+  // canaries / safety padding behind it.  Such buffers are handed to
+  // libasherah in place instead of being copied into a new CobhanBuffer.
+  // Like Buffer.allocUnsafe(), the contents are not initialized.
+  static Napi::Buffer<unsigned char>
+  AllocateHeaderReserved(const Napi::Env &env, size_t data_len_bytes) {
+    size_t allocation_size = DataSizeToAllocationSize(data_len_bytes);
+    auto backing = Napi::Buffer<unsigned char>::New(env, allocation_size);
+    auto subarray = backing.Get("subarray").As<Napi::Function>();
+    auto view =
+        subarray
+            .Call(backing,
+                  {Napi::Number::New(env, cobhan_header_size_bytes),
+                   Napi::Number::New(env, static_cast<double>(
+                                              cobhan_header_size_bytes +
+                                              data_len_bytes))})
+            .As<Napi::Buffer<unsigned char>>();
+    if (unlikely(!view.TypeTag(&header_reserved_type_tag))) {
+      NapiUtils::ThrowException(
+          env, "CobhanBufferNapi::AllocateHeaderReserved: TypeTag failed");
+    }
+    return view;
+  }
+
+  // True for buffers returned by AllocateHeaderReserved (but not views or
+  // slices of them, which lose the reserved space)
+  static bool IsHeaderReserved(const Napi::Value &value) {
+    if (!value.IsBuffer()) {
+      return false;
+    }
+    auto napiBuffer = value.As<Napi::Buffer<unsigned char>>();
+    return napiBuffer.CheckTypeTag(&header_reserved_type_tag) &&
+           napiBuffer.Data() != nullptr &&
+           napiBuffer.ByteOffset() >= cobhan_header_size_bytes;
+  }
+
   // Returns a Napi::String from the buffer using napi_create_string_utf8
   [[nodiscard]] Napi::String ToString() const {
     napi_value napiStr;
@@ -106,6 +140,8 @@ public:
       NapiUtils::ThrowException(env,
           "CobhanBufferNapi::ToString: Failed to create Napi::String from CobhanBuffer");
     }
+    MarshalCounters::Add(MarshalCounters::Counter::CopyOutString,
+                         get_data_len_bytes());
 
     return {env, napiStr};
   }
@@ -115,6 +151,8 @@ public:
     auto buffer = Napi::Buffer<unsigned char>::Copy(
         env, reinterpret_cast<unsigned char *>(get_data_ptr()),
         get_data_len_bytes());
+    MarshalCounters::Add(MarshalCounters::Counter::CopyOutBuffer,
+                         get_data_len_bytes());
     return buffer;
   }
 
@@ -139,11 +177,14 @@ public:
   }
 
   // Public method to calculate the required allocation size for a Napi::Value
-  // (either Napi::String or Napi::Buffer<unsigned char>)
+  // (either Napi::String or Napi::Buffer<unsigned char>).  Returns 0 for
+  // header-reserved buffers, which need no allocation.
   static size_t ValueToAllocationSize(const Napi::Env &env,
                                       const Napi::Value &value) {
     if (value.IsString()) {
       return StringToAllocationSize(env, value.As<Napi::String>());
+    } else if (IsHeaderReserved(value)) {
+      return 0;
     } else if (value.IsBuffer()) {
       return BufferToAllocationSize(env,
                                     value.As<Napi::Buffer<unsigned char>>());
@@ -169,6 +210,77 @@ public:
 
 private:
   Napi::Env env;
+  // Keeps a header-reserved input Buffer alive while libasherah uses it
+  Napi::ObjectReference pinned_value;
+
+  static constexpr napi_type_tag header_reserved_type_tag = {
+      0x6173686572616821ULL, 0x636f6268616e4844ULL};
+
+  struct ValuePlacement {
+    char *cbuffer;
+    size_t allocation_size;
+    bool borrowed;
+  };
+
+  CobhanBufferNapi(const Napi::Env &env, const Napi::Value &napiValue,
+                   const ValuePlacement &placement)
+      : CobhanBuffer(placement.cbuffer, placement.allocation_size,
+                     placement.borrowed),
+        env(env) {
+    copy_from_value(napiValue);
+  }
+
+  static char *HeaderReservedBase(const Napi::Value &value) {
+    return reinterpret_cast<char *>(
+               value.As<Napi::Buffer<unsigned char>>().Data()) -
+           cobhan_header_size_bytes;
+  }
+
+  static size_t HeaderReservedAllocationSize(const Napi::Value &value) {
+    return DataSizeToAllocationSize(
+        value.As<Napi::Buffer<unsigned char>>().Length());
+  }
+
+  static ValuePlacement PlaceValue(const Napi::Value &value, char *cbuffer,
+                                   size_t allocation_size) {
+    if (IsHeaderReserved(value)) {
+      return {HeaderReservedBase(value), HeaderReservedAllocationSize(value),
+              true};
+    }
+    return {cbuffer, allocation_size, false};
+  }
+
+  static CobhanBuffer ValueToCobhanBuffer(const Napi::Env &env,
+                                          const Napi::Value &value) {
+    if (IsHeaderReserved(value)) {
+      return CobhanBuffer(HeaderReservedBase(value),
+                          HeaderReservedAllocationSize(value), true);
+    }
+    return CobhanBuffer(ValueToDataSize(env, value));
+  }
+
+  void copy_from_value(const Napi::Value &napiValue) {
+    if (napiValue.IsString()) {
+      copy_from_string(napiValue.As<Napi::String>());
+    } else if (napiValue.IsBuffer()) {
+      if (is_borrowed()) {
+        // The header and canaries were written around the caller's data by
+        // initialize(); just keep the Buffer alive
+        pinned_value = Napi::Persistent(napiValue.As<Napi::Object>());
+        MarshalCounters::Add(MarshalCounters::Counter::ZeroCopyIn,
+                             get_data_len_bytes());
+        return;
+      }
+      auto napiBuffer = napiValue.As<Napi::Buffer<unsigned char>>();
+      std::memcpy(get_data_ptr(), napiBuffer.Data(), napiBuffer.Length());
+      MarshalCounters::Add(MarshalCounters::Counter::CopyInBuffer,
+                           napiBuffer.Length());
+    } else {
+      NapiUtils::ThrowException(
+          env, "Expected a Napi::String or Napi::Buffer<unsigned "
+               "char> as the value.");
+    }
+  }
 
   void copy_from_string(const Napi::String &napiString) {
     // max_data_size is str_len + 1 (the +1 accounts for the NULL delimiter
@@ -190,6 +302,7 @@ private:
 
     // Update our data length to the actual string length
     set_data_len_bytes(str_len);
+    MarshalCounters::Add(MarshalCounters::Counter::CopyInString, str_len);
   }
 };
 
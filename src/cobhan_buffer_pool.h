@@ -0,0 +1,292 @@
+#ifndef COBHAN_BUFFER_POOL_H
+#define COBHAN_BUFFER_POOL_H
+
+#include "hints.h"           // for unlikely
+#include "marshal_counters.h" // for MarshalCounters
+#include <cstddef> // for size_t
+#include <cstdint> // for uint64_t
+#include <mutex>   // for std::mutex
+#include <vector>  // for std::vector
+
+#ifdef _WIN32
+#include <windows.h> // for SecureZeroMemory
+#else
+#include <string.h> // for explicit_bzero
+#endif
+
+__attribute__((always_inline)) inline void secure_wipe_memory(void *ptr,
+                                                              size_t len) {
+  if (ptr == nullptr || len == 0) {
+    return;
+  }
+#ifdef _WIN32
+  // Windows secure zero
+  SecureZeroMemory(ptr, len);
+#elif defined(__linux__) && defined(__GLIBC__)
+  // Linux with glibc has explicit_bzero
+  explicit_bzero(ptr, len);
+#else
+  // Fallback - volatile to prevent optimization
+  volatile char *p = static_cast<char *>(ptr);
+  while (len--)
+    *p++ = 0;
+#endif
+}
+
+/*
+  Size-class pool for CobhanBuffer allocations (header + data + canaries).
+
+  Blocks are grouped into power-of-two size classes from 256 bytes to 1MB.
+  Each thread keeps a small private cache per class so the common
+  acquire/release pair on the event loop thread never takes a lock; overflow
+  spills into a bounded shared cache guarded by a mutex so that buffers
+  acquired on one thread (e.g. async worker output) and released on another
+  are still recycled.  Anything larger than the biggest class goes straight to
+  new[] / delete[].
+
+  Every block is securely wiped before it is made available for reuse.
+*/
+class CobhanBufferPool {
+public:
+  // Returns a block of at least allocation_size bytes.  capacity receives the
+  // real size of the block, which must be passed back to Release().
+  static char *Acquire(size_t allocation_size, size_t &capacity) {
+    size_t size_class = SizeClassFor(allocation_size);
+    if (unlikely(size_class == num_size_classes)) {
+      capacity = allocation_size;
+      MarshalCounters::Add(MarshalCounters::Counter::HeapAllocation,
+                           allocation_size);
+      return new char[allocation_size];
+    }
+
+    capacity = ClassSize(size_class);
+
+    ThreadCache &local = GetThreadCache();
+    auto &local_blocks = local.blocks[size_class];
+    if (likely(!local_blocks.empty())) {
+      char *block = local_blocks.back();
+      local_blocks.pop_back();
+      MarshalCounters::Add(MarshalCounters::Counter::PooledAllocation,
+                           capacity);
+      return block;
+    }
+
+    SharedCache &shared = GetSharedCache();
+    {
+      std::lock_guard<std::mutex> lock(shared.mutex);
+      auto &shared_blocks = shared.blocks[size_class];
+      if (!shared_blocks.empty()) {
+        char *block = shared_blocks.back();
+        shared_blocks.pop_back();
+        MarshalCounters::Add(MarshalCounters::Counter::PooledAllocation,
+                             capacity);
+        return block;
+      }
+    }
+
+    MarshalCounters::Add(MarshalCounters::Counter::HeapAllocation, capacity);
+    return new char[capacity];
+  }
+
+  // Returns a block to the pool.  used_bytes is the prefix of the block that
+  // may contain data and must be wiped before reuse.
+  static void Release(char *block, size_t capacity, size_t used_bytes) {
+    if (block == nullptr) {
+      return;
+    }
+
+    size_t size_class = SizeClassFor(capacity);
+    if (unlikely(size_class == num_size_classes ||
+                 ClassSize(size_class) != capacity)) {
+      delete[] block;
+      return;
+    }
+
+    secure_wipe_memory(block, used_bytes < capacity ? used_bytes : capacity);
+
+    ThreadCache &local = GetThreadCache();
+    auto &local_blocks = local.blocks[size_class];
+    if (likely(local_blocks.size() < MaxThreadCachedBlocks(size_class))) {
+      local_blocks.push_back(block);
+      return;
+    }
+
+    SharedCache &shared = GetSharedCache();
+    {
+      std::lock_guard<std::mutex> lock(shared.mutex);
+      auto &shared_blocks = shared.blocks[size_class];
+      if (shared_blocks.size() < MaxSharedCachedBlocks(size_class)) {
+        shared_blocks.push_back(block);
+        return;
+      }
+    }
+
+    delete[] block;
+  }
+
+  static constexpr size_t ClassSize(size_t size_class) {
+    return min_class_size << size_class;
+  }
+
+  // Returns num_size_classes if the size is too large to be pooled
+  static size_t SizeClassFor(size_t allocation_size) {
+    if (allocation_size <= min_class_size) {
+      return 0;
+    }
+    if (unlikely(allocation_size > max_class_size)) {
+      return num_size_classes;
+    }
+    // ceil(log2(allocation_size)) - log2(min_class_size)
+    auto bits = static_cast<size_t>(
+        64 - __builtin_clzll(static_cast<uint64_t>(allocation_size - 1)));
+    return bits - min_class_shift;
+  }
+
+  static constexpr size_t min_class_shift = 8;
+  static constexpr size_t min_class_size = size_t(1) << min_class_shift;
+  static constexpr size_t num_size_classes = 13; // 256B .. 1MB
+  static constexpr size_t max_class_size =
+      min_class_size << (num_size_classes - 1);
+
+private:
+  static constexpr size_t thread_cache_bytes_per_class = 256 * 1024;
+  static constexpr size_t shared_cache_bytes_per_class = 2 * 1024 * 1024;
+
+  static constexpr size_t MaxThreadCachedBlocks(size_t size_class) {
+    return ClassSize(size_class) >= thread_cache_bytes_per_class
+               ? 1
+               : thread_cache_bytes_per_class / ClassSize(size_class);
+  }
+
+  static constexpr size_t MaxSharedCachedBlocks(size_t size_class) {
+    return ClassSize(size_class) >= shared_cache_bytes_per_class / 2
+               ? 2
+               : shared_cache_bytes_per_class / ClassSize(size_class);
+  }
+
+  struct SharedCache {
+    std::mutex mutex;
+    std::vector<char *> blocks[num_size_classes];
+  };
+
+  struct ThreadCache {
+    std::vector<char *> blocks[num_size_classes];
+
+    ~ThreadCache() {
+      // Hand cached blocks to the shared cache when a thread exits so that
+      // short-lived threads don't leak their private cache
+      SharedCache &shared = GetSharedCache();
+      std::lock_guard<std::mutex> lock(shared.mutex);
+      for (size_t size_class = 0; size_class < num_size_classes;
+           size_class++) {
+        for (char *block : blocks[size_class]) {
+          if (shared.blocks[size_class].size() <
+              MaxSharedCachedBlocks(size_class)) {
+            shared.blocks[size_class].push_back(block);
+          } else {
+            delete[] block;
+          }
+        }
+        blocks[size_class].clear();
+      }
+    }
+  };
+
+  static ThreadCache &GetThreadCache() {
+    thread_local ThreadCache cache;
+    return cache;
+  }
+
+  static SharedCache &GetSharedCache() {
+    // Intentionally leaked so thread exit during process teardown never
+    // touches a destroyed mutex
+    static auto *shared = new SharedCache();
+    return *shared;
+  }
+};
+
+/*
+  Tracks the distribution of payload allocation sizes seen on the sync paths
+  and derives the SCOPED_ALLOCATE_BUFFER stack cutoff from it, so callers no
+  longer need to tune set_max_stack_alloc_item_size by hand.
+
+  The cutoff is the smallest power-of-two bucket boundary that covers
+  target_coverage_percent of recent samples, clamped to [min_cutoff,
+  max_cutoff].  Counts are halved at every recalculation so the cutoff follows
+  shifts in the workload.  Only used from the event loop thread.
+*/
+class AdaptiveStackCutoff {
+public:
+  explicit AdaptiveStackCutoff(size_t initial_cutoff)
+      : cutoff(initial_cutoff) {}
+
+  // Returns true if the cutoff changed
+  bool Record(size_t allocation_size) {
+    size_t bucket = BucketFor(allocation_size);
+    bucket_counts[bucket]++;
+    if (likely(++samples_since_update < update_interval)) {
+      return false;
+    }
+    return Recalculate();
+  }
+
+  [[nodiscard]] size_t Cutoff() const { return cutoff; }
+
+  static constexpr size_t min_cutoff = 2048;
+  static constexpr size_t max_cutoff = 64 * 1024;
+
+private:
+  static constexpr size_t num_buckets = 32;
+  static constexpr uint64_t update_interval = 256;
+  static constexpr uint64_t target_coverage_percent = 90;
+
+  static size_t BucketFor(size_t allocation_size) {
+    if (allocation_size <= 1) {
+      return 0;
+    }
+    auto bits = static_cast<size_t>(
+        64 - __builtin_clzll(static_cast<uint64_t>(allocation_size - 1)));
+    return bits < num_buckets ? bits : num_buckets - 1;
+  }
+
+  bool Recalculate() {
+    uint64_t total = 0;
+    for (auto count : bucket_counts) {
+      total += count;
+    }
+
+    uint64_t target = (total * target_coverage_percent + 99) / 100;
+    uint64_t covered = 0;
+    size_t bucket = 0;
+    for (; bucket < num_buckets; bucket++) {
+      covered += bucket_counts[bucket];
+      if (covered >= target) {
+        break;
+      }
+    }
+
+    // SCOPED_ALLOCATE_BUFFER uses the stack when size < cutoff, so go one
+    // past the bucket's upper bound
+    size_t new_cutoff = (size_t(1) << bucket) + 1;
+    if (new_cutoff < min_cutoff) {
+      new_cutoff = min_cutoff;
+    } else if (new_cutoff > max_cutoff) {
+      new_cutoff = max_cutoff;
+    }
+
+    for (auto &count : bucket_counts) {
+      count /= 2;
+    }
+    samples_since_update = 0;
+
+    bool changed = new_cutoff != cutoff;
+    cutoff = new_cutoff;
+    return changed;
+  }
+
+  uint64_t bucket_counts[num_buckets] = {};
+  uint64_t samples_since_update = 0;
+  size_t cutoff;
+};
+
+#endif // COBHAN_BUFFER_POOL_H
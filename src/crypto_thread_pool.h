@@ -0,0 +1,222 @@
+#ifndef CRYPTO_THREAD_POOL_H
+#define CRYPTO_THREAD_POOL_H
+
+#include "phase_trace.h"
+#include "worker_freelist.h"
+#include <condition_variable> // for std::condition_variable
+#include <cstddef>            // for size_t
+#include <deque>              // for std::deque
+#include <memory>             // for std::shared_ptr
+#include <mutex>              // for std::mutex
+#include <napi.h>
+#include <system_error> // for std::system_error
+#include <thread>       // for std::thread
+#include <utility>      // for std::swap
+#include <vector>       // for std::vector
+
+/*
+  Long-lived native threads for crypto work, so *_async calls don't queue
+  behind fs, dns and zlib on libuv's (by default four) threads.  Reusing the
+  same threads also keeps the set of OS threads calling into Go stable.
+
+  Finished tasks go on a completion queue.  Only the push that finds the
+  queue empty wakes the JS thread (through a threadsafe function), and each
+  wakeup completes everything queued by then, so under load many Promises
+  are settled per trip through the event loop.  The threadsafe function
+  only holds the event loop open while tasks are in flight.
+
+  Without a pool, tasks run as ordinary libuv async work, one event loop
+  trip per task; only the allocations are recycled.
+*/
+class CryptoThreadPool {
+public:
+  class Task {
+  public:
+    virtual ~Task() = default;
+    // Called on a pool (or libuv) thread; must not throw
+    virtual void Run() = 0;
+    // Called on the JS thread after Run.  This is the last call made on the
+    // task, so it may delete itself.
+    virtual void Complete(Napi::Env env) = 0;
+
+    static void *operator new(size_t size) {
+      return WorkerFreelist::Allocate(size);
+    }
+    static void operator delete(void *ptr, size_t size) {
+      WorkerFreelist::Free(ptr, size);
+    }
+  };
+
+  static constexpr size_t max_threads = 256;
+
+  CryptoThreadPool(const Napi::Env &env, size_t thread_count)
+      : completion(std::make_shared<CompletionState>()) {
+    completion->tsfn = Napi::ThreadSafeFunction::New(
+        env, Napi::Function::New(env, [](const Napi::CallbackInfo &) {}),
+        "asherah-crypto-pool", 0, 1);
+    completion->tsfn.Unref(env);
+
+    threads.reserve(thread_count);
+    try {
+      for (size_t i = 0; i < thread_count; i++) {
+        threads.emplace_back(&CryptoThreadPool::WorkerLoop, this);
+      }
+    } catch (const std::system_error &) {
+      Stop();
+      throw;
+    }
+  }
+
+  CryptoThreadPool(const CryptoThreadPool &) = delete;
+  CryptoThreadPool &operator=(const CryptoThreadPool &) = delete;
+
+  ~CryptoThreadPool() { Stop(); }
+
+  // Runs task on pool if there is one and on libuv's pool otherwise.  Must
+  // be called on the JS thread.
+  static void Queue(CryptoThreadPool *pool, const Napi::Env &env,
+                    Task *task) {
+    if (pool != nullptr) {
+      pool->Submit(env, task);
+    } else {
+      (new LibuvTaskWork(env, task))->Queue();
+    }
+  }
+
+  // Runs task->Run() on a pool thread then task->Complete() on the JS
+  // thread.  Must be called on the JS thread.
+  void Submit(const Napi::Env &env, Task *task) {
+    if (completion->in_flight++ == 0) {
+      completion->tsfn.Ref(env);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(task);
+    }
+    cv.notify_one();
+  }
+
+  // Runs any queued tasks and joins the threads.  Completions already
+  // queued for the JS thread are still delivered after this returns.
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (stopping) {
+        return;
+      }
+      stopping = true;
+    }
+    cv.notify_all();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    threads.clear();
+    completion->tsfn.Release();
+  }
+
+  size_t size() const { return threads.size(); }
+
+private:
+  // Shared with the threadsafe function's callbacks, which can outlive the
+  // pool
+  struct CompletionState {
+    Napi::ThreadSafeFunction tsfn;
+    std::mutex mutex;
+    std::vector<Task *> completed;
+    // JS thread only
+    std::vector<Task *> draining;
+    size_t in_flight = 0;
+  };
+
+  // Completion path for tasks queued without a pool.  Created and deleted
+  // (by Napi::AsyncWorker itself) on the JS thread, like Task.
+  class LibuvTaskWork : public Napi::AsyncWorker {
+  public:
+    LibuvTaskWork(const Napi::Env &env, Task *task)
+        : Napi::AsyncWorker(env), task(task) {}
+
+    static void *operator new(size_t size) {
+      return WorkerFreelist::Allocate(size);
+    }
+    static void operator delete(void *ptr, size_t size) {
+      WorkerFreelist::Free(ptr, size);
+    }
+
+    void Execute() override { task->Run(); }
+
+    void OnOK() override { task->Complete(Env()); }
+
+  private:
+    Task *task;
+  };
+
+  void WorkerLoop() {
+    PhaseTrace::NameThread("asherah-crypto");
+    for (;;) {
+      Task *task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+          return;
+        }
+        task = queue.front();
+        queue.pop_front();
+      }
+
+      task->Run();
+
+      bool wake;
+      {
+        std::lock_guard<std::mutex> lock(completion->mutex);
+        wake = completion->completed.empty();
+        completion->completed.push_back(task);
+      }
+      if (wake) {
+        auto state = completion;
+        completion->tsfn.NonBlockingCall(
+            state.get(), [state](Napi::Env env, Napi::Function,
+                                 CompletionState *) { Drain(env, *state); });
+      }
+    }
+  }
+
+  static void Drain(Napi::Env env, CompletionState &state) {
+    auto &completed = state.draining;
+    {
+      std::lock_guard<std::mutex> lock(state.mutex);
+      std::swap(completed, state.completed);
+    }
+
+    // A JS exception from one completion mustn't strand the rest
+    Napi::Error first_error;
+    for (Task *task : completed) {
+      try {
+        task->Complete(env);
+      } catch (const Napi::Error &e) {
+        if (first_error.IsEmpty()) {
+          first_error = e;
+        }
+      }
+    }
+
+    state.in_flight -= completed.size();
+    if (state.in_flight == 0 && !completed.empty()) {
+      state.tsfn.Unref(env);
+    }
+    completed.clear();
+
+    if (!first_error.IsEmpty()) {
+      first_error.ThrowAsJavaScriptException();
+    }
+  }
+
+  std::shared_ptr<CompletionState> completion;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Task *> queue;
+  bool stopping = false;
+  std::vector<std::thread> threads;
+};
+
+#endif // CRYPTO_THREAD_POOL_H
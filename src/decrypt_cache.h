@@ -0,0 +1,184 @@
+#ifndef DECRYPT_CACHE_H
+#define DECRYPT_CACHE_H
+
+#include "cobhan_buffer_pool.h" // for secure_wipe_memory
+#include "hints.h"              // for likely, unlikely
+#include <chrono>               // for std::chrono::steady_clock
+#include <cstddef>              // for size_t
+#include <cstdint>              // for uint64_t
+#include <functional>           // for std::hash
+#include <iterator>             // for std::prev
+#include <list>                 // for std::list
+#include <string>               // for std::string
+#include <string_view>          // for std::string_view
+#include <unordered_map>        // for std::unordered_map
+
+/*
+  Optional LRU cache of decrypted plaintext, for services that decrypt the
+  same DRRs over and over.  Entries are keyed by a hash of the partition ID
+  and the DRR, confirmed by comparing the full key, and bounded by a byte
+  budget (keys, plaintext and bookkeeping) and a TTL.  Plaintext is wiped
+  when an entry is evicted, expires or the cache is cleared.
+
+  JS thread only: lookups happen before a call is marshaled to libasherah
+  and inserts when its result is handed back to JS.
+*/
+class DecryptCache {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t expirations;
+    size_t entries;
+    size_t bytes;
+  };
+
+  DecryptCache() = default;
+  DecryptCache(const DecryptCache &) = delete;
+  DecryptCache &operator=(const DecryptCache &) = delete;
+  ~DecryptCache() { Clear(); }
+
+  // Empties the cache and applies a new budget; max_bytes 0 turns it off
+  void Configure(size_t new_max_bytes, Clock::duration new_ttl) {
+    Clear();
+    max_bytes = new_max_bytes;
+    ttl = new_ttl;
+  }
+
+  bool enabled() const { return unlikely(max_bytes != 0); }
+
+  // Sets plaintext to the cached result for (partition_id, drr).  The view
+  // is valid until the next call on the cache.
+  bool Find(std::string_view partition_id, std::string_view drr,
+            std::string_view &plaintext) {
+    Clock::time_point now = Clock::now();
+    SweepExpired(now);
+    auto found = index.find(Hash(partition_id, drr));
+    if (found == index.end() || !found->second->Matches(partition_id, drr)) {
+      misses++;
+      return false;
+    }
+    auto entry = found->second;
+    if (unlikely(now >= entry->expires)) {
+      expirations++;
+      Evict(entry);
+      misses++;
+      return false;
+    }
+    entries.splice(entries.begin(), entries, entry);
+    hits++;
+    plaintext = entry->plaintext;
+    return true;
+  }
+
+  void Insert(std::string_view partition_id, std::string_view drr,
+              std::string_view plaintext) {
+    size_t cost = Cost(partition_id.size() + drr.size(), plaintext.size());
+    if (!enabled() || cost > max_bytes) {
+      return;
+    }
+    Clock::time_point now = Clock::now();
+    SweepExpired(now);
+    uint64_t hash = Hash(partition_id, drr);
+    auto found = index.find(hash);
+    if (found != index.end()) {
+      // Same key decrypted again while in flight, or a hash collision
+      Evict(found->second);
+    }
+
+    entries.emplace_front();
+    Entry &entry = entries.front();
+    entry.hash = hash;
+    entry.partition_id_length = partition_id.size();
+    entry.key.reserve(partition_id.size() + drr.size());
+    entry.key.append(partition_id).append(drr);
+    entry.plaintext.assign(plaintext);
+    entry.expires = now + ttl;
+    index[hash] = entries.begin();
+    bytes += cost;
+
+    while (bytes > max_bytes) {
+      evictions++;
+      Evict(std::prev(entries.end()));
+    }
+  }
+
+  void Clear() {
+    while (!entries.empty()) {
+      Evict(entries.begin());
+    }
+  }
+
+  Stats Read(bool reset) {
+    Stats stats{hits, misses, evictions, expirations, entries.size(), bytes};
+    if (reset) {
+      hits = misses = evictions = expirations = 0;
+    }
+    return stats;
+  }
+
+private:
+  // Rough per-entry cost of the list and index nodes and string headers
+  static constexpr size_t entry_overhead_bytes = 160;
+
+  struct Entry {
+    uint64_t hash;
+    size_t partition_id_length;
+    // Partition ID followed by the DRR
+    std::string key;
+    std::string plaintext;
+    Clock::time_point expires;
+
+    bool Matches(std::string_view partition_id, std::string_view drr) const {
+      return partition_id.size() == partition_id_length &&
+             std::string_view(key).substr(0, partition_id_length) ==
+                 partition_id &&
+             std::string_view(key).substr(partition_id_length) == drr;
+    }
+  };
+
+  using EntryList = std::list<Entry>;
+
+  static size_t Cost(size_t key_length, size_t plaintext_length) {
+    return key_length + plaintext_length + entry_overhead_bytes;
+  }
+
+  static uint64_t Hash(std::string_view partition_id, std::string_view drr) {
+    std::hash<std::string_view> hash;
+    return hash(drr) ^ (hash(partition_id) * 0x9e3779b97f4a7c15ULL);
+  }
+
+  // Drops expired entries from the least recently used end, so plaintext
+  // nobody asks for again doesn't sit in memory until it is pushed out
+  void SweepExpired(Clock::time_point now) {
+    while (!entries.empty() && now >= entries.back().expires) {
+      expirations++;
+      Evict(std::prev(entries.end()));
+    }
+  }
+
+  void Evict(EntryList::iterator entry) {
+    index.erase(entry->hash);
+    bytes -= Cost(entry->key.size(), entry->plaintext.size());
+    if (!entry->plaintext.empty()) {
+      secure_wipe_memory(&entry->plaintext[0], entry->plaintext.size());
+    }
+    entries.erase(entry);
+  }
+
+  size_t max_bytes = 0;
+  Clock::duration ttl{};
+  // Most recently used first
+  EntryList entries;
+  std::unordered_map<uint64_t, EntryList::iterator> index;
+  size_t bytes = 0;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  uint64_t expirations = 0;
+};
+
+#endif // DECRYPT_CACHE_H
@@ -0,0 +1,439 @@
+#ifndef DRR_SCANNER_H
+#define DRR_SCANNER_H
+
+#include "base64.h"
+#include "hints.h" // for likely, unlikely
+#include <cstddef> // for size_t
+#include <cstdint> // for int64_t, uint64_t
+#include <cstring> // for std::memchr, std::memcmp
+
+/*
+  Allocation-free scan of a JSON DataRowRecord ahead of DecryptFromJson:
+
+    {"Key":{"Created":N,"Key":"<b64>","ParentKeyMeta":
+      {"KeyId":"<id>","Created":N}},"Data":"<b64>"}
+
+  Follows what Go's encoding/json does with the document: it must be one
+  well-formed JSON value, field names match case-insensitively with the last
+  duplicate winning, unknown fields and nulls are ignored, and a known field
+  of the wrong type, a timestamp that isn't an int64 or a []byte field that
+  isn't padded base64 fails the whole unmarshal.
+
+  Invalid is only returned for input libasherah would fail to unmarshal.
+  What can't be judged exactly without reimplementing encoding/json, like
+  escaped or non-ASCII field names, escaped base64, []byte fields given as
+  arrays or very deep nesting, is Unknown and left to libasherah.
+*/
+class DrrScanner {
+public:
+  enum class Result { Valid, Invalid, Unknown };
+
+  // Raw bytes of a string value, between the quotes.  data is null if the
+  // field is absent.
+  struct Span {
+    const char *data = nullptr;
+    size_t len = 0;
+    bool escaped = false;
+  };
+
+  struct Fields {
+    Span data;
+    Span encrypted_key;
+    Span key_id;
+    int64_t created = 0;
+    int64_t parent_key_created = 0;
+  };
+
+  static constexpr size_t max_depth = 64;
+
+  // Fields are only meaningful if the result is Valid
+  static Result Scan(const char *drr, size_t len, Fields &fields) {
+    fields = Fields();
+    Cursor cursor{drr, drr + len};
+    cursor.SkipWhitespace();
+
+    bool ok;
+    if (cursor.Peek() == '{') {
+      ok = ScanObject(cursor, fields, Object::Record, 1);
+    } else if (cursor.Peek() == 'n') {
+      // Unmarshals to an empty record; libasherah reports what's missing
+      ok = cursor.ConsumeLiteral("null");
+      cursor.unknown = true;
+    } else {
+      // Any other value is a syntax or type error
+      ok = false;
+    }
+    if (unlikely(!ok)) {
+      return cursor.too_deep ? Result::Unknown : Result::Invalid;
+    }
+
+    cursor.SkipWhitespace();
+    if (unlikely(cursor.pos != cursor.end)) {
+      return Result::Invalid;
+    }
+    return cursor.unknown ? Result::Unknown : Result::Valid;
+  }
+
+private:
+  enum class Object { Record, Key, KeyMeta, Other };
+
+  struct Cursor {
+    const char *pos;
+    const char *end;
+    bool unknown = false;
+    bool too_deep = false;
+
+    char Peek() const { return pos < end ? *pos : '\0'; }
+
+    bool Consume(char c) {
+      if (pos < end && *pos == c) {
+        pos++;
+        return true;
+      }
+      return false;
+    }
+
+    bool ConsumeLiteral(const char *literal) {
+      size_t len = std::strlen(literal);
+      if (static_cast<size_t>(end - pos) < len ||
+          std::memcmp(pos, literal, len) != 0) {
+        return false;
+      }
+      pos += len;
+      return true;
+    }
+
+    void SkipWhitespace() {
+      while (pos < end &&
+             (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r')) {
+        pos++;
+      }
+    }
+  };
+
+  // At a '{'
+  static bool ScanObject(Cursor &cursor, Fields &fields, Object object,
+                         size_t depth) {
+    if (unlikely(depth > max_depth)) {
+      cursor.too_deep = true;
+      return false;
+    }
+    cursor.pos++;
+    cursor.SkipWhitespace();
+    if (cursor.Consume('}')) {
+      return true;
+    }
+    for (;;) {
+      Span name;
+      if (cursor.Peek() != '"' || !ScanString(cursor, name)) {
+        return false;
+      }
+      cursor.SkipWhitespace();
+      if (!cursor.Consume(':')) {
+        return false;
+      }
+      cursor.SkipWhitespace();
+      if (!ScanMember(cursor, fields, object, name, depth + 1)) {
+        return false;
+      }
+      cursor.SkipWhitespace();
+      if (!cursor.Consume(',')) {
+        return cursor.Consume('}');
+      }
+      cursor.SkipWhitespace();
+    }
+  }
+
+  static bool ScanMember(Cursor &cursor, Fields &fields, Object object,
+                         const Span &name, size_t depth) {
+    if (object == Object::Other) {
+      return SkipValue(cursor, depth);
+    }
+    if (unlikely(name.escaped || !IsAscii(name))) {
+      cursor.unknown = true;
+      return SkipValue(cursor, depth);
+    }
+
+    switch (object) {
+    case Object::Record:
+      if (NameIs(name, "Data")) {
+        return ScanBytes(cursor, fields.data, depth);
+      }
+      if (NameIs(name, "Key")) {
+        return ScanStruct(cursor, fields, Object::Key, depth);
+      }
+      break;
+    case Object::Key:
+      if (NameIs(name, "Created")) {
+        return ScanInt64(cursor, fields.created);
+      }
+      if (NameIs(name, "Key")) {
+        return ScanBytes(cursor, fields.encrypted_key, depth);
+      }
+      if (NameIs(name, "ParentKeyMeta")) {
+        return ScanStruct(cursor, fields, Object::KeyMeta, depth);
+      }
+      if (NameIs(name, "Revoked")) {
+        return cursor.ConsumeLiteral("true") ||
+               cursor.ConsumeLiteral("false") ||
+               cursor.ConsumeLiteral("null");
+      }
+      break;
+    case Object::KeyMeta:
+      if (NameIs(name, "Created")) {
+        return ScanInt64(cursor, fields.parent_key_created);
+      }
+      if (NameIs(name, "KeyId")) {
+        if (cursor.Peek() == '"') {
+          return ScanString(cursor, fields.key_id);
+        }
+        return cursor.ConsumeLiteral("null");
+      }
+      break;
+    default:
+      break;
+    }
+    return SkipValue(cursor, depth);
+  }
+
+  // A pointer to struct field: an object or null
+  static bool ScanStruct(Cursor &cursor, Fields &fields, Object object,
+                         size_t depth) {
+    if (cursor.Peek() == '{') {
+      return ScanObject(cursor, fields, object, depth);
+    }
+    return cursor.ConsumeLiteral("null");
+  }
+
+  // A []byte field: a base64 string, null, or an array of byte values
+  static bool ScanBytes(Cursor &cursor, Span &span, size_t depth) {
+    switch (cursor.Peek()) {
+    case '"':
+      break;
+    case '[':
+      cursor.unknown = true;
+      return SkipValue(cursor, depth);
+    default:
+      return cursor.ConsumeLiteral("null");
+    }
+
+    // The base64 alphabet has nothing JSON escapes, so the first quote ends
+    // the string if everything before it validates
+    const char *start = cursor.pos + 1;
+    auto quote = static_cast<const char *>(
+        std::memchr(start, '"', static_cast<size_t>(cursor.end - start)));
+    if (likely(quote != nullptr &&
+               Base64::Validate(start, static_cast<size_t>(quote - start)))) {
+      span = Span{start, static_cast<size_t>(quote - start), false};
+      cursor.pos = quote + 1;
+      return true;
+    }
+
+    if (!ScanString(cursor, span)) {
+      return false;
+    }
+    if (span.escaped) {
+      cursor.unknown = true;
+      return true;
+    }
+    return false;
+  }
+
+  // An int64 field: an integer in range, or null
+  static bool ScanInt64(Cursor &cursor, int64_t &value) {
+    if (cursor.Peek() == 'n') {
+      return cursor.ConsumeLiteral("null");
+    }
+    bool integer;
+    return ScanNumber(cursor, integer, value) && integer;
+  }
+
+  static bool SkipValue(Cursor &cursor, size_t depth) {
+    Fields ignored;
+    Span string;
+    switch (cursor.Peek()) {
+    case '{':
+      return ScanObject(cursor, ignored, Object::Other, depth);
+    case '[':
+      return SkipArray(cursor, depth);
+    case '"':
+      return ScanString(cursor, string);
+    case 't':
+      return cursor.ConsumeLiteral("true");
+    case 'f':
+      return cursor.ConsumeLiteral("false");
+    case 'n':
+      return cursor.ConsumeLiteral("null");
+    default:
+      bool integer;
+      int64_t number;
+      return ScanNumber(cursor, integer, number);
+    }
+  }
+
+  // At a '['
+  static bool SkipArray(Cursor &cursor, size_t depth) {
+    if (unlikely(depth > max_depth)) {
+      cursor.too_deep = true;
+      return false;
+    }
+    cursor.pos++;
+    cursor.SkipWhitespace();
+    if (cursor.Consume(']')) {
+      return true;
+    }
+    for (;;) {
+      if (!SkipValue(cursor, depth + 1)) {
+        return false;
+      }
+      cursor.SkipWhitespace();
+      if (!cursor.Consume(',')) {
+        return cursor.Consume(']');
+      }
+      cursor.SkipWhitespace();
+    }
+  }
+
+  // At a '"'.  Checks escapes and rejects raw control characters; other
+  // bytes, including invalid UTF-8, are accepted as Go does.
+  static bool ScanString(Cursor &cursor, Span &span) {
+    const char *p = cursor.pos + 1;
+    span = Span{p, 0, false};
+    while (p < cursor.end) {
+      auto c = static_cast<unsigned char>(*p);
+      if (c == '"') {
+        span.len = static_cast<size_t>(p - span.data);
+        cursor.pos = p + 1;
+        return true;
+      }
+      if (unlikely(c < 0x20)) {
+        return false;
+      }
+      if (c != '\\') {
+        p++;
+        continue;
+      }
+
+      span.escaped = true;
+      if (++p >= cursor.end) {
+        return false;
+      }
+      switch (*p) {
+      case '"':
+      case '\\':
+      case '/':
+      case 'b':
+      case 'f':
+      case 'n':
+      case 'r':
+      case 't':
+        p++;
+        break;
+      case 'u':
+        if (cursor.end - p < 5 || !IsHex(p[1]) || !IsHex(p[2]) ||
+            !IsHex(p[3]) || !IsHex(p[4])) {
+          return false;
+        }
+        p += 5;
+        break;
+      default:
+        return false;
+      }
+    }
+    return false;
+  }
+
+  // Checks JSON number syntax.  integer is set, with value, if the number
+  // is one strconv.ParseInt accepts as an int64.
+  static bool ScanNumber(Cursor &cursor, bool &integer, int64_t &value) {
+    const char *p = cursor.pos;
+    const char *end = cursor.end;
+    bool negative = p < end && *p == '-';
+    if (negative) {
+      p++;
+    }
+    if (p >= end || !IsDigit(*p)) {
+      return false;
+    }
+
+    uint64_t magnitude = 0;
+    bool overflow = false;
+    if (*p == '0') {
+      p++;
+    } else {
+      for (; p < end && IsDigit(*p); p++) {
+        auto digit = static_cast<uint64_t>(*p - '0');
+        if (magnitude > (UINT64_MAX - digit) / 10) {
+          overflow = true;
+        } else {
+          magnitude = magnitude * 10 + digit;
+        }
+      }
+    }
+
+    integer = true;
+    if (p < end && *p == '.') {
+      integer = false;
+      if (++p >= end || !IsDigit(*p)) {
+        return false;
+      }
+      while (p < end && IsDigit(*p)) {
+        p++;
+      }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+      integer = false;
+      if (++p < end && (*p == '+' || *p == '-')) {
+        p++;
+      }
+      if (p >= end || !IsDigit(*p)) {
+        return false;
+      }
+      while (p < end && IsDigit(*p)) {
+        p++;
+      }
+    }
+
+    constexpr uint64_t int64_limit = uint64_t{1} << 63;
+    if (overflow || magnitude > int64_limit - (negative ? 0 : 1)) {
+      integer = false;
+    }
+    if (integer) {
+      value = negative ? static_cast<int64_t>(0 - magnitude)
+                       : static_cast<int64_t>(magnitude);
+    }
+    cursor.pos = p;
+    return true;
+  }
+
+  // Go's fallback match for field names, restricted to ASCII
+  static bool NameIs(const Span &name, const char *field) {
+    size_t len = std::strlen(field);
+    if (name.len != len) {
+      return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+      if ((name.data[i] | 0x20) != (field[i] | 0x20)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static bool IsAscii(const Span &span) {
+    for (size_t i = 0; i < span.len; i++) {
+      if (static_cast<unsigned char>(span.data[i]) >= 0x80) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+  static bool IsHex(char c) {
+    return IsDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+  }
+};
+
+#endif // DRR_SCANNER_H
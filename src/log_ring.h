@@ -0,0 +1,122 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include "hints.h"     // for likely, unlikely
+#include <atomic>      // for std::atomic
+#include <cstddef>     // for size_t
+#include <cstdint>     // for uint32_t, uint64_t
+#include <cstring>     // for memcpy
+#include <memory>      // for std::unique_ptr
+#include <string_view> // for std::string_view
+
+/*
+  Bounded lock-free queue of log messages that any thread can write to and
+  one thread drains (Vyukov's bounded queue, single consumer).  Messages are
+  formatted straight into a fixed-size slot, so logging allocates nothing;
+  longer messages are truncated.  When the ring is full the message is
+  dropped and counted rather than blocking the caller.
+*/
+class LogRing {
+public:
+  static constexpr size_t max_message_length = 496;
+
+  struct Entry {
+    int level;
+    uint32_t length;
+    bool truncated;
+    char text[max_message_length];
+
+    void Append(std::string_view part) {
+      size_t available = max_message_length - length;
+      if (unlikely(part.size() > available)) {
+        truncated = true;
+        part = part.substr(0, available);
+      }
+      memcpy(text + length, part.data(), part.size());
+      length += static_cast<uint32_t>(part.size());
+    }
+
+    std::string_view Text() const { return {text, length}; }
+  };
+
+  // capacity is rounded up to a power of two
+  explicit LogRing(size_t capacity) {
+    size_t rounded = 1;
+    while (rounded < capacity) {
+      rounded <<= 1;
+    }
+    mask = rounded - 1;
+    cells.reset(new Cell[rounded]);
+    for (size_t i = 0; i < rounded; i++) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  LogRing(const LogRing &) = delete;
+  LogRing &operator=(const LogRing &) = delete;
+
+  // Claims a slot and calls format(Entry &) to fill it.  Safe from any
+  // thread; returns false if the ring was full.
+  template <typename Format> bool TryPush(int level, Format &&format) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;) {
+      cell = &cells[pos & mask];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      auto diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (likely(diff == 0)) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->entry.level = level;
+    cell->entry.length = 0;
+    cell->entry.truncated = false;
+    format(cell->entry);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Calls consume(const Entry &) for each published message, oldest first.
+  // Only one thread may drain a ring.
+  template <typename Consume> size_t Drain(Consume &&consume) {
+    size_t drained = 0;
+    for (;;) {
+      Cell &cell = cells[dequeue_pos & mask];
+      if (cell.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) {
+        return drained;
+      }
+      consume(static_cast<const Entry &>(cell.entry));
+      cell.sequence.store(dequeue_pos + mask + 1, std::memory_order_release);
+      dequeue_pos++;
+      drained++;
+    }
+  }
+
+  // Messages dropped because the ring was full since the last call
+  uint64_t TakeDropped() {
+    return dropped.exchange(0, std::memory_order_relaxed);
+  }
+
+private:
+  struct alignas(64) Cell {
+    std::atomic<size_t> sequence;
+    Entry entry;
+  };
+
+  std::unique_ptr<Cell[]> cells;
+  size_t mask = 0;
+  alignas(64) std::atomic<size_t> enqueue_pos{0};
+  alignas(64) size_t dequeue_pos = 0;
+  std::atomic<uint64_t> dropped{0};
+};
+
+#endif // LOG_RING_H
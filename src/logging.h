@@ -4,31 +4,63 @@
 #ifndef LOGGING_H
 #define LOGGING_H
 
-#include <cstddef> // size_t
-#include <cstdint> // int32_t
-#include <sstream> // std::ostringstream
-#include <string>  // std::string
+#include "hints.h"          // unlikely
+#include <atomic>           // std::atomic
+#include <charconv>         // std::to_chars
+#include <cstddef>          // size_t
+#include <cstdint>          // int32_t
+#include <initializer_list> // std::initializer_list
+#include <sstream>          // std::ostringstream
+#include <string>           // std::string
+#include <string_view>      // std::string_view
 
 class Logger {
 public:
-    [[maybe_unused]] void set_verbose_flag(int32_t verbose) { verbose_flag = verbose != 0; };
+  static constexpr int posix_log_level_error = 3;
+  static constexpr int posix_log_level_debug = 7;
 
-  virtual void debug_log(const char *function_name,
-                         const char *message) const = 0;
-  virtual void debug_log(const char *function_name,
-                         const std::string &message) const = 0;
-  virtual void debug_log_alloca(const char *function_name,
-                                const char *variable_name,
-                                size_t length) const = 0;
+  virtual ~Logger() = default;
 
-  virtual void debug_log_new(const char *function_name,
-                             const char *variable_name,
-                             size_t length) const = 0;
+  [[maybe_unused]] void set_verbose_flag(int32_t verbose) {
+    verbose_flag.store(verbose != 0, std::memory_order_relaxed);
+  }
+
+  // Check before building an expensive debug message
+  bool debug_enabled() const {
+    return unlikely(verbose_flag.load(std::memory_order_relaxed));
+  }
 
-  virtual void error_log(const char *function_name,
-                         const char *message) const = 0;
-  virtual void error_log(const char *function_name,
-                         const std::string &message) const = 0;
+  // Levels are filtered here, before anything is formatted.  Safe to call
+  // from any thread.
+  void debug_log(const char *function_name, std::string_view message) const {
+    if (debug_enabled()) {
+      log(posix_log_level_debug, function_name, {message});
+    }
+  }
+
+  void debug_log_alloca(const char *function_name, const char *variable_name,
+                        size_t length) const {
+    if (debug_enabled()) {
+      char digits[24];
+      log(posix_log_level_debug, function_name,
+          {"Calling alloca(", format_size(length, digits), ") (stack) for ",
+           variable_name});
+    }
+  }
+
+  void debug_log_new(const char *function_name, const char *variable_name,
+                     size_t length) const {
+    if (debug_enabled()) {
+      char digits[24];
+      log(posix_log_level_debug, function_name,
+          {"Calling new[", format_size(length, digits), "] (heap) for ",
+           variable_name});
+    }
+  }
+
+  void error_log(const char *function_name, std::string_view message) const {
+    log(posix_log_level_error, function_name, {message});
+  }
 
   __attribute__((always_inline)) inline static std::string
   format_ptr(const void *ptr) {
@@ -38,10 +70,20 @@ public:
   }
 
 protected:
-  bool verbose_flag = false;
+  std::atomic<bool> verbose_flag{false};
   std::string system_name;
 
   explicit Logger(std::string system_name) : system_name(std::move(system_name)) {}
+
+  // Writes function_name and the concatenated parts at level, which has
+  // already passed filtering
+  virtual void log(int level, const char *function_name,
+                   std::initializer_list<std::string_view> parts) const = 0;
+
+  static std::string_view format_size(size_t value, char (&digits)[24]) {
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    return {digits, static_cast<size_t>(result.ptr - digits)};
+  }
 };
 
 #endif // LOGGING_H
@@ -2,8 +2,7 @@
 #include "napi_utils.h"
 
 LoggerNapi::LoggerNapi(Napi::Env &env, const std::string &system_name)
-    : StdErrLogger(system_name), log_hook(Napi::FunctionReference()), env(env) {
-}
+    : StdErrLogger(system_name), env(env) {}
 
 [[maybe_unused]] LoggerNapi::LoggerNapi(Napi::Env &env,
                                         const std::string &system_name,
@@ -13,11 +12,28 @@ LoggerNapi::LoggerNapi(Napi::Env &env, const std::string &system_name)
     NapiUtils::ThrowException(env,
                               system_name + ": new_log_hook cannot be nullptr");
   }
-  log_hook = Napi::Persistent(new_log_hook);
+  set_log_hook(new_log_hook);
 }
 
 LoggerNapi::~LoggerNapi() {
-  auto old_log_hook = std::exchange(log_hook, Napi::FunctionReference());
+  if (hook_state == nullptr) {
+    return;
+  }
+  hooked.store(false, std::memory_order_release);
+  hook_state->tsfn.Release();
+  // The environment is going away, so nothing queued can reach JS now
+  hook_state->ring.Drain([this](const LogRing::Entry &entry) {
+    // Entries are "function_name: message"
+    std::string_view text = entry.Text();
+    size_t separator = text.find(": ");
+    std::string function_name(text.substr(0, separator));
+    text.remove_prefix(separator == std::string_view::npos ? text.size()
+                                                           : separator + 2);
+    StdErrLogger::log(entry.level, function_name.c_str(),
+                      {text, entry.truncated ? "..." : ""});
+  });
+  auto old_log_hook =
+      std::exchange(hook_state->log_hook, Napi::FunctionReference());
   if (!old_log_hook.IsEmpty()) {
     old_log_hook.Unref();
   }
@@ -28,92 +44,101 @@ void LoggerNapi::set_log_hook(Napi::Function new_log_hook) {
     NapiUtils::ThrowException(env,
                               system_name + ": new_log_hook cannot be empty");
   }
-  auto old_log_hook = std::exchange(log_hook, Napi::Persistent(new_log_hook));
+  if (hook_state == nullptr) {
+    auto state = std::make_shared<HookState>();
+    state->system_name = system_name;
+    state->tsfn = Napi::ThreadSafeFunction::New(
+        env, Napi::Function::New(env, [](const Napi::CallbackInfo &) {}),
+        "asherah-log", 0, 1);
+    // Pending log lines don't keep the process alive
+    state->tsfn.Unref(env);
+    hook_state = std::move(state);
+  }
+  auto old_log_hook =
+      std::exchange(hook_state->log_hook, Napi::Persistent(new_log_hook));
   if (!old_log_hook.IsEmpty()) {
     old_log_hook.Unref();
   }
+  hooked.store(true, std::memory_order_release);
 }
 
-void LoggerNapi::call_log_hook(int level, const std::string &message) const {
-  if (unlikely(log_hook.IsEmpty())) {
-    NapiUtils::ThrowException(env, system_name + ": log_hook cannot be empty");
+void LoggerNapi::log(int level, const char *function_name,
+                     std::initializer_list<std::string_view> parts) const {
+  if (likely(!hooked.load(std::memory_order_acquire))) {
+    StdErrLogger::log(level, function_name, parts);
+    return;
   }
-  Napi::HandleScope scope(env);
-  Napi::Function log_hook_function = log_hook.Value();
-  log_hook_function.Call(
-      {Napi::Number::New(env, level),
-       Napi::String::New(env, system_name + ": " + message)});
-}
 
-void LoggerNapi::debug_log(const char *function_name,
-                           const char *message) const {
-  if (unlikely(verbose_flag)) {
-    if (unlikely(log_hook.IsEmpty())) {
-      StdErrLogger::debug_log(function_name, message);
-    } else {
-      call_log_hook(posix_log_level_debug,
-                    std::string(function_name) + ": " + message);
+  HookState &state = *hook_state;
+  state.ring.TryPush(level, [&](LogRing::Entry &entry) {
+    entry.Append(function_name);
+    entry.Append(": ");
+    for (auto part : parts) {
+      entry.Append(part);
     }
+  });
+  // Pairs with the exchange in DeliverQueued: either that drain sees this
+  // message or this call schedules another drain
+  if (!state.drain_pending.exchange(true, std::memory_order_acq_rel)) {
+    auto shared_state = hook_state;
+    state.tsfn.NonBlockingCall(
+        shared_state.get(),
+        [shared_state](Napi::Env env, Napi::Function, HookState *) {
+          DeliverQueued(env, *shared_state);
+        });
   }
 }
 
-void LoggerNapi::debug_log(const char *function_name,
-                           const std::string &message) const {
-  if (unlikely(verbose_flag)) {
-    if (unlikely(log_hook.IsEmpty())) {
-      StdErrLogger::debug_log(function_name, message);
-    } else {
-      call_log_hook(posix_log_level_debug,
-                    std::string(function_name) + ": " + message);
-    }
-  }
-}
+void LoggerNapi::DeliverQueued(Napi::Env env, HookState &state) {
+  state.drain_pending.exchange(false, std::memory_order_acq_rel);
 
-void LoggerNapi::debug_log_alloca(const char *function_name,
-                                  const char *variable_name,
-                                  size_t length) const {
-  if (unlikely(verbose_flag)) {
-    if (unlikely(log_hook.IsEmpty())) {
-      StdErrLogger::debug_log_alloca(function_name, variable_name, length);
-    } else {
-      call_log_hook(posix_log_level_debug,
-                    std::string(function_name) + ": Calling alloca(" +
-                        std::to_string(length) + ") (stack) for " +
-                        variable_name);
+  // A JS exception from the hook mustn't strand the rest of the batch, and
+  // thrown from here it would be uncaught, so it is reported as a warning
+  auto deliver = [&](int level, std::string_view message, bool truncated) {
+    if (unlikely(state.log_hook.IsEmpty())) {
+      return;
     }
-  }
-}
-
-void LoggerNapi::debug_log_new(const char *function_name,
-                               const char *variable_name, size_t length) const {
-  if (unlikely(verbose_flag)) {
-    if (unlikely(log_hook.IsEmpty())) {
-      StdErrLogger::debug_log_new(function_name, variable_name, length);
-    } else {
-      call_log_hook(posix_log_level_debug,
-                    std::string(function_name) + ": Calling new[" +
-                        std::to_string(length) + "] (heap) for " +
-                        variable_name);
+    state.line.assign(state.system_name);
+    state.line += ": ";
+    state.line.append(message);
+    if (unlikely(truncated)) {
+      state.line += "...";
     }
-  }
-}
+    Napi::HandleScope scope(env);
+    try {
+      state.log_hook.Value().Call(
+          {Napi::Number::New(env, level),
+           Napi::String::New(env, state.line.data(), state.line.size())});
+    } catch (const Napi::Error &e) {
+      ReportHookError(env, state, e);
+    }
+  };
 
-void LoggerNapi::error_log(const char *function_name,
-                           const char *message) const {
-  if (likely(!log_hook.IsEmpty())) {
-    call_log_hook(posix_log_level_error,
-                  std::string(function_name) + ": " + message);
-  } else {
-    StdErrLogger::error_log(function_name, message);
+  state.ring.Drain([&](const LogRing::Entry &entry) {
+    deliver(entry.level, entry.Text(), entry.truncated);
+  });
+  uint64_t dropped = state.ring.TakeDropped();
+  if (unlikely(dropped != 0)) {
+    deliver(Logger::posix_log_level_error,
+            "log: " + std::to_string(dropped) +
+                " messages dropped (log hook queue full)",
+            false);
   }
 }
 
-void LoggerNapi::error_log(const char *function_name,
-                           const std::string &message) const {
-  if (likely(!log_hook.IsEmpty())) {
-    call_log_hook(posix_log_level_error,
-                  std::string(function_name) + ": " + message);
-  } else {
-    StdErrLogger::error_log(function_name, message);
+void LoggerNapi::ReportHookError(Napi::Env env, const HookState &state,
+                                 const Napi::Error &error) {
+  try {
+    Napi::Object process = env.Global().Get("process").As<Napi::Object>();
+    Napi::Value emit_warning = process.Get("emitWarning");
+    if (emit_warning.IsFunction()) {
+      emit_warning.As<Napi::Function>().Call(
+          process, {Napi::String::New(env, state.system_name +
+                                               ": log hook threw: " +
+                                               error.Message()),
+                    Napi::String::New(env, "AsherahLogHookWarning")});
+    }
+  } catch (const Napi::Error &) {
+    // Nowhere left to report it
   }
 }
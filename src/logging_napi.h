@@ -2,10 +2,19 @@
 #define LOGGING_NAPI_H
 
 #include "hints.h"
+#include "log_ring.h"
 #include "logging.h"
 #include "logging_stderr.h"
+#include <atomic>
+#include <memory>
 #include <napi.h>
 
+/*
+  Logs to the JS hook set with set_log_hook, or to stderr until there is
+  one.  Messages from any thread go into a LogRing and are delivered in
+  batches on the JS thread through one threadsafe function, so logging
+  never calls into JS synchronously and works from pool threads.
+*/
 class LoggerNapi : public StdErrLogger {
 public:
   LoggerNapi(Napi::Env &env, const std::string &system_name);
@@ -13,29 +22,36 @@ public:
   [[maybe_unused]] explicit LoggerNapi(Napi::Env &env,
                                        const std::string &system_name,
                                        Napi::Function new_log_hook);
-  ~LoggerNapi();
+  ~LoggerNapi() override;
 
   void set_log_hook(Napi::Function new_log_hook);
 
-  void debug_log(const char *function_name, const char *message) const override;
-  void debug_log(const char *function_name,
-                 const std::string &message) const override;
-  void debug_log_alloca(const char *function_name, const char *variable_name,
-                        size_t length) const override;
-
-  void debug_log_new(const char *function_name, const char *variable_name,
-                     size_t length) const override;
-
-  void error_log(const char *function_name, const char *message) const override;
-  void error_log(const char *function_name,
-                 const std::string &message) const override;
+protected:
+  void log(int level, const char *function_name,
+           std::initializer_list<std::string_view> parts) const override;
 
 private:
-  void call_log_hook(int level, const std::string &message) const;
-  Napi::FunctionReference log_hook;
+  static constexpr size_t hook_queue_capacity = 1024;
+
+  // Shared with the threadsafe function's callbacks, which can outlive the
+  // logger
+  struct HookState {
+    LogRing ring{hook_queue_capacity};
+    Napi::ThreadSafeFunction tsfn;
+    std::atomic<bool> drain_pending{false};
+    std::string system_name;
+    // JS thread only
+    Napi::FunctionReference log_hook;
+    std::string line;
+  };
+
+  static void DeliverQueued(Napi::Env env, HookState &state);
+  static void ReportHookError(Napi::Env env, const HookState &state,
+                              const Napi::Error &error);
+
   Napi::Env env;
-  const int posix_log_level_error = 3;
-  const int posix_log_level_debug = 7;
+  std::shared_ptr<HookState> hook_state;
+  std::atomic<bool> hooked{false};
 };
 
 #endif // LOGGING_NAPI_H
@@ -1,60 +1,145 @@
 #include "logging_stderr.h"
 #include "hints.h"
-#include <iostream>
+#include "log_ring.h"
+#include <cerrno>             // for errno, EINTR
+#include <condition_variable> // for std::condition_variable
+#include <cstdlib>            // for std::atexit
+#include <mutex>              // for std::mutex
+#include <string>             // for std::string
+#include <system_error>       // for std::system_error
+#include <thread>             // for std::thread
+#include <unistd.h>           // for write, STDERR_FILENO
 
-StdErrLogger::StdErrLogger(const std::string &system_name)
-    : Logger(system_name) {}
+namespace {
 
-void StdErrLogger::debug_log(const char *function_name,
-                             const char *message) const {
-  if (unlikely(verbose_flag)) {
-    std::cerr << system_name << ": [DEBUG] " << function_name << ": " << message
-              << std::endl
-              << std::flush;
+// The process-wide queue of stderr lines and the thread that writes them
+class StdErrSink {
+public:
+  static StdErrSink &Get() {
+    // Intentionally leaked: the writer thread may still be draining it while
+    // static destructors run
+    static auto *sink = new StdErrSink();
+    return *sink;
   }
-}
 
-void StdErrLogger::debug_log(const char *function_name,
-                             const std::string &message) const {
-  if (unlikely(verbose_flag)) {
-    std::cerr << system_name << ": [DEBUG] " << function_name << ": " << message
-              << std::endl
-              << std::flush;
+  template <typename Format> void Write(int level, Format &&format) {
+    if (unlikely(!threaded.load(std::memory_order_acquire))) {
+      // No writer thread: this caller is the consumer
+      std::lock_guard<std::mutex> lock(mutex);
+      ring.TryPush(level, format);
+      WriteQueued();
+      return;
+    }
+    ring.TryPush(level, format);
+    // Pairs with the exchange in WriterLoop: either the writer's drain sees
+    // this line or this call sees that the writer needs waking
+    if (!wake_pending.exchange(true, std::memory_order_acq_rel)) {
+      std::lock_guard<std::mutex> lock(mutex);
+      cv.notify_one();
+    }
   }
-}
 
-void StdErrLogger::debug_log_alloca(const char *function_name,
-                                    const char *variable_name,
-                                    size_t length) const {
-  if (unlikely(verbose_flag)) {
-    std::cerr << system_name << ": [DEBUG] " << function_name
-              << ": Calling alloca(" << length << ") (stack) for "
-              << variable_name << std::endl
-              << std::flush;
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!threaded.load(std::memory_order_relaxed)) {
+        return;
+      }
+      stopping = true;
+    }
+    cv.notify_one();
+    writer.join();
+    std::lock_guard<std::mutex> lock(mutex);
+    threaded.store(false, std::memory_order_release);
+    WriteQueued();
   }
-}
 
-void StdErrLogger::debug_log_new(const char *function_name,
-                                 const char *variable_name,
-                                 size_t length) const {
-  if (unlikely(verbose_flag)) {
-    std::cerr << system_name << ": [DEBUG] " << function_name
-              << ": Calling new[" << length << "] (heap) for " << variable_name
-              << std::endl
-              << std::flush;
+private:
+  static constexpr size_t ring_capacity = 2048;
+
+  StdErrSink() : ring(ring_capacity) {
+    try {
+      writer = std::thread(&StdErrSink::WriterLoop, this);
+      threaded.store(true, std::memory_order_release);
+      std::atexit([] { Get().Stop(); });
+    } catch (const std::system_error &) {
+      // Fall back to writing on the calling thread
+    }
   }
-}
 
-void StdErrLogger::error_log(const char *function_name,
-                             const char *message) const {
-  std::cerr << system_name << ": [ERROR] " << function_name << ": " << message
-            << std::endl
-            << std::flush;
-}
+  void WriterLoop() {
+    for (;;) {
+      bool stop;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] {
+          return stopping || wake_pending.load(std::memory_order_relaxed);
+        });
+        stop = stopping;
+      }
+      wake_pending.exchange(false, std::memory_order_acq_rel);
+      WriteQueued();
+      if (stop) {
+        return;
+      }
+    }
+  }
+
+  // Only the writer thread, or a caller holding mutex when there is none
+  void WriteQueued() {
+    ring.Drain([this](const LogRing::Entry &entry) {
+      batch.append(entry.Text());
+      if (unlikely(entry.truncated)) {
+        batch += "...";
+      }
+      batch += '\n';
+    });
+    uint64_t dropped = ring.TakeDropped();
+    if (unlikely(dropped != 0)) {
+      batch += "[ERROR] " + std::to_string(dropped) +
+               " log messages dropped (stderr log queue full)\n";
+    }
+
+    size_t written = 0;
+    while (written < batch.size()) {
+      ssize_t result = ::write(STDERR_FILENO, batch.data() + written,
+                               batch.size() - written);
+      if (result > 0) {
+        written += static_cast<size_t>(result);
+      } else if (result < 0 && errno == EINTR) {
+        continue;
+      } else {
+        break; // Nowhere to report a failing stderr
+      }
+    }
+    batch.clear();
+  }
+
+  LogRing ring;
+  std::string batch;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<bool> wake_pending{false};
+  std::atomic<bool> threaded{false};
+  bool stopping = false;
+  std::thread writer;
+};
+
+} // namespace
+
+StdErrLogger::StdErrLogger(const std::string &system_name)
+    : Logger(system_name) {}
 
-void StdErrLogger::error_log(const char *function_name,
-                             const std::string &message) const {
-  std::cerr << system_name << ": [ERROR] " << function_name << ": " << message
-            << std::endl
-            << std::flush;
+void StdErrLogger::log(int level, const char *function_name,
+                       std::initializer_list<std::string_view> parts) const {
+  StdErrSink::Get().Write(level, [&](LogRing::Entry &entry) {
+    entry.Append(system_name);
+    entry.Append(level <= posix_log_level_error ? ": [ERROR] "
+                                                : ": [DEBUG] ");
+    entry.Append(function_name);
+    entry.Append(": ");
+    for (auto part : parts) {
+      entry.Append(part);
+    }
+  });
 }
@@ -3,21 +3,19 @@
 
 #include "logging.h"
 
+/*
+  Logs to stderr without blocking the caller: lines go into a process-wide
+  LogRing and a background thread writes them out in batches, one write()
+  per batch.  Anything still queued is written at exit.
+*/
 class StdErrLogger : public Logger {
 public:
   StdErrLogger() = delete;
   explicit StdErrLogger(const std::string &system_name);
 
-  void debug_log(const char *function_name, const char *message) const override;
-  void debug_log(const char *function_name,
-                 const std::string &message) const override;
-  void debug_log_alloca(const char *function_name, const char *variable_name,
-                        size_t length) const override;
-  void debug_log_new(const char *function_name, const char *variable_name,
-                     size_t length) const override;
-  void error_log(const char *function_name, const char *message) const override;
-  void error_log(const char *function_name,
-                 const std::string &message) const override;
+protected:
+  void log(int level, const char *function_name,
+           std::initializer_list<std::string_view> parts) const override;
 };
 
 #endif // STDERR_LOGGER_H
@@ -0,0 +1,106 @@
+#ifndef MARSHAL_COUNTERS_H
+#define MARSHAL_COUNTERS_H
+
+#include <atomic>  // for std::atomic
+#include <cstddef> // for size_t
+#include <cstdint> // for uint64_t
+
+/*
+  Process-wide counters for the marshaling layer: where Cobhan buffers were
+  allocated, how many bytes were copied at each step between JS values and
+  libasherah, and how close the output size estimates came to the real
+  output.
+
+  Recording is a pair of relaxed atomic adds on a counter with its own cache
+  line, cheap enough to stay on in production.  Allocations and copies
+  happen on crypto pool threads as well as the JS thread, so the counters
+  are shared by every addon instance in the process.
+*/
+class MarshalCounters {
+public:
+  enum class Counter {
+    // Cobhan buffer allocations
+    StackAllocation,  // alloca() in SCOPED_ALLOCATE_BUFFER
+    HeapAllocation,   // new[], for scoped buffers and pool misses
+    PooledAllocation, // reused CobhanBufferPool block
+    // Input copies, JS value to Cobhan buffer
+    CopyInString,  // napi_get_value_string_utf8
+    CopyInBuffer,  // memcpy from a Buffer
+    ZeroCopyIn,    // header-reserved Buffer used in place
+    CopyMove,      // moving a stack buffer to the heap for an async worker
+    // Output copies, Cobhan buffer to JS value
+    CopyOutString, // napi_create_string_utf8
+    CopyOutBuffer, // Buffer::Copy
+    CopyOutInto,   // memcpy into a caller's Buffer (*_into)
+    ZeroCopyOut,   // slab subarray, no copy
+    Count
+  };
+
+  struct Totals {
+    uint64_t count;
+    uint64_t bytes;
+  };
+
+  struct EstimateTotals {
+    uint64_t count;
+    uint64_t estimated_bytes;
+    uint64_t actual_bytes;
+    uint64_t retries;
+  };
+
+  static void Add(Counter counter, size_t bytes) {
+    auto &slot = counters[static_cast<size_t>(counter)];
+    slot.count.fetch_add(1, std::memory_order_relaxed);
+    slot.bytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  // A libasherah call that succeeded into an output buffer sized at
+  // estimated bytes (the first attempt's size if it had to retry)
+  static void RecordEstimate(bool encrypt, size_t estimated, size_t actual,
+                             bool retried) {
+    auto &slot = estimates[encrypt ? 1 : 0];
+    slot.count.fetch_add(1, std::memory_order_relaxed);
+    slot.estimated_bytes.fetch_add(estimated, std::memory_order_relaxed);
+    slot.actual_bytes.fetch_add(actual, std::memory_order_relaxed);
+    if (retried) {
+      slot.retries.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Counters incremented concurrently with a reset land in one read or the
+  // next, never both
+  static Totals Read(Counter counter, bool reset) {
+    auto &slot = counters[static_cast<size_t>(counter)];
+    return {Load(slot.count, reset), Load(slot.bytes, reset)};
+  }
+
+  static EstimateTotals ReadEstimates(bool encrypt, bool reset) {
+    auto &slot = estimates[encrypt ? 1 : 0];
+    return {Load(slot.count, reset), Load(slot.estimated_bytes, reset),
+            Load(slot.actual_bytes, reset), Load(slot.retries, reset)};
+  }
+
+private:
+  // Static storage, so zero-initialized
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> bytes;
+  };
+
+  struct alignas(64) EstimateSlot {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> estimated_bytes;
+    std::atomic<uint64_t> actual_bytes;
+    std::atomic<uint64_t> retries;
+  };
+
+  static inline Slot counters[static_cast<size_t>(Counter::Count)];
+  static inline EstimateSlot estimates[2];
+
+  static uint64_t Load(std::atomic<uint64_t> &value, bool reset) {
+    return reset ? value.exchange(0, std::memory_order_relaxed)
+                 : value.load(std::memory_order_relaxed);
+  }
+};
+
+#endif // MARSHAL_COUNTERS_H
@@ -88,6 +88,29 @@ public:
     }
   }
 
+  // Optional non-negative integer property no greater than maxValue
+  static void GetSizeProperty(const Napi::Object &obj,
+                              const char *propertyName, size_t &result,
+                              size_t defaultValue, size_t maxValue) {
+    auto maybeValue = obj.Get(propertyName);
+
+    if (maybeValue.IsUndefined() || maybeValue.IsNull() ||
+        maybeValue.IsEmpty()) {
+      result = defaultValue;
+      return;
+    }
+    if (unlikely(!maybeValue.IsNumber())) {
+      ThrowException(obj.Env(), "Property '" + std::string(propertyName) +
+                                    "' is not a Number.");
+    }
+    int64_t value = maybeValue.As<Napi::Number>().Int64Value();
+    if (unlikely(value < 0 || static_cast<uint64_t>(value) > maxValue)) {
+      ThrowException(obj.Env(), "Property '" + std::string(propertyName) +
+                                    "' is out of range.");
+    }
+    result = static_cast<size_t>(value);
+  }
+
 #pragma endregion Object Properties
 
 #pragma region Parameter Support
@@ -102,6 +125,19 @@ public:
     }
   }
 
+  static void RequireParameterCountRange(const Napi::CallbackInfo &info,
+                                         size_t min_expected,
+                                         size_t max_expected) {
+    if (unlikely(info.Length() < min_expected ||
+                 info.Length() > max_expected)) {
+      std::string error_msg = "Expected " + std::to_string(min_expected) +
+                              " to " + std::to_string(max_expected) +
+                              " arguments, but got " +
+                              std::to_string(info.Length());
+      ThrowException(info.Env(), error_msg);
+    }
+  }
+
   static Napi::String RequireParameterString(const Napi::Env &env,
                                              const char *func_name,
                                              Napi::Value value) {
@@ -129,7 +165,7 @@ public:
     return str;
   }
 
-  __attribute__((unused)) static Napi::Buffer<unsigned char>
+  static Napi::Buffer<unsigned char>
   RequireParameterBuffer(const Napi::Env &env, const char *func_name,
                          Napi::Value value) {
     if (likely(value.IsBuffer())) {
@@ -165,6 +201,36 @@ public:
     }
   }
 
+  static Napi::Array RequireParameterArray(const Napi::Env &env,
+                                           const char *func_name,
+                                           Napi::Value value) {
+    if (unlikely(!value.IsArray())) {
+      ThrowException(env, std::string(func_name) + ": Expected an Array");
+    }
+    return value.As<Napi::Array>();
+  }
+
+  // Optional non-negative integer parameter no greater than max_value
+  static size_t OptionalParameterSize(const Napi::Env &env,
+                                      const char *func_name,
+                                      const Napi::CallbackInfo &info,
+                                      size_t index, size_t default_value,
+                                      size_t max_value) {
+    if (info.Length() <= index || info[index].IsUndefined()) {
+      return default_value;
+    }
+    if (unlikely(!info[index].IsNumber())) {
+      ThrowException(env, std::string(func_name) +
+                              ": Expected Number but received unknown type");
+    }
+    int64_t value = info[index].As<Napi::Number>().Int64Value();
+    if (unlikely(value < 0 || static_cast<uint64_t>(value) > max_value)) {
+      ThrowException(env, std::string(func_name) + ": Value " +
+                              std::to_string(value) + " is out of range");
+    }
+    return static_cast<size_t>(value);
+  }
+
 #pragma endregion Parameter Support
 };
 
@@ -0,0 +1,309 @@
+#ifndef OPERATION_METRICS_H
+#define OPERATION_METRICS_H
+
+#include "hints.h" // for unlikely
+#include <array>   // for std::array
+#include <chrono>  // for std::chrono::steady_clock
+#include <cmath>   // for std::ceil
+#include <cstddef> // for size_t
+#include <cstdint> // for int32_t, uint64_t, uintptr_t
+#include <memory>  // for std::unique_ptr
+#include <napi.h>
+#include <utility> // for std::pair
+#include <vector>  // for std::vector
+
+/*
+  HDR-style latency histogram: 16 linear sub-buckets per power of two, so a
+  value is reported to within 1/16 (6.25%) from 1ns up to 2^40ns (about 18
+  minutes).  Recording is an index computation and an increment.
+*/
+class LatencyHistogram {
+public:
+  void Record(uint64_t ns) {
+    if (ns > max_value) {
+      ns = max_value;
+    }
+    buckets[BucketIndex(ns)]++;
+    if (count == 0 || ns < min) {
+      min = ns;
+    }
+    if (ns > max) {
+      max = ns;
+    }
+    sum += ns;
+    count++;
+  }
+
+  // Highest value in the bucket holding the q quantile, capped at max
+  uint64_t ValueAtQuantile(double q) const {
+    auto rank =
+        static_cast<uint64_t>(std::ceil(q * static_cast<double>(count)));
+    if (rank == 0) {
+      rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+      seen += buckets[i];
+      if (seen >= rank) {
+        uint64_t value = BucketLowerBound(i + 1) - 1;
+        return value < max ? value : max;
+      }
+    }
+    return max;
+  }
+
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t min = 0;
+  uint64_t max = 0;
+
+private:
+  static constexpr unsigned sub_bucket_bits = 4;
+  static constexpr size_t sub_buckets = size_t{1} << sub_bucket_bits;
+  static constexpr unsigned max_value_bits = 40;
+  static constexpr uint64_t max_value = (uint64_t{1} << max_value_bits) - 1;
+  // Values below 2 * sub_buckets get a bucket each
+  static constexpr size_t bucket_count =
+      (max_value_bits - sub_bucket_bits + 1) * sub_buckets;
+
+  static size_t BucketIndex(uint64_t value) {
+    if (value < 2 * sub_buckets) {
+      return static_cast<size_t>(value);
+    }
+    unsigned shift = (63 - __builtin_clzll(value)) - sub_bucket_bits;
+    return shift * sub_buckets + static_cast<size_t>(value >> shift);
+  }
+
+  static uint64_t BucketLowerBound(size_t index) {
+    if (index < 2 * sub_buckets) {
+      return index;
+    }
+    size_t shift = index / sub_buckets - 1;
+    return static_cast<uint64_t>(index % sub_buckets + sub_buckets) << shift;
+  }
+
+  std::array<uint64_t, bucket_count> buckets{};
+};
+
+/*
+  Wall time of every call into the addon, from entry until it returns or,
+  for *_async calls, until the Promise settles.  Each operation is split by
+  payload size and counts the libasherah error codes it failed with.
+
+  An instance belongs to one addon instance and so to one JS thread, which
+  is the only thread that records (sync calls and async completions both
+  run there) or reads.  That keeps recording lock- and atomic-free without
+  any per-thread merging.
+*/
+class OperationMetrics {
+public:
+  static constexpr size_t size_class_count = 6;
+
+  // An operation in progress.  Scope makes it the current one, so errors
+  // raised while it runs are recorded against it.
+  class Operation {
+  public:
+    Operation() = default;
+    Operation(OperationMetrics *metrics, size_t id, size_t size_class)
+        : metrics(metrics), id(id), size_class(size_class),
+          start(std::chrono::steady_clock::now()) {}
+
+    Operation(Operation &&other) noexcept { *this = std::move(other); }
+
+    Operation &operator=(Operation &&other) noexcept {
+      Finish();
+      metrics = other.metrics;
+      id = other.id;
+      size_class = other.size_class;
+      start = other.start;
+      error = other.error;
+      other.metrics = nullptr;
+      return *this;
+    }
+
+    Operation(const Operation &) = delete;
+    Operation &operator=(const Operation &) = delete;
+
+    ~Operation() { Finish(); }
+
+    void Finish() {
+      if (metrics != nullptr) {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        metrics->Record(
+            id, size_class,
+            static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                    .count()),
+            error);
+        metrics = nullptr;
+      }
+    }
+
+  private:
+    friend class OperationMetrics;
+
+    OperationMetrics *metrics = nullptr;
+    size_t id = 0;
+    size_t size_class = 0;
+    std::chrono::steady_clock::time_point start;
+    int32_t error = 0;
+  };
+
+  class Scope {
+  public:
+    explicit Scope(Operation &&operation)
+        : operation(std::move(operation)), previous(current) {
+      current = &this->operation;
+    }
+
+    Scope(OperationMetrics &metrics, void *id, size_t size_class)
+        : Scope(Operation(&metrics, reinterpret_cast<uintptr_t>(id),
+                          size_class)) {}
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    ~Scope() { current = previous; }
+
+  private:
+    Operation operation;
+    Operation *previous;
+  };
+
+  // Registers an operation; the result is its ID, as InstanceMethod data
+  void *Add(const char *name) {
+    operations.emplace_back();
+    operations.back().name = name;
+    return reinterpret_cast<void *>(
+        static_cast<uintptr_t>(operations.size() - 1));
+  }
+
+  const char *Name(void *id) const {
+    return operations[reinterpret_cast<uintptr_t>(id)].name;
+  }
+
+  // Hands the current operation to an async worker, which finishes it when
+  // the Promise settles
+  static Operation TakeCurrent() {
+    return current != nullptr ? std::move(*current) : Operation();
+  }
+
+  static void RecordError(int32_t code) {
+    if (current != nullptr) {
+      current->error = code;
+    }
+  }
+
+  // 0 for calls without a string or Buffer payload, then up to 256B, 4KB,
+  // 64KB, 1MB and larger
+  static size_t SizeClass(const Napi::Value &payload) {
+    size_t size;
+    if (payload.IsString()) {
+      // UTF-16 length is O(1) in V8; UTF-8 would need a scan
+      napi_get_value_string_utf16(payload.Env(), payload, nullptr, 0, &size);
+    } else if (payload.IsBuffer()) {
+      size = payload.As<Napi::Buffer<unsigned char>>().Length();
+    } else {
+      return 0;
+    }
+    size_t size_class = 1;
+    for (size_t limit = 256; size > limit && size_class < size_class_count - 1;
+         limit *= 16) {
+      size_class++;
+    }
+    return size_class;
+  }
+
+  // { name: { errors: { message: count }, sizes: { class: stats } } } for
+  // each operation called at least once.  Times are in nanoseconds.
+  Napi::Object ToObject(const Napi::Env &env,
+                        const char *(*error_name)(int32_t),
+                        bool reset) {
+    static constexpr const char *size_names[size_class_count] = {
+        "none", "256B", "4KB", "64KB", "1MB", "large"};
+    auto result = Napi::Object::New(env);
+    for (auto &operation : operations) {
+      if (operation.calls == 0) {
+        continue;
+      }
+      auto sizes = Napi::Object::New(env);
+      for (size_t i = 0; i < size_class_count; i++) {
+        auto &histogram = operation.histograms[i];
+        if (histogram != nullptr && histogram->count > 0) {
+          sizes.Set(size_names[i], HistogramToObject(env, *histogram));
+        }
+      }
+      auto errors = Napi::Object::New(env);
+      for (auto &error : operation.errors) {
+        errors.Set(error_name(error.first),
+                   Napi::Number::New(env, static_cast<double>(error.second)));
+      }
+
+      auto entry = Napi::Object::New(env);
+      entry.Set("calls",
+                Napi::Number::New(env, static_cast<double>(operation.calls)));
+      entry.Set("errors", errors);
+      entry.Set("sizes", sizes);
+      result.Set(operation.name, entry);
+
+      if (reset) {
+        const char *name = operation.name;
+        operation = OperationStats();
+        operation.name = name;
+      }
+    }
+    return result;
+  }
+
+private:
+  struct OperationStats {
+    const char *name = nullptr;
+    uint64_t calls = 0;
+    // Allocated on first use; most operations see one or two size classes
+    std::array<std::unique_ptr<LatencyHistogram>, size_class_count>
+        histograms;
+    std::vector<std::pair<int32_t, uint64_t>> errors;
+  };
+
+  static inline thread_local Operation *current = nullptr;
+
+  std::vector<OperationStats> operations;
+
+  void Record(size_t id, size_t size_class, uint64_t ns, int32_t error) {
+    auto &operation = operations[id];
+    operation.calls++;
+    auto &histogram = operation.histograms[size_class];
+    if (unlikely(histogram == nullptr)) {
+      histogram.reset(new LatencyHistogram());
+    }
+    histogram->Record(ns);
+    if (error < 0) {
+      for (auto &entry : operation.errors) {
+        if (entry.first == error) {
+          entry.second++;
+          return;
+        }
+      }
+      operation.errors.emplace_back(error, 1);
+    }
+  }
+
+  static Napi::Object HistogramToObject(const Napi::Env &env,
+                                        const LatencyHistogram &histogram) {
+    auto stats = Napi::Object::New(env);
+    auto set = [&](const char *name, uint64_t value) {
+      stats.Set(name, Napi::Number::New(env, static_cast<double>(value)));
+    };
+    set("count", histogram.count);
+    set("min", histogram.min);
+    set("mean", histogram.sum / histogram.count);
+    set("p50", histogram.ValueAtQuantile(0.5));
+    set("p90", histogram.ValueAtQuantile(0.9));
+    set("p99", histogram.ValueAtQuantile(0.99));
+    set("p999", histogram.ValueAtQuantile(0.999));
+    set("max", histogram.max);
+    return stats;
+  }
+};
+
+#endif // OPERATION_METRICS_H
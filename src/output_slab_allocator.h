@@ -0,0 +1,133 @@
+#ifndef OUTPUT_SLAB_ALLOCATOR_H
+#define OUTPUT_SLAB_ALLOCATOR_H
+
+#include "cobhan_buffer.h"
+#include "cobhan_buffer_pool.h" // for secure_wipe_memory
+#include "hints.h"
+#include "marshal_counters.h"
+#include "napi_utils.h"
+#include <cstring>
+#include <napi.h>
+
+/*
+  Hands out Cobhan output buffers that live inside V8 ArrayBuffers so that
+  libasherah writes its result straight into memory the caller will receive.
+  The Cobhan header sits just before the data region and the result is
+  returned as a subarray() view, with no copy and no native allocation.
+
+  Small outputs are carved from shared slabs (much like Node's own Buffer
+  pool), large ones get a dedicated ArrayBuffer.  Nothing past a result is
+  left uninitialized, since .buffer exposes it.  As with
+  Buffer.allocUnsafe(), views of one slab share its ArrayBuffer, so the
+  .buffer property of a result can reach other results from the same slab.
+
+  Only used from the event loop thread.
+*/
+class OutputSlabAllocator {
+public:
+  struct Reservation {
+    Napi::Buffer<unsigned char> backing; // Slab or dedicated Buffer
+    char *cbuffer = nullptr;             // Start of the Cobhan header
+    size_t offset = 0;                   // Offset of cbuffer in backing
+    size_t allocation_size = 0;
+  };
+
+  Reservation Reserve(const Napi::Env &env, size_t allocation_size) {
+    if (allocation_size > dedicated_threshold) {
+      auto backing = Napi::Buffer<unsigned char>::New(env, allocation_size);
+      return {backing, reinterpret_cast<char *>(backing.Data()), 0,
+              allocation_size};
+    }
+
+    if (current_slab.IsEmpty() ||
+        slab_used + allocation_size > slab_size) {
+      auto slab = Napi::Buffer<unsigned char>::New(env, slab_size);
+      // Slab views expose the whole ArrayBuffer, so don't hand out
+      // uninitialized heap memory
+      std::memset(slab.Data(), 0, slab_size);
+      current_slab = Napi::Persistent(slab.As<Napi::Object>());
+      slab_data = reinterpret_cast<char *>(slab.Data());
+      slab_used = 0;
+    }
+
+    Reservation reservation{
+        current_slab.Value().As<Napi::Buffer<unsigned char>>(),
+        slab_data + slab_used, slab_used, allocation_size};
+    slab_used += AlignUp(allocation_size);
+    return reservation;
+  }
+
+  // Returns a view of the data_len_bytes written after the Cobhan header and
+  // gives back the unused tail if this was the most recent reservation.
+  // The tail is zeroed first: the view's .buffer reaches it, and dedicated
+  // Buffers start out as uninitialized heap memory.
+  Napi::Buffer<unsigned char> Commit(const Napi::Env &env,
+                                     const Reservation &reservation,
+                                     size_t data_len_bytes) {
+    size_t data_offset = reservation.offset + CobhanBuffer::HeaderSizeBytes();
+    size_t data_end = data_offset + data_len_bytes;
+    size_t reservation_end = reservation.offset + reservation.allocation_size;
+    if (likely(data_end < reservation_end)) {
+      std::memset(reinterpret_cast<char *>(reservation.backing.Data()) +
+                      data_end,
+                  0, reservation_end - data_end);
+    }
+    MarshalCounters::Add(MarshalCounters::Counter::ZeroCopyOut, data_len_bytes);
+    if (IsMostRecent(reservation)) {
+      slab_used = AlignUp(data_end);
+    }
+
+    auto subarray = reservation.backing.Get("subarray").As<Napi::Function>();
+    return subarray
+        .Call(reservation.backing,
+              {Napi::Number::New(env, static_cast<double>(data_offset)),
+               Napi::Number::New(env, static_cast<double>(data_offset +
+                                                          data_len_bytes))})
+        .As<Napi::Buffer<unsigned char>>();
+  }
+
+  // Wipes a reservation whose result won't be returned
+  void Abandon(const Reservation &reservation) {
+    secure_wipe_memory(reservation.cbuffer, reservation.allocation_size);
+    if (IsMostRecent(reservation)) {
+      slab_used = reservation.offset;
+    }
+  }
+
+  // Rebuilds a reservation from the pinned backing Buffer (async workers)
+  static Reservation Restore(const Napi::Buffer<unsigned char> &backing,
+                             char *cbuffer, size_t allocation_size) {
+    auto offset = static_cast<size_t>(
+        cbuffer - reinterpret_cast<char *>(backing.Data()));
+    return {backing, cbuffer, offset, allocation_size};
+  }
+
+  void Reset() {
+    current_slab.Reset();
+    slab_data = nullptr;
+    slab_used = 0;
+  }
+
+  static constexpr size_t slab_size = 128 * 1024;
+  static constexpr size_t dedicated_threshold = slab_size / 8;
+
+private:
+  static constexpr size_t alignment = 8;
+
+  static constexpr size_t AlignUp(size_t size) {
+    return (size + alignment - 1) & ~(alignment - 1);
+  }
+
+  [[nodiscard]] bool IsMostRecent(const Reservation &reservation) const {
+    return slab_data != nullptr &&
+           reservation.cbuffer == slab_data + reservation.offset &&
+           slab_used == reservation.offset +
+                            AlignUp(reservation.allocation_size);
+  }
+
+  Napi::ObjectReference current_slab;
+  char *slab_data = nullptr;
+  size_t slab_used = 0;
+};
+
+#endif // OUTPUT_SLAB_ALLOCATOR_H
@@ -0,0 +1,158 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <algorithm>          // for std::remove
+#include <atomic>             // for std::atomic
+#include <condition_variable> // for std::condition_variable
+#include <cstddef>            // for size_t
+#include <deque>              // for std::deque
+#include <exception>          // for std::exception_ptr
+#include <mutex>              // for std::mutex
+#include <system_error>       // for std::system_error
+#include <thread>             // for std::thread
+
+// Default fan-out for ParallelFor callers
+inline size_t DefaultParallelism() {
+  unsigned int hardware_threads = std::thread::hardware_concurrency();
+  return hardware_threads == 0 ? 1 : hardware_threads;
+}
+
+/*
+  Process-wide helper threads for ParallelFor, started on first use and
+  kept for the life of the process, so a batch call costs a queue push per
+  helper rather than a thread spawn and join.
+
+  A job is queued once per helper it could use.  Whatever the helpers
+  haven't picked up by the time the caller has finished the work itself is
+  withdrawn, so the caller never waits on a busy pool (or on itself, when
+  ParallelFor is called from a helper).
+*/
+class ParallelForPool {
+public:
+  struct Job {
+    void (*run)(void *context);
+    void *context;
+    // Guarded by the pool's mutex
+    size_t running = 0;
+  };
+
+  static ParallelForPool &Get() {
+    // Intentionally leaked: helpers are parked forever, and may be mid-job
+    // while static destructors run
+    static auto *pool = new ParallelForPool();
+    return *pool;
+  }
+
+  ParallelForPool(const ParallelForPool &) = delete;
+  ParallelForPool &operator=(const ParallelForPool &) = delete;
+
+  // Runs job->run on the calling thread and on up to helpers pool threads,
+  // returning once every run has returned
+  void Run(Job &job, size_t helpers) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      Grow(helpers);
+      for (size_t i = 0; i < helpers; i++) {
+        queue.push_back(&job);
+      }
+    }
+    cv.notify_all();
+
+    job.run(job.context);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    queue.erase(std::remove(queue.begin(), queue.end(), &job), queue.end());
+    done.wait(lock, [&job] { return job.running == 0; });
+  }
+
+private:
+  ParallelForPool() = default;
+
+  // Called with mutex held.  Out of threads just means fewer helpers.
+  void Grow(size_t wanted) {
+    while (thread_count < wanted) {
+      try {
+        std::thread(&ParallelForPool::WorkerLoop, this).detach();
+      } catch (const std::system_error &) {
+        return;
+      }
+      thread_count++;
+    }
+  }
+
+  void WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      cv.wait(lock, [this] { return !queue.empty(); });
+      Job *job = queue.front();
+      queue.pop_front();
+      job->running++;
+
+      lock.unlock();
+      job->run(job->context);
+      lock.lock();
+
+      if (--job->running == 0) {
+        done.notify_all();
+      }
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::condition_variable done;
+  std::deque<Job *> queue;
+  size_t thread_count = 0;
+};
+
+// Runs fn(i) for every i in [0, count) on up to max_threads threads, one of
+// which is the calling thread and the rest ParallelForPool helpers.  Indices
+// are handed out dynamically so uneven work balances itself.  The first
+// exception thrown by fn is rethrown once every thread has finished.
+template <typename Fn>
+void ParallelFor(size_t count, size_t max_threads, const Fn &fn) {
+  size_t thread_count = count < max_threads ? count : max_threads;
+  if (thread_count <= 1) {
+    for (size_t i = 0; i < count; i++) {
+      fn(i);
+    }
+    return;
+  }
+
+  struct State {
+    State(const Fn &fn, size_t count) : fn(fn), count(count) {}
+    const Fn &fn;
+    size_t count;
+    std::atomic<size_t> next_index{0};
+    std::exception_ptr first_error;
+    std::mutex error_mutex;
+  } state(fn, count);
+
+  ParallelForPool::Job job;
+  job.context = &state;
+  job.run = [](void *context) {
+    auto &state = *static_cast<State *>(context);
+    for (;;) {
+      size_t i = state.next_index.fetch_add(1, std::memory_order_relaxed);
+      if (i >= state.count) {
+        return;
+      }
+      try {
+        state.fn(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(state.error_mutex);
+        if (!state.first_error) {
+          state.first_error = std::current_exception();
+        }
+      }
+    }
+  };
+
+  ParallelForPool::Get().Run(job, thread_count - 1);
+
+  if (state.first_error) {
+    std::rethrow_exception(state.first_error);
+  }
+}
+
+#endif // PARALLEL_FOR_H
@@ -0,0 +1,361 @@
+#ifndef PHASE_TRACE_H
+#define PHASE_TRACE_H
+
+#include "hints.h"   // for likely, unlikely
+#include <algorithm> // for std::sort, std::remove
+#include <atomic>    // for std::atomic
+#include <chrono>    // for std::chrono::steady_clock
+#include <cinttypes> // for PRIu64
+#include <cstddef>   // for size_t
+#include <cstdint>   // for int64_t, uint32_t, uint64_t
+#include <cstdio>    // for snprintf
+#include <ctime>     // for clock_gettime
+#include <memory>    // for std::shared_ptr
+#include <mutex>     // for std::mutex
+#include <string>    // for std::string
+#include <utility>   // for std::pair
+#include <vector>    // for std::vector
+
+/*
+  Opt-in tracing of where each call spends its time: the JS thread part of
+  the call (marshaling, and for *_async calls queueing the task), time
+  waiting for a pool thread, the task on the pool thread, the libasherah
+  call itself and the completion back on the JS thread.  Every phase gets
+  wall and thread CPU time.
+
+  Each thread records into its own fixed-size ring, keeping the most recent
+  events.  The ring's mutex is only contended while a dump copies it out.
+  A ring outlives its thread until a dump has included it, then is freed.
+  Dump() writes Chrome Trace Event JSON, with flow arrows linking the
+  phases of each call across threads, for chrome://tracing or Perfetto.
+
+  When disabled, recording costs a relaxed load and a thread_local read.
+*/
+class PhaseTrace {
+public:
+  static constexpr size_t default_events_per_thread = 16384;
+
+  struct Clock {
+    int64_t wall_ns = 0;
+    int64_t cpu_ns = 0;
+
+    static Clock Now() {
+      Clock now;
+      now.wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch())
+                        .count();
+#ifdef CLOCK_THREAD_CPUTIME_ID
+      timespec cpu;
+      if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu) == 0) {
+        now.cpu_ns = static_cast<int64_t>(cpu.tv_sec) * 1000000000 +
+                     cpu.tv_nsec;
+      }
+#endif
+      return now;
+    }
+  };
+
+  // A phase of operation op on this thread; a no-op when op is 0.  Nested
+  // spans (e.g. the libasherah call inside a task) show as children.
+  class Span {
+  public:
+    Span(const char *name, uint64_t op, bool flow = false)
+        : name(name), op(op), flow(flow) {
+      if (unlikely(op != 0)) {
+        start = Clock::Now();
+      }
+    }
+
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+
+    ~Span() {
+      if (unlikely(op != 0)) {
+        RecordSpan(name, op, flow, start, Clock::Now());
+      }
+    }
+
+  private:
+    const char *name;
+    uint64_t op;
+    bool flow;
+    Clock start;
+  };
+
+  // Runs operation op on this thread as the named phase, so spans started
+  // under it belong to op
+  class Phase {
+  public:
+    Phase(const char *name, uint64_t op)
+        : previous(current_op), span(name, op, true) {
+      current_op = op;
+    }
+
+    Phase(const Phase &) = delete;
+    Phase &operator=(const Phase &) = delete;
+
+    ~Phase() { current_op = previous; }
+
+  private:
+    uint64_t previous;
+    Span span;
+  };
+
+  // Starts a new operation (0 when tracing is off) for the current call
+  static uint64_t NewOp() {
+    if (likely(!enabled.load(std::memory_order_relaxed))) {
+      return 0;
+    }
+    return next_op.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static uint64_t CurrentOp() { return current_op; }
+
+  // Records op waiting from since until now, e.g. in a task queue
+  static void RecordWait(const char *name, uint64_t op, int64_t since_ns) {
+    if (unlikely(op != 0)) {
+      Event event{};
+      event.name = name;
+      event.op = op;
+      event.wait = true;
+      event.ts_ns = since_ns;
+      event.dur_ns = Clock::Now().wall_ns - since_ns;
+      Record(event);
+    }
+  }
+
+  static void Enable(size_t events_per_thread) {
+    capacity.store(events_per_thread, std::memory_order_relaxed);
+    enabled.store(true, std::memory_order_relaxed);
+  }
+
+  static void Disable() { enabled.store(false, std::memory_order_relaxed); }
+
+  // Names this thread in dumps; name must outlive the process's rings
+  static void NameThread(const char *name) { thread_name = name; }
+
+  // Chrome Trace Event JSON for every event still in the rings.  Rings of
+  // exited threads are dropped once dumped.
+  static std::string Dump(bool clear) {
+    std::vector<std::pair<std::shared_ptr<Ring>, std::vector<Event>>> threads;
+    {
+      Registry &registry = GetRegistry();
+      std::lock_guard<std::mutex> registry_lock(registry.mutex);
+      size_t kept = 0;
+      for (auto &ring : registry.rings) {
+        std::lock_guard<std::mutex> lock(ring->mutex);
+        threads.emplace_back(ring, ring->Ordered());
+        if (clear) {
+          ring->Clear();
+        }
+        if (!ring->exited) {
+          registry.rings[kept++] = ring;
+        }
+      }
+      registry.rings.resize(kept);
+    }
+
+    std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    json += "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\","
+            "\"args\":{\"name\":\"asherah\"}}";
+
+    // (op, ts, tid) of each phase, for the flow arrows between them
+    struct FlowPoint {
+      uint64_t op;
+      int64_t ts_ns;
+      uint32_t tid;
+    };
+    std::vector<FlowPoint> flow_points;
+
+    char line[384];
+    for (auto &thread : threads) {
+      const Ring &ring = *thread.first;
+      if (ring.name != nullptr) {
+        snprintf(line, sizeof(line),
+                 ",{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":"
+                 "\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+                 ring.tid, ring.name);
+        json += line;
+      }
+      // Names are literals from this addon, so need no escaping
+      for (auto &event : thread.second) {
+        if (event.wait) {
+          // Nestable async slice, drawn on its own track per operation
+          snprintf(line, sizeof(line),
+                   ",{\"ph\":\"b\",\"cat\":\"asherah\",\"pid\":1,"
+                   "\"tid\":%u,\"id\":%" PRIu64 ",\"name\":\"%s\","
+                   "\"ts\":%.3f},{\"ph\":\"e\",\"cat\":\"asherah\","
+                   "\"pid\":1,\"tid\":%u,\"id\":%" PRIu64
+                   ",\"name\":\"%s\",\"ts\":%.3f}",
+                   ring.tid, event.op, event.name, Micros(event.ts_ns),
+                   ring.tid, event.op, event.name,
+                   Micros(event.ts_ns + event.dur_ns));
+        } else {
+          snprintf(line, sizeof(line),
+                   ",{\"ph\":\"X\",\"cat\":\"asherah\",\"pid\":1,"
+                   "\"tid\":%u,\"name\":\"%s\",\"ts\":%.3f,\"dur\":%.3f,"
+                   "\"tts\":%.3f,\"tdur\":%.3f,\"args\":{\"op\":%" PRIu64
+                   "}}",
+                   ring.tid, event.name, Micros(event.ts_ns),
+                   Micros(event.dur_ns), Micros(event.tts_ns),
+                   Micros(event.tdur_ns), event.op);
+          if (event.flow) {
+            flow_points.push_back({event.op, event.ts_ns, ring.tid});
+          }
+        }
+        json += line;
+      }
+    }
+
+    std::sort(flow_points.begin(), flow_points.end(),
+              [](const FlowPoint &a, const FlowPoint &b) {
+                return a.op != b.op ? a.op < b.op : a.ts_ns < b.ts_ns;
+              });
+    for (size_t i = 0; i < flow_points.size(); i++) {
+      auto &point = flow_points[i];
+      bool first = i == 0 || flow_points[i - 1].op != point.op;
+      bool last =
+          i + 1 == flow_points.size() || flow_points[i + 1].op != point.op;
+      if (first && last) {
+        continue; // Single-phase (sync) call
+      }
+      snprintf(line, sizeof(line),
+               ",{\"ph\":\"%s\",\"cat\":\"asherah\",\"pid\":1,\"tid\":%u,"
+               "\"id\":%" PRIu64 ",\"name\":\"op\",\"ts\":%.3f,"
+               "\"bp\":\"e\"}",
+               first ? "s" : (last ? "f" : "t"), point.tid, point.op,
+               Micros(point.ts_ns));
+      json += line;
+    }
+
+    json += "]}";
+    return json;
+  }
+
+private:
+  struct Event {
+    const char *name;
+    uint64_t op;
+    bool flow;
+    bool wait;
+    int64_t ts_ns;
+    int64_t dur_ns;
+    int64_t tts_ns;
+    int64_t tdur_ns;
+  };
+
+  struct Ring {
+    std::mutex mutex;
+    std::vector<Event> events;
+    size_t next = 0;
+    bool wrapped = false;
+    bool exited = false;
+    uint32_t tid = 0;
+    const char *name = nullptr;
+
+    bool empty() const { return next == 0 && !wrapped; }
+
+    void Clear() {
+      next = 0;
+      wrapped = false;
+    }
+
+    std::vector<Event> Ordered() const {
+      std::vector<Event> ordered;
+      if (wrapped) {
+        ordered.insert(ordered.end(), events.begin() + next, events.end());
+      }
+      ordered.insert(ordered.end(), events.begin(), events.begin() + next);
+      return ordered;
+    }
+  };
+
+  struct Registry {
+    std::mutex mutex;
+    // Rings outlive their threads so a dump still shows exited threads
+    std::vector<std::shared_ptr<Ring>> rings;
+    uint32_t next_tid = 1;
+  };
+
+  // Hands a thread's ring back when the thread exits: an empty ring is
+  // freed now, anything else by the next dump
+  struct ThreadRing {
+    std::shared_ptr<Ring> ring;
+
+    ~ThreadRing() {
+      if (ring == nullptr) {
+        return;
+      }
+      Registry &registry = GetRegistry();
+      std::lock_guard<std::mutex> registry_lock(registry.mutex);
+      std::lock_guard<std::mutex> lock(ring->mutex);
+      ring->exited = true;
+      if (ring->empty()) {
+        auto &rings = registry.rings;
+        rings.erase(std::remove(rings.begin(), rings.end(), ring),
+                    rings.end());
+      }
+    }
+  };
+
+  static inline std::atomic<bool> enabled{false};
+  static inline std::atomic<size_t> capacity{default_events_per_thread};
+  static inline std::atomic<uint64_t> next_op{1};
+  static inline thread_local uint64_t current_op = 0;
+  static inline thread_local const char *thread_name = nullptr;
+
+  static double Micros(int64_t ns) { return static_cast<double>(ns) / 1e3; }
+
+  static Registry &GetRegistry() {
+    // Intentionally leaked so exiting threads never touch a destroyed mutex
+    static auto *registry = new Registry();
+    return *registry;
+  }
+
+  static Ring &GetThreadRing() {
+    thread_local ThreadRing thread_ring;
+    auto &ring = thread_ring.ring;
+    if (unlikely(ring == nullptr)) {
+      ring = std::make_shared<Ring>();
+      ring->name = thread_name;
+      Registry &registry = GetRegistry();
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      ring->tid = registry.next_tid++;
+      registry.rings.push_back(ring);
+    }
+    return *ring;
+  }
+
+  static void RecordSpan(const char *name, uint64_t op, bool flow,
+                         const Clock &start, const Clock &end) {
+    Event event{};
+    event.name = name;
+    event.op = op;
+    event.flow = flow;
+    event.ts_ns = start.wall_ns;
+    event.dur_ns = end.wall_ns - start.wall_ns;
+    event.tts_ns = start.cpu_ns;
+    event.tdur_ns = end.cpu_ns - start.cpu_ns;
+    Record(event);
+  }
+
+  static void Record(const Event &event) {
+    Ring &ring = GetThreadRing();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    size_t events_per_thread = capacity.load(std::memory_order_relaxed);
+    if (unlikely(ring.events.size() != events_per_thread)) {
+      ring.events.assign(events_per_thread, Event{});
+      ring.Clear();
+    }
+    if (unlikely(events_per_thread == 0)) {
+      return;
+    }
+    ring.events[ring.next] = event;
+    if (++ring.next == events_per_thread) {
+      ring.next = 0;
+      ring.wrapped = true;
+    }
+  }
+};
+
+#endif // PHASE_TRACE_H
@@ -3,7 +3,8 @@
 
 #ifdef USE_SCOPED_ALLOCATE_BUFFER
 
-#include "hints.h" // for unlikely macro
+#include "hints.h"           // for unlikely macro
+#include "marshal_counters.h" // for MarshalCounters
 
 /*
   This macro allows us to allocate a buffer either on the stack or on the heap.
@@ -21,7 +22,9 @@
                                           max_stack_alloc_size, function_name) \
   do {                                                                         \
     buffer = nullptr;                                                          \
-    if (buffer_size < max_stack_alloc_size) {                                  \
+    if (buffer_size == 0) {                                                    \
+      /* Nothing to allocate (e.g. the input is used in place) */              \
+    } else if (buffer_size < max_stack_alloc_size) {                           \
       /* If the buffer is small enough, allocate it on the stack */            \
       buffer = (char *)alloca(buffer_size);                                    \
       if (unlikely(buffer == nullptr)) {                                       \
@@ -29,6 +32,8 @@
                                  std::to_string(buffer_size) +                 \
                                  ") returned null");                           \
       }                                                                        \
+      MarshalCounters::Add(MarshalCounters::Counter::StackAllocation,          \
+                           buffer_size);                                       \
     } else {                                                                   \
       /* Otherwise, allocate it on the heap */                                 \
       buffer = new (std::nothrow) char[buffer_size];                           \
@@ -38,6 +43,8 @@
                                  "] returned null");                           \
       }                                                                        \
       unique_ptr.reset(buffer);                                                \
+      MarshalCounters::Add(MarshalCounters::Counter::HeapAllocation,           \
+                           buffer_size);                                       \
     }                                                                          \
   } while (0)
 
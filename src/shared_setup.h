@@ -0,0 +1,99 @@
+#ifndef SHARED_SETUP_H
+#define SHARED_SETUP_H
+
+#include <cstddef>   // for size_t
+#include <mutex>     // for std::mutex
+#include <stdexcept> // for std::invalid_argument
+#include <string>    // for std::string
+
+/*
+  libasherah is set up once per process, but every Node environment (the
+  main thread and each worker_thread) gets its own Asherah addon instance.
+  SharedSetup counts the environments that have called setup: the first
+  one runs libasherah's setup, later ones join it, and the last one to shut
+  down tears it down.  Setup and shutdown are serialized, so one environment
+  never joins a setup another is still running or tearing down.
+
+  Joining requires the same libasherah settings as the active setup, so no
+  environment encrypts under a key hierarchy other than the one it asked
+  for.
+*/
+class SharedSetup {
+public:
+  // One environment's reference, shared between the environment and a
+  // setup_async still in flight for it.  Once released it is spent, so a
+  // setup that completes after its environment is gone takes nothing.
+  class Claim {
+  private:
+    friend class SharedSetup;
+    bool held = false;
+    bool released = false;
+  };
+
+  static SharedSetup &Get() {
+    // Intentionally leaked: environments may still be shutting down while
+    // static destructors run
+    static auto *shared = new SharedSetup();
+    return *shared;
+  }
+
+  SharedSetup(const SharedSetup &) = delete;
+  SharedSetup &operator=(const SharedSetup &) = delete;
+
+  // Takes a reference for claim, running setup first if nobody holds one.
+  // A negative result from setup is returned and takes no reference.
+  // config is the canonical form of the libasherah settings; joining with
+  // different ones throws.  joined is set if libasherah was already set up.
+  template <typename SetupFunction>
+  auto Acquire(Claim &claim, const std::string &config, SetupFunction &&setup,
+               bool &joined) -> decltype(setup()) {
+    std::lock_guard<std::mutex> lock(mutex);
+    joined = references != 0;
+    if (claim.released) {
+      return 0;
+    }
+    if (joined) {
+      if (config != active_config) {
+        throw std::invalid_argument(
+            "setup: config differs from the setup already shared by another "
+            "thread in this process");
+      }
+    } else {
+      auto result = setup();
+      if (result < 0) {
+        return result;
+      }
+      active_config = config;
+    }
+    claim.held = true;
+    references++;
+    return 0;
+  }
+
+  // Gives up claim's reference, if it took one, running shutdown if it was
+  // the last.  Returns whether it did.
+  template <typename ShutdownFunction>
+  bool Release(Claim &claim, ShutdownFunction &&shutdown) {
+    std::lock_guard<std::mutex> lock(mutex);
+    claim.released = true;
+    if (!claim.held) {
+      return false;
+    }
+    claim.held = false;
+    if (--references != 0) {
+      return false;
+    }
+    active_config.clear();
+    shutdown();
+    return true;
+  }
+
+private:
+  SharedSetup() = default;
+
+  std::mutex mutex;
+  size_t references = 0;
+  std::string active_config;
+};
+
+#endif // SHARED_SETUP_H
@@ -0,0 +1,109 @@
+#ifndef STREAM_FRAMING_H
+#define STREAM_FRAMING_H
+
+#include <cstddef> // for size_t
+#include <cstdint> // for uint32_t, uint64_t
+#include <cstring> // for std::memcmp, std::memcpy
+#include <random>  // for std::random_device
+
+/*
+  Chunked envelope used by createEncryptStream / createDecryptStream.
+
+    stream := magic frame*
+    magic  := "AHS1"
+    frame  := uint32 big-endian DRR length, DRR JSON bytes
+
+  Each DRR encrypts a chunk header followed by up to chunk_size bytes of
+  plaintext:
+
+    chunk header := uint64 stream ID, uint64 sequence number, uint8 flags
+
+  all big-endian.  The stream ID is random per stream and the sequence number
+  counts up from zero, so chunks can't be reordered, dropped or spliced in
+  from another stream without failing authentication checks on decrypt.
+  The last chunk carries the final flag (and possibly no data), so
+  truncation at a frame boundary is detected too.
+*/
+class StreamFraming {
+public:
+  static constexpr char magic[] = {'A', 'H', 'S', '1'};
+  static constexpr size_t magic_size = sizeof(magic);
+  static constexpr size_t length_prefix_size = sizeof(uint32_t);
+  static constexpr size_t chunk_header_size = 8 + 8 + 1;
+  static constexpr uint8_t final_flag = 0x01;
+
+  static constexpr size_t default_chunk_size = 64 * 1024;
+  static constexpr size_t min_chunk_size = 1024;
+  static constexpr size_t max_chunk_size = 16 * 1024 * 1024;
+  // Bounds how much a decrypt stream will buffer waiting for one frame
+  static constexpr size_t max_frame_size = 2 * max_chunk_size;
+
+  struct ChunkHeader {
+    uint64_t stream_id;
+    uint64_t sequence;
+    bool final;
+  };
+
+  static uint64_t NewStreamId() {
+    std::random_device random;
+    return (static_cast<uint64_t>(random()) << 32) ^ random();
+  }
+
+  static bool HasMagic(const char *data) {
+    return std::memcmp(data, magic, magic_size) == 0;
+  }
+
+  static void WriteChunkHeader(char *dest, const ChunkHeader &header) {
+    WriteUint64(dest, header.stream_id);
+    WriteUint64(dest + 8, header.sequence);
+    dest[16] = static_cast<char>(header.final ? final_flag : 0);
+  }
+
+  static bool ReadChunkHeader(const char *data, size_t len,
+                              ChunkHeader &header) {
+    if (len < chunk_header_size) {
+      return false;
+    }
+    header.stream_id = ReadUint64(data);
+    header.sequence = ReadUint64(data + 8);
+    auto flags = static_cast<uint8_t>(data[16]);
+    if ((flags & ~final_flag) != 0) {
+      return false;
+    }
+    header.final = (flags & final_flag) != 0;
+    return true;
+  }
+
+  static void WriteLengthPrefix(char *dest, uint32_t len) {
+    for (int i = 3; i >= 0; i--) {
+      dest[i] = static_cast<char>(len & 0xff);
+      len >>= 8;
+    }
+  }
+
+  static uint32_t ReadLengthPrefix(const char *data) {
+    uint32_t len = 0;
+    for (int i = 0; i < 4; i++) {
+      len = (len << 8) | static_cast<uint8_t>(data[i]);
+    }
+    return len;
+  }
+
+private:
+  static void WriteUint64(char *dest, uint64_t value) {
+    for (int i = 7; i >= 0; i--) {
+      dest[i] = static_cast<char>(value & 0xff);
+      value >>= 8;
+    }
+  }
+
+  static uint64_t ReadUint64(const char *data) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+      value = (value << 8) | static_cast<uint8_t>(data[i]);
+    }
+    return value;
+  }
+};
+
+#endif // STREAM_FRAMING_H
@@ -0,0 +1,83 @@
+#ifndef WORKER_FREELIST_H
+#define WORKER_FREELIST_H
+
+#include <cstddef> // for size_t
+#include <new>     // for ::operator new, ::operator delete
+
+/*
+  Recycles async worker allocations.  Workers are created and destroyed on
+  the JS thread that owns them, so each thread keeps its own lists and no
+  locking is needed.  Sizes are rounded up to size_class_bytes; anything
+  larger than the biggest class goes straight to the heap.
+*/
+class WorkerFreelist {
+public:
+  static constexpr size_t size_class_bytes = 64;
+  static constexpr size_t size_class_count = 16; // up to 1KB
+  static constexpr size_t max_cached_per_class = 64;
+
+  static void *Allocate(size_t size) {
+    size_t size_class = SizeClass(size);
+    if (size_class < size_class_count) {
+      auto &list = Lists().lists[size_class];
+      if (list.head != nullptr) {
+        Node *node = list.head;
+        list.head = node->next;
+        list.count--;
+        return node;
+      }
+      return ::operator new((size_class + 1) * size_class_bytes);
+    }
+    return ::operator new(size);
+  }
+
+  static void Free(void *ptr, size_t size) {
+    size_t size_class = SizeClass(size);
+    if (size_class < size_class_count) {
+      auto &list = Lists().lists[size_class];
+      if (list.count < max_cached_per_class) {
+        auto node = static_cast<Node *>(ptr);
+        node->next = list.head;
+        list.head = node;
+        list.count++;
+        return;
+      }
+    }
+    ::operator delete(ptr);
+  }
+
+private:
+  struct Node {
+    Node *next;
+  };
+
+  struct List {
+    Node *head = nullptr;
+    size_t count = 0;
+  };
+
+  struct ThreadLists {
+    List lists[size_class_count];
+
+    ~ThreadLists() {
+      for (auto &list : lists) {
+        while (list.head != nullptr) {
+          Node *next = list.head->next;
+          ::operator delete(list.head);
+          list.head = next;
+        }
+      }
+    }
+  };
+
+  static size_t SizeClass(size_t size) {
+    return size == 0 ? 0 : (size - 1) / size_class_bytes;
+  }
+
+  static ThreadLists &Lists() {
+    static thread_local ThreadLists thread_lists;
+    return thread_lists;
+  }
+};
+
+#endif // WORKER_FREELIST_H
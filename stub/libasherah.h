@@ -0,0 +1,37 @@
+/* Exports of the Go libasherah, as declared by its cgo header, implemented
+   by libasherah_stub.c for ASHERAH_STUB builds */
+
+#ifndef LIBASHERAH_STUB_H
+#define LIBASHERAH_STUB_H
+
+#include <stdint.h>
+
+typedef int32_t GoInt32;
+typedef int64_t GoInt64;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern GoInt32 SetEnv(void *envJson);
+extern GoInt32 SetupJson(void *configJson);
+extern void Shutdown(void);
+extern GoInt32 EncryptToJson(void *partitionIdPtr, void *dataPtr,
+                             void *jsonPtr);
+extern GoInt32 DecryptFromJson(void *partitionIdPtr, void *jsonPtr,
+                               void *dataPtr);
+extern GoInt32 Encrypt(void *partitionIdPtr, void *dataPtr,
+                       void *outputEncryptedDataPtr,
+                       void *outputEncryptedKeyPtr, void *outputCreatedPtr,
+                       void *outputParentKeyIdPtr,
+                       void *outputParentKeyCreatedPtr);
+extern GoInt32 Decrypt(void *partitionIdPtr, void *encryptedDataPtr,
+                       void *encryptedKeyPtr, GoInt64 created,
+                       void *parentKeyIdPtr, GoInt64 parentKeyCreated,
+                       void *outputDecryptedDataPtr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBASHERAH_STUB_H */
@@ -0,0 +1,575 @@
+/*
+  Null-crypto stand-in for the Go libasherah, for measuring and profiling
+  the binding (N-API and Cobhan marshaling) on its own.  Built instead of
+  lib/libasherah.a when ASHERAH_STUB=1.
+
+  THIS DOES NOT ENCRYPT.  Data is XORed with a constant.
+
+  Everything the binding can observe matches the real library: the same
+  exports, Cobhan buffer handling and error codes, and DataRowRecords of
+  the same layout and size (a 12 byte nonce and 16 byte tag around the
+  data, a 60 byte encrypted key (a 32 byte key plus nonce and tag), and a
+  KeyId built from the partition, service and product).  The tag only depends on the partition, so
+  decrypting with the wrong partition still fails.
+*/
+
+#include "libasherah.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum {
+  ERR_NONE = 0,
+  ERR_NULL_PTR = -1,
+  ERR_BUFFER_TOO_LARGE = -2,
+  ERR_BUFFER_TOO_SMALL = -3,
+  ERR_JSON_DECODE_FAILED = -5,
+  ERR_NOT_INITIALIZED = -100,
+  ERR_ALREADY_INITIALIZED = -101,
+  ERR_DECRYPT_FAILED = -104,
+  ERR_BAD_CONFIG = -105,
+};
+
+#define HEADER_SIZE 8
+#define NONCE_SIZE 12
+#define TAG_SIZE 16
+#define AEAD_OVERHEAD (NONCE_SIZE + TAG_SIZE)
+#define ENCRYPTED_KEY_SIZE (32 + AEAD_OVERHEAD)
+#define XOR_BYTE 0x5a
+#define MAX_NAME_SIZE 256
+
+static atomic_int initialized;
+static atomic_uint_fast64_t nonce_counter;
+// "_<service>_<product>", already JSON-escaped as it was in the config
+static char key_id_suffix[2 * MAX_NAME_SIZE + 2];
+static size_t key_id_suffix_len;
+
+/* Cobhan buffers: int32 length, int32 reserved, then the data.  For
+   outputs the length is the capacity on entry. */
+
+static int32_t buffer_len(const void *buffer) {
+  int32_t len;
+  memcpy(&len, buffer, sizeof(len));
+  return len;
+}
+
+static const char *buffer_data(const void *buffer) {
+  return (const char *)buffer + HEADER_SIZE;
+}
+
+static char *output_data(void *buffer) { return (char *)buffer + HEADER_SIZE; }
+
+static GoInt32 input_span(const void *buffer, const char **data,
+                          size_t *len) {
+  if (buffer == NULL) {
+    return ERR_NULL_PTR;
+  }
+  int32_t length = buffer_len(buffer);
+  if (length < 0) {
+    // Temp file inputs aren't supported
+    return ERR_BUFFER_TOO_LARGE;
+  }
+  *data = buffer_data(buffer);
+  *len = (size_t)length;
+  return ERR_NONE;
+}
+
+static GoInt32 output_check(const void *buffer, size_t needed) {
+  if (buffer == NULL) {
+    return ERR_NULL_PTR;
+  }
+  int32_t capacity = buffer_len(buffer);
+  if (capacity < 0 || (size_t)capacity < needed) {
+    return ERR_BUFFER_TOO_SMALL;
+  }
+  return ERR_NONE;
+}
+
+static void output_set_len(void *buffer, size_t len) {
+  int32_t length = (int32_t)len;
+  memcpy(buffer, &length, sizeof(length));
+}
+
+/* JSON */
+
+// Length once escaped the way Go's encoding/json escapes strings
+static size_t json_escaped_len(const char *s, size_t len) {
+  size_t escaped = 0;
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = (unsigned char)s[i];
+    if (c == '"' || c == '\\') {
+      escaped += 2;
+    } else if (c == '<' || c == '>' || c == '&') {
+      escaped += 6;
+    } else if (c < 0x20) {
+      escaped += (c == '\n' || c == '\r' || c == '\t') ? 2 : 6;
+    } else if (c == 0xe2 && i + 2 < len && (unsigned char)s[i + 1] == 0x80 &&
+               ((unsigned char)s[i + 2] & 0xfe) == 0xa8) {
+      escaped += 6; // U+2028, U+2029
+      i += 2;
+    } else {
+      escaped += 1;
+    }
+  }
+  return escaped;
+}
+
+static char *json_escape(char *out, const char *s, size_t len) {
+  static const char hex[] = "0123456789abcdef";
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = (unsigned char)s[i];
+    unsigned code = c;
+    if (c == '"' || c == '\\') {
+      *out++ = '\\';
+      *out++ = (char)c;
+      continue;
+    } else if (c == '\n' || c == '\r' || c == '\t') {
+      *out++ = '\\';
+      *out++ = c == '\n' ? 'n' : (c == '\r' ? 'r' : 't');
+      continue;
+    } else if (c == 0xe2 && i + 2 < len && (unsigned char)s[i + 1] == 0x80 &&
+               ((unsigned char)s[i + 2] & 0xfe) == 0xa8) {
+      code = 0x2000u | (unsigned char)s[i + 2];
+      i += 2;
+    } else if (c >= 0x20 && c != '<' && c != '>' && c != '&') {
+      *out++ = (char)c;
+      continue;
+    }
+    *out++ = '\\';
+    *out++ = 'u';
+    *out++ = hex[(code >> 12) & 0xf];
+    *out++ = hex[(code >> 8) & 0xf];
+    *out++ = hex[(code >> 4) & 0xf];
+    *out++ = hex[code & 0xf];
+  }
+  return out;
+}
+
+// Raw (still escaped) value of the first "name":"value" string field, or
+// NULL
+static const char *json_string_field(const char *json, size_t len,
+                                     const char *name, size_t *value_len) {
+  size_t name_len = strlen(name);
+  for (size_t i = 0; i + name_len + 2 < len; i++) {
+    if (json[i] != '"' || memcmp(json + i + 1, name, name_len) != 0 ||
+        json[i + name_len + 1] != '"') {
+      continue;
+    }
+    size_t j = i + name_len + 2;
+    while (j < len && (json[j] == ' ' || json[j] == ':')) {
+      j++;
+    }
+    if (j >= len || json[j] != '"') {
+      return NULL;
+    }
+    const char *value = json + j + 1;
+    const char *end = memchr(value, '"', len - j - 1);
+    while (end != NULL && end[-1] == '\\') {
+      end = memchr(end + 1, '"', (size_t)(json + len - end - 1));
+    }
+    if (end == NULL) {
+      return NULL;
+    }
+    *value_len = (size_t)(end - value);
+    return value;
+  }
+  return NULL;
+}
+
+/* Base64 (standard, padded) */
+
+static const char base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static size_t base64_len(size_t len) { return (len + 2) / 3 * 4; }
+
+static char *base64_encode(char *out, const unsigned char *in, size_t len) {
+  size_t i = 0;
+  for (; i + 2 < len; i += 3) {
+    uint32_t v = (uint32_t)in[i] << 16 | (uint32_t)in[i + 1] << 8 | in[i + 2];
+    *out++ = base64_chars[v >> 18];
+    *out++ = base64_chars[(v >> 12) & 63];
+    *out++ = base64_chars[(v >> 6) & 63];
+    *out++ = base64_chars[v & 63];
+  }
+  if (i < len) {
+    uint32_t v = (uint32_t)in[i] << 16;
+    if (i + 1 < len) {
+      v |= (uint32_t)in[i + 1] << 8;
+    }
+    *out++ = base64_chars[v >> 18];
+    *out++ = base64_chars[(v >> 12) & 63];
+    *out++ = i + 1 < len ? base64_chars[(v >> 6) & 63] : '=';
+    *out++ = '=';
+  }
+  return out;
+}
+
+static const signed char base64_values[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+static int base64_value(char c) { return base64_values[(unsigned char)c]; }
+
+// Returns the decoded length, or -1 if in isn't padded base64
+static long base64_decode(unsigned char *out, const char *in, size_t len) {
+  if (len % 4 != 0) {
+    return -1;
+  }
+  size_t written = 0;
+  for (size_t i = 0; i < len; i += 4) {
+    int pad = 0;
+    uint32_t v = 0;
+    for (size_t j = 0; j < 4; j++) {
+      int d;
+      if (in[i + j] == '=' && i + 4 == len && j >= 2) {
+        pad++;
+        d = 0;
+      } else if (pad > 0 || (d = base64_value(in[i + j])) < 0) {
+        return -1;
+      }
+      v = v << 6 | (uint32_t)d;
+    }
+    out[written++] = (unsigned char)(v >> 16);
+    if (pad < 2) {
+      out[written++] = (unsigned char)(v >> 8);
+    }
+    if (pad < 1) {
+      out[written++] = (unsigned char)v;
+    }
+  }
+  return (long)written;
+}
+
+/* The "cipher" */
+
+static void partition_tag(unsigned char tag[TAG_SIZE], const char *partition,
+                          size_t len) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char)partition[i]) * 0x100000001b3ull;
+  }
+  memcpy(tag, &hash, sizeof(hash));
+  hash = ~hash;
+  memcpy(tag + sizeof(hash), &hash, sizeof(hash));
+}
+
+static void xor_copy(unsigned char *out, const unsigned char *in,
+                     size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    out[i] = in[i] ^ XOR_BYTE;
+  }
+}
+
+// nonce || data ^ XOR_BYTE || tag
+static void seal(unsigned char *out, const char *data, size_t len,
+                 const char *partition, size_t partition_len) {
+  uint64_t nonce = atomic_fetch_add(&nonce_counter, 1);
+  memset(out, 0, NONCE_SIZE);
+  memcpy(out, &nonce, sizeof(nonce));
+  xor_copy(out + NONCE_SIZE, (const unsigned char *)data, len);
+  partition_tag(out + NONCE_SIZE + len, partition, partition_len);
+}
+
+static int open_sealed(unsigned char *out, const unsigned char *sealed,
+                       size_t sealed_len, const char *partition,
+                       size_t partition_len) {
+  unsigned char tag[TAG_SIZE];
+  if (sealed_len < AEAD_OVERHEAD) {
+    return 0;
+  }
+  partition_tag(tag, partition, partition_len);
+  if (memcmp(tag, sealed + sealed_len - TAG_SIZE, TAG_SIZE) != 0) {
+    return 0;
+  }
+  xor_copy(out, sealed + NONCE_SIZE, sealed_len - AEAD_OVERHEAD);
+  return 1;
+}
+
+static void encrypted_key(unsigned char key[ENCRYPTED_KEY_SIZE]) {
+  for (size_t i = 0; i < ENCRYPTED_KEY_SIZE; i++) {
+    key[i] = (unsigned char)(i * 7 + 1);
+  }
+}
+
+static long long created_now(void) {
+  // Real keys are created on minute boundaries
+  return (long long)time(NULL) / 60 * 60;
+}
+
+/* Exports */
+
+GoInt32 SetEnv(void *envJson) {
+  return envJson == NULL ? ERR_NULL_PTR : ERR_NONE;
+}
+
+GoInt32 SetupJson(void *configJson) {
+  const char *config;
+  size_t len;
+  GoInt32 result = input_span(configJson, &config, &len);
+  if (result != ERR_NONE) {
+    return result;
+  }
+  if (atomic_load(&initialized)) {
+    return ERR_ALREADY_INITIALIZED;
+  }
+
+  size_t service_len;
+  size_t product_len;
+  const char *service =
+      json_string_field(config, len, "ServiceName", &service_len);
+  const char *product =
+      json_string_field(config, len, "ProductID", &product_len);
+  if (service == NULL || product == NULL || service_len > MAX_NAME_SIZE ||
+      product_len > MAX_NAME_SIZE) {
+    return ERR_BAD_CONFIG;
+  }
+  char *p = key_id_suffix;
+  *p++ = '_';
+  memcpy(p, service, service_len);
+  p += service_len;
+  *p++ = '_';
+  memcpy(p, product, product_len);
+  key_id_suffix_len = (size_t)(p + product_len - key_id_suffix);
+
+  atomic_store(&initialized, 1);
+  // Nobody should mistake a stub build for a real one
+  fputs("\n"
+        "*** WARNING: asherah-node is built with stub/libasherah_stub.c\n"
+        "*** (ASHERAH_STUB=1).  DATA IS NOT ENCRYPTED.  Benchmarks only.\n"
+        "\n",
+        stderr);
+  return ERR_NONE;
+}
+
+void Shutdown(void) { atomic_store(&initialized, 0); }
+
+GoInt32 EncryptToJson(void *partitionIdPtr, void *dataPtr, void *jsonPtr) {
+  const char *partition;
+  size_t partition_len;
+  const char *data;
+  size_t data_len;
+  GoInt32 result = input_span(partitionIdPtr, &partition, &partition_len);
+  if (result == ERR_NONE) {
+    result = input_span(dataPtr, &data, &data_len);
+  }
+  if (result != ERR_NONE) {
+    return result;
+  }
+  if (!atomic_load(&initialized)) {
+    return ERR_NOT_INITIALIZED;
+  }
+
+  static const char key_prefix[] = "{\"Key\":{\"Created\":";
+  static const char key_value[] = ",\"Key\":\"";
+  static const char key_id[] = "\",\"ParentKeyMeta\":{\"KeyId\":\"_IK_";
+  static const char parent_created[] = "\",\"Created\":";
+  static const char data_prefix[] = "}},\"Data\":\"";
+  char created[24];
+  size_t created_len = (size_t)snprintf(created, sizeof(created), "%lld",
+                                        created_now());
+
+  size_t sealed_len = data_len + AEAD_OVERHEAD;
+  size_t needed = sizeof(key_prefix) - 1 + 2 * created_len +
+                  sizeof(key_value) - 1 + base64_len(ENCRYPTED_KEY_SIZE) +
+                  sizeof(key_id) - 1 +
+                  json_escaped_len(partition, partition_len) +
+                  key_id_suffix_len + sizeof(parent_created) - 1 +
+                  sizeof(data_prefix) - 1 + base64_len(sealed_len) + 2;
+  result = output_check(jsonPtr, needed);
+  if (result != ERR_NONE) {
+    return result;
+  }
+
+  unsigned char *sealed = malloc(sealed_len);
+  if (sealed == NULL) {
+    return ERR_BUFFER_TOO_LARGE;
+  }
+  seal(sealed, data, data_len, partition, partition_len);
+  unsigned char key[ENCRYPTED_KEY_SIZE];
+  encrypted_key(key);
+
+  char *out = output_data(jsonPtr);
+#define APPEND(s, n)                                                           \
+  do {                                                                         \
+    memcpy(out, s, n);                                                         \
+    out += n;                                                                  \
+  } while (0)
+  APPEND(key_prefix, sizeof(key_prefix) - 1);
+  APPEND(created, created_len);
+  APPEND(key_value, sizeof(key_value) - 1);
+  out = base64_encode(out, key, sizeof(key));
+  APPEND(key_id, sizeof(key_id) - 1);
+  out = json_escape(out, partition, partition_len);
+  APPEND(key_id_suffix, key_id_suffix_len);
+  APPEND(parent_created, sizeof(parent_created) - 1);
+  APPEND(created, created_len);
+  APPEND(data_prefix, sizeof(data_prefix) - 1);
+  out = base64_encode(out, sealed, sealed_len);
+  APPEND("\"}", 2);
+#undef APPEND
+  free(sealed);
+
+  output_set_len(jsonPtr, (size_t)(out - output_data(jsonPtr)));
+  return ERR_NONE;
+}
+
+GoInt32 DecryptFromJson(void *partitionIdPtr, void *jsonPtr, void *dataPtr) {
+  const char *partition;
+  size_t partition_len;
+  const char *json;
+  size_t json_len;
+  GoInt32 result = input_span(partitionIdPtr, &partition, &partition_len);
+  if (result == ERR_NONE) {
+    result = input_span(jsonPtr, &json, &json_len);
+  }
+  if (result != ERR_NONE) {
+    return result;
+  }
+  if (!atomic_load(&initialized)) {
+    return ERR_NOT_INITIALIZED;
+  }
+
+  size_t encoded_len;
+  const char *encoded =
+      json_string_field(json, json_len, "Data", &encoded_len);
+  if (encoded == NULL || json_len == 0 || json[0] != '{') {
+    return ERR_JSON_DECODE_FAILED;
+  }
+  unsigned char *sealed = malloc(encoded_len / 4 * 3 + 1);
+  if (sealed == NULL) {
+    return ERR_BUFFER_TOO_LARGE;
+  }
+  long sealed_len = base64_decode(sealed, encoded, encoded_len);
+  if (sealed_len < AEAD_OVERHEAD) {
+    free(sealed);
+    return sealed_len < 0 ? ERR_JSON_DECODE_FAILED : ERR_DECRYPT_FAILED;
+  }
+  size_t plaintext_len = (size_t)sealed_len - AEAD_OVERHEAD;
+  result = output_check(dataPtr, plaintext_len);
+  if (result == ERR_NONE &&
+      !open_sealed((unsigned char *)output_data(dataPtr), sealed,
+                   (size_t)sealed_len, partition, partition_len)) {
+    result = ERR_DECRYPT_FAILED;
+  }
+  free(sealed);
+  if (result == ERR_NONE) {
+    output_set_len(dataPtr, plaintext_len);
+  }
+  return result;
+}
+
+GoInt32 Encrypt(void *partitionIdPtr, void *dataPtr,
+                void *outputEncryptedDataPtr, void *outputEncryptedKeyPtr,
+                void *outputCreatedPtr, void *outputParentKeyIdPtr,
+                void *outputParentKeyCreatedPtr) {
+  const char *partition;
+  size_t partition_len;
+  const char *data;
+  size_t data_len;
+  GoInt32 result = input_span(partitionIdPtr, &partition, &partition_len);
+  if (result == ERR_NONE) {
+    result = input_span(dataPtr, &data, &data_len);
+  }
+  if (result != ERR_NONE) {
+    return result;
+  }
+  if (outputCreatedPtr == NULL || outputParentKeyCreatedPtr == NULL) {
+    return ERR_NULL_PTR;
+  }
+  if (!atomic_load(&initialized)) {
+    return ERR_NOT_INITIALIZED;
+  }
+
+  size_t key_id_len = 4 + partition_len + key_id_suffix_len;
+  if ((result = output_check(outputEncryptedDataPtr,
+                             data_len + AEAD_OVERHEAD)) != ERR_NONE ||
+      (result = output_check(outputEncryptedKeyPtr, ENCRYPTED_KEY_SIZE)) !=
+          ERR_NONE ||
+      (result = output_check(outputParentKeyIdPtr, key_id_len)) != ERR_NONE) {
+    return result;
+  }
+
+  seal((unsigned char *)output_data(outputEncryptedDataPtr), data, data_len,
+       partition, partition_len);
+  output_set_len(outputEncryptedDataPtr, data_len + AEAD_OVERHEAD);
+
+  encrypted_key((unsigned char *)output_data(outputEncryptedKeyPtr));
+  output_set_len(outputEncryptedKeyPtr, ENCRYPTED_KEY_SIZE);
+
+  // The config values are JSON-escaped, which only matters for names that
+  // need escaping
+  char *key_id = output_data(outputParentKeyIdPtr);
+  memcpy(key_id, "_IK_", 4);
+  memcpy(key_id + 4, partition, partition_len);
+  memcpy(key_id + 4 + partition_len, key_id_suffix, key_id_suffix_len);
+  output_set_len(outputParentKeyIdPtr, key_id_len);
+
+  GoInt64 created = created_now();
+  memcpy(outputCreatedPtr, &created, sizeof(created));
+  memcpy(outputParentKeyCreatedPtr, &created, sizeof(created));
+  return ERR_NONE;
+}
+
+GoInt32 Decrypt(void *partitionIdPtr, void *encryptedDataPtr,
+                void *encryptedKeyPtr, GoInt64 created, void *parentKeyIdPtr,
+                GoInt64 parentKeyCreated, void *outputDecryptedDataPtr) {
+  (void)created;
+  (void)parentKeyCreated;
+  const char *partition;
+  size_t partition_len;
+  const char *sealed;
+  size_t sealed_len;
+  const char *unused;
+  size_t unused_len;
+  GoInt32 result = input_span(partitionIdPtr, &partition, &partition_len);
+  if (result == ERR_NONE) {
+    result = input_span(encryptedDataPtr, &sealed, &sealed_len);
+  }
+  if (result == ERR_NONE) {
+    result = input_span(encryptedKeyPtr, &unused, &unused_len);
+  }
+  if (result == ERR_NONE) {
+    result = input_span(parentKeyIdPtr, &unused, &unused_len);
+  }
+  if (result != ERR_NONE) {
+    return result;
+  }
+  if (!atomic_load(&initialized)) {
+    return ERR_NOT_INITIALIZED;
+  }
+
+  if (sealed_len < AEAD_OVERHEAD) {
+    return ERR_DECRYPT_FAILED;
+  }
+  size_t plaintext_len = sealed_len - AEAD_OVERHEAD;
+  result = output_check(outputDecryptedDataPtr, plaintext_len);
+  if (result != ERR_NONE) {
+    return result;
+  }
+  if (!open_sealed((unsigned char *)output_data(outputDecryptedDataPtr),
+                   (const unsigned char *)sealed, sealed_len, partition,
+                   partition_len)) {
+    return ERR_DECRYPT_FAILED;
+  }
+  output_set_len(outputDecryptedDataPtr, plaintext_len);
+  return ERR_NONE;
+}
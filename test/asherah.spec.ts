@@ -5,17 +5,20 @@ import {
     asherah_setup,
     asherah_setup_static_memory,
     asherah_setup_static_memory_async,
+    asherah_set_env,
     asherah_shutdown,
     asherah_shutdown_async,
     AsherahConfig,
     assert_asherah_shutdown,
     assert_throws_async,
+    get_static_memory_config,
     test_round_trip_buffers,
     test_round_trip_buffers_async,
     test_round_trip_strings,
     test_round_trip_strings_async
 } from './asherah'
 import {
+    allocate,
     encrypt,
     encrypt_async,
     encrypt_string,
@@ -24,12 +27,46 @@ import {
     decrypt_string,
     encrypt_string_async,
     decrypt_string_async,
+    encrypt_into,
+    encrypt_into_async,
+    decrypt_into,
+    decrypt_into_async,
+    encrypt_batch,
+    encrypt_batch_async,
+    decrypt_batch,
+    decrypt_batch_async,
+    encrypt_many,
+    encrypt_many_async,
+    decrypt_many,
+    decrypt_many_async,
+    encrypt_record,
+    encrypt_record_async,
+    decrypt_record,
+    decrypt_record_async,
+    encrypt_binary,
+    encrypt_binary_async,
+    createEncryptStream,
+    createDecryptStream,
+    partition,
+    is_stub,
     setup,
+    get_setup_status,
+    get_metrics,
+    get_marshal_stats,
+    get_decrypt_cache_stats,
+    set_trace_enabled,
+    dump_trace,
+    set_log_hook,
+    set_max_stack_alloc_item_size,
     set_safety_padding_overhead,
     setenv
 } from '../dist/asherah'
 import { assert } from 'chai';
-import { get_string } from './helpers';
+import { get_string, posix_log_levels } from './helpers';
+import { Readable, Writable } from 'stream';
+import { pipeline } from 'stream/promises';
+import { once } from 'events';
+import { Worker } from 'worker_threads';
 
 const force_use_heap = 0;
 const test_verbose = true;
@@ -321,6 +358,633 @@ describe('Asherah', function () {
         assert_asherah_shutdown();
     });
 
+    it('Adaptive stack cutoff round trips varying payload sizes', function () {
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            // Negative values re-enable the adaptive cutoff
+            set_max_stack_alloc_item_size(-1);
+            // Enough samples to move the cutoff up and back down again
+            for (let i = 0; i < 600; i++) {
+                test_round_trip_strings(get_string(i < 300 ? 10000 : 16));
+            }
+            test_round_trip_buffers(Buffer.from(get_string(big_string_size), 'utf8'));
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('Adaptive stack cutoff moves allocations between stack and heap', function () {
+        this.timeout(30000);
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            set_max_stack_alloc_item_size(-1);
+            const payload = get_string(10000);
+            // Drives the cutoff with n encrypts of size, then counts where one
+            // 10KB encrypt's buffers were allocated
+            const allocations_after = (n: number, size: number) => {
+                const input = get_string(size);
+                for (let i = 0; i < n; i++) {
+                    encrypt_string('partition', input);
+                }
+                get_marshal_stats(true);
+                encrypt_string('partition', payload);
+                return get_marshal_stats(true).allocations;
+            };
+
+            // Small payloads keep the cutoff at its 2KB floor
+            const small = allocations_after(2000, 16);
+            // Mostly 10KB payloads raise it past them
+            const large = allocations_after(2000, 10000);
+            assert.isAbove(large.stack.count, small.stack.count);
+            assert.isBelow(large.heap.count + large.pooled.count, small.heap.count + small.pooled.count);
+            // And it comes back down when they stop
+            const small_again = allocations_after(2000, 16);
+            assert.equal(small_again.stack.count, small.stack.count);
+
+            // A pinned cutoff doesn't move
+            set_max_stack_alloc_item_size(1024);
+            assert.equal(allocations_after(2000, 10000).stack.count, allocations_after(0, 0).stack.count);
+        } finally {
+            set_max_stack_alloc_item_size(-1);
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('Right-sized outputs round trip every base64 padding and escaped partition', async function () {
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            const partitions = ['partition', 'p<&>"\\\u2028\u00e9\n'];
+            for (const partition of partitions) {
+                for (const size of [1, 2, 3, 4, 5, 6, 100, 1000, 4096, 1024 * 1024]) {
+                    const input = get_string(size);
+                    const drr = encrypt_string(partition, input);
+                    assert.equal(decrypt_string(partition, drr), input);
+                    assert.equal(decrypt(partition, drr).toString('utf8'), input);
+                    assert.equal(await decrypt_string_async(partition, await encrypt_string_async(partition, input)), input);
+                }
+            }
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('Round trip header-reserved allocate() buffers', async function () {
+        await asherah_setup_static_memory_async(test_verbose, false);
+        try {
+            for (const size of [0, 1, simple_secret.length, big_string_size]) {
+                const input = allocate(size);
+                assert.equal(input.length, size);
+                input.fill(0x61);
+                const expected = Buffer.from(input);
+
+                const encrypted = encrypt('partition', input);
+                assert.deepEqual(decrypt('partition', encrypted), expected);
+
+                const encrypted_async = await encrypt_async('partition', input);
+                assert.deepEqual(await decrypt_async('partition', encrypted_async), expected);
+
+                // The caller's data must be left untouched
+                assert.deepEqual(input, expected);
+            }
+
+            // Views of an allocate() buffer fall back to the copying path
+            const view = allocate(simple_secret.length * 2).subarray(4, 4 + simple_secret.length);
+            view.write(simple_secret, 'utf8');
+            const encrypted = encrypt('partition', view);
+            assert.equal(decrypt_string('partition', encrypted), simple_secret);
+        } finally {
+            await asherah_shutdown_async();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('allocate() rejects invalid sizes', function () {
+        assert.throws(() => allocate(-1), Error);
+        assert.throws(() => allocate('10' as any), Error);
+    });
+
+    it('encrypt_into / decrypt_into write into caller buffers', function () {
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            const slab = Buffer.alloc(4096);
+            const drr_length = encrypt_into('partition', simple_secret, slab, 16);
+            assert(drr_length > 0 && drr_length <= slab.length - 16);
+            const drr = slab.subarray(16, 16 + drr_length);
+            assert.equal(decrypt_string('partition', drr.toString('utf8')), simple_secret);
+
+            const plain = Buffer.alloc(64);
+            const plain_length = decrypt_into('partition', drr, plain, 8);
+            assert.equal(plain_length, simple_secret.length);
+            assert.equal(plain.subarray(8, 8 + plain_length).toString('utf8'), simple_secret);
+
+            // Too small: nothing is written and the required size comes back
+            const tiny = Buffer.alloc(4);
+            assert.equal(decrypt_into('partition', drr, tiny), simple_secret.length);
+            assert.deepEqual(tiny, Buffer.alloc(4));
+
+            assert.throws(() => decrypt_into('partition', drr, plain, plain.length + 1), Error);
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('encrypt_into_async / decrypt_into_async write into caller buffers', async function () {
+        await asherah_setup_static_memory_async(test_verbose, false);
+        try {
+            const slab = Buffer.alloc(4096);
+            const drr_length = await encrypt_into_async('partition', Buffer.from(simple_secret, 'utf8'), slab);
+            const drr = slab.subarray(0, drr_length);
+
+            const plain = Buffer.alloc(64);
+            const plain_length = await decrypt_into_async('partition', drr, plain, 32);
+            assert.equal(plain.subarray(32, 32 + plain_length).toString('utf8'), simple_secret);
+
+            assert.equal(await decrypt_into_async('partition', drr, Buffer.alloc(1)), simple_secret.length);
+        } finally {
+            await asherah_shutdown_async();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('Round trip with EnableDecryptSlabs', async function () {
+        asherah_set_env();
+        setup({ ...get_static_memory_config(test_verbose, false), EnableDecryptSlabs: true });
+        try {
+            const small = get_string(100);
+            const large = get_string(64 * 1024);
+            const small_drr = encrypt_string('partition', small);
+            const large_drr = encrypt_string('partition', large);
+
+            // Several small results share a slab and must stay intact
+            const results: Buffer[] = [];
+            for (let i = 0; i < 50; i++) {
+                results.push(decrypt('partition', small_drr));
+            }
+            results.push(decrypt('partition', large_drr));
+            results.push(await decrypt_async('partition', small_drr));
+            results.push(await decrypt_async('partition', large_drr));
+            assert.equal(decrypt_string('partition', small_drr), small);
+
+            for (let i = 0; i < 50; i++) {
+                assert.equal(results[i].toString('utf8'), small);
+            }
+            assert.equal(results[50].toString('utf8'), large);
+            assert.equal(results[51].toString('utf8'), small);
+            assert.equal(results[52].toString('utf8'), large);
+
+            // The dedicated ArrayBuffer behind a large result holds nothing
+            // past the plaintext but zeros (and no stale heap memory)
+            const view = results[52];
+            const tail = new Uint8Array(view.buffer, view.byteOffset + view.length);
+            assert.isAbove(tail.length, 0);
+            assert.isTrue(tail.every((byte) => byte === 0));
+
+            assert.throws(() => decrypt('wrong-partition', small_drr), Error);
+            assert.equal(decrypt('partition', small_drr).toString('utf8'), small);
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('encrypt_batch / decrypt_batch round trip in order', async function () {
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            const inputs = [simple_secret, Buffer.from(get_string(5000), 'utf8'), get_string(1), get_string(big_string_size)];
+            const expected = inputs.map((input) => input.toString());
+
+            const drrs = encrypt_batch('partition', inputs);
+            assert.equal(drrs.length, inputs.length);
+            assert.deepEqual(decrypt_batch('partition', drrs).map((b) => b.toString('utf8')), expected);
+            assert.equal(decrypt_string('partition', drrs[1]), expected[1]);
+
+            const async_drrs = await encrypt_batch_async('partition', inputs);
+            const async_plain = await decrypt_batch_async('partition', async_drrs.map((drr) => Buffer.from(drr, 'utf8')));
+            assert.deepEqual(async_plain.map((b) => b.toString('utf8')), expected);
+
+            assert.deepEqual(encrypt_batch('partition', []), []);
+            assert.throws(() => encrypt_batch('partition', 'not-an-array' as any), Error);
+            assert.throws(() => encrypt_batch('partition', [simple_secret, null as any]), Error);
+            assert.throws(() => decrypt_batch('partition', [drrs[0], 'garbage']), /item 1/);
+            await assert_throws_async(async () => { await decrypt_batch_async('wrong-partition', drrs); }, 'Expected decrypt_batch_async to fail');
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('Malformed DRRs fail before reaching Asherah', async function () {
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            const drr = encrypt_string('partition', simple_secret);
+            const bad_base64 = drr.replace(/"Data":"/, '"Data":"!');
+            const malformed = [drr.slice(0, drr.length - 1), drr + '{}', bad_base64, '[]', '{"Key":{"Created":1.5}}'];
+            for (const input of malformed) {
+                assert.throws(() => decrypt_string('partition', input), /JSON decode failed/);
+                assert.throws(() => decrypt('partition', Buffer.from(input)), /JSON decode failed/);
+                await decrypt_async('partition', input).then(
+                    () => assert.fail('Expected decrypt_async to reject'),
+                    (e) => assert.match(e.message, /JSON decode failed/));
+            }
+            assert.throws(() => decrypt_batch('partition', [drr, drr, bad_base64]), /item 2: Cobhan error: JSON decode failed/);
+            assert.equal(decrypt_string('partition', drr.replace('{', '{ "Unknown": [1, {"a": null}],')), simple_secret);
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('Round trip async on NativeThreadPoolSize threads', async function () {
+        asherah_set_env();
+        setup({ ...get_static_memory_config(test_verbose, false), NativeThreadPoolSize: 3 });
+        try {
+            const secrets = [];
+            for (let i = 0; i < 100; i++) {
+                secrets.push(get_string(1 + i * 97));
+            }
+            const drrs = await Promise.all(secrets.map((secret) => encrypt_string_async('partition', secret)));
+            const plaintexts = await Promise.all(drrs.map((drr) => decrypt_string_async('partition', drr)));
+            assert.deepEqual(plaintexts, secrets);
+            assert.deepEqual((await decrypt_batch_async('partition', drrs)).map((b) => b.toString('utf8')), secrets);
+            await assert_throws_async(async () => { await decrypt_async('wrong-partition', drrs[0]); }, 'Expected decrypt_async to fail');
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+        assert.throws(() => setup({ ...get_static_memory_config(test_verbose, false), NativeThreadPoolSize: -1 }), Error);
+        assert_asherah_shutdown();
+    });
+
+    it('encrypt_many / decrypt_many round trip mixed partitions in order', async function () {
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            const items = [];
+            for (let i = 0; i < 200; i++) {
+                items.push({ partition: 'partition-' + (i % 7), data: get_string(1 + (i * 37) % 3000) });
+            }
+
+            const drrs = encrypt_many(items);
+            assert.equal(drrs.length, items.length);
+            for (let i = 0; i < items.length; i += 23) {
+                assert.equal(decrypt_string(items[i].partition, drrs[i]), items[i].data);
+            }
+
+            const drr_items = items.map((item, i) => ({ partition: item.partition, data: drrs[i] }));
+            assert.deepEqual(decrypt_many(drr_items).map((b) => b.toString('utf8')), items.map((item) => item.data));
+
+            const async_drrs = await encrypt_many_async(items);
+            const async_items = items.map((item, i) => ({ partition: item.partition, data: Buffer.from(async_drrs[i], 'utf8') }));
+            const async_plain = await decrypt_many_async(async_items);
+            assert.deepEqual(async_plain.map((b) => b.toString('utf8')), items.map((item) => item.data));
+
+            // Swapping partitions fails; the lowest failing index is reported
+            const swapped = drr_items.map((item, i) => i >= 5 ? { partition: drr_items[(i + 1) % 200].partition, data: item.data } : item);
+            assert.throws(() => decrypt_many(swapped), /item 5/);
+            assert.throws(() => encrypt_many([{ partition: '', data: simple_secret }]), Error);
+            assert.throws(() => encrypt_many([simple_secret as any]), Error);
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('encrypt_record / decrypt_record round trip with binary fields', async function () {
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            const secret = Buffer.from(get_string(5000), 'utf8');
+            const record = encrypt_record('partition', secret);
+            assert.isTrue(Buffer.isBuffer(record.Data));
+            assert.equal(record.Data.length, secret.length + 28);
+            assert.isTrue(Buffer.isBuffer(record.Key.Key));
+            assert.isAbove(record.Key.Created, 0);
+            assert.include(record.Key.ParentKeyMeta.KeyId, 'partition');
+            assert.isTrue(decrypt_record('partition', record).equals(secret));
+
+            // Records carry the same fields as the JSON DRR
+            const drr = JSON.parse(encrypt_string('partition', simple_secret));
+            const from_json = {
+                Key: { ...drr.Key, Key: Buffer.from(drr.Key.Key, 'base64') },
+                Data: Buffer.from(drr.Data, 'base64')
+            };
+            assert.equal(decrypt_record('partition', from_json).toString('utf8'), simple_secret);
+
+            const async_record = await encrypt_record_async('partition', simple_secret);
+            assert.equal((await decrypt_record_async('partition', async_record)).toString('utf8'), simple_secret);
+
+            assert.throws(() => decrypt_record('wrong-partition', record), Error);
+            assert.throws(() => decrypt_record('partition', { ...record, Data: 'not a buffer' as any }), Error);
+            assert.throws(() => decrypt_record('partition', { Data: record.Data } as any), Error);
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('encrypt_binary envelopes decrypt alongside JSON DRRs', async function () {
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            const secret = get_string(1000);
+            const binary = encrypt_binary('partition', secret);
+            const json = encrypt_string('partition', secret);
+            assert.isBelow(binary.length, Buffer.byteLength(json));
+            assert.equal(binary[0], 0);
+
+            assert.equal(decrypt_string('partition', binary), secret);
+            assert.equal(decrypt('partition', json).toString('utf8'), secret);
+            assert.equal((await decrypt_async('partition', await encrypt_binary_async('partition', secret))).toString('utf8'), secret);
+            assert.deepEqual(decrypt_batch('partition', [binary, json, Buffer.from(json)]).map((b) => b.toString('utf8')), [secret, secret, secret]);
+
+            const small = encrypt_binary('partition', simple_secret);
+            assert.isBelow(small.length, 150);
+            assert.equal(decrypt_string('partition', small), simple_secret);
+
+            assert.throws(() => decrypt('partition', binary.subarray(0, binary.length - 1)), /binary envelope/);
+            assert.throws(() => decrypt('wrong-partition', binary), Error);
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('get_metrics reports latency by method and payload size', async function () {
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            get_metrics(true);
+            const drr = encrypt_string('partition', simple_secret);
+            encrypt_string('partition', get_string(5000));
+            await decrypt_string_async('partition', drr);
+            assert.throws(() => decrypt_string('partition', '[]'), Error);
+
+            const metrics = get_metrics(true);
+            assert.equal(metrics.encrypt_string.calls, 2);
+            assert.hasAllKeys(metrics.encrypt_string.sizes, ['256B', '64KB']);
+            const latency = metrics.encrypt_string.sizes['256B'];
+            assert.equal(latency.count, 1);
+            assert.isAbove(latency.max, 0);
+            assert.isAtMost(latency.p50, latency.max);
+            assert.equal(metrics.decrypt_string_async.calls, 1);
+            assert.equal(metrics.decrypt_string.errors['Cobhan error: JSON decode failed'], 1);
+            assert.notProperty(get_metrics(), 'encrypt_string');
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('get_marshal_stats counts allocations, copies and size estimates', async function () {
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            get_marshal_stats(true);
+            const drr = encrypt_string('partition', simple_secret);
+            const input = allocate(simple_secret.length);
+            input.write(simple_secret);
+            decrypt('partition', encrypt('partition', input));
+            assert.equal(decrypt_string('partition', drr), simple_secret);
+
+            const stats = get_marshal_stats(true);
+            const allocations = stats.allocations.stack.count + stats.allocations.heap.count +
+                stats.allocations.pooled.count;
+            assert.isAbove(allocations, 0);
+            assert.isAtLeast(stats.copies.in_string.bytes, simple_secret.length);
+            assert.equal(stats.copies.in_place.count, 1);
+            assert.equal(stats.copies.in_place.bytes, simple_secret.length);
+            assert.equal(stats.copies.out_buffer.bytes, simple_secret.length);
+            assert.equal(stats.estimates.encrypt.count, 2);
+            assert.equal(stats.estimates.decrypt.count, 2);
+            assert.isAtLeast(stats.estimates.encrypt.ratio, 1);
+            assert.equal(stats.estimates.encrypt.retries, 0);
+            assert.equal(get_marshal_stats().estimates.encrypt.count, 0);
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('dump_trace exports call phases as Chrome trace events', async function () {
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            set_trace_enabled(true);
+            dump_trace(true);
+            const drr = await encrypt_string_async('partition', simple_secret);
+            decrypt_string('partition', drr);
+            set_trace_enabled(false);
+            encrypt_string('partition', simple_secret);
+
+            const events: { ph: string, name: string }[] = JSON.parse(dump_trace(true)).traceEvents;
+            const spans = events.filter(e => e.ph === 'X').map(e => e.name);
+            for (const phase of ['encrypt_string_async', 'execute', 'asherah', 'complete', 'decrypt_string']) {
+                assert.include(spans, phase);
+            }
+            assert.notInclude(spans, 'encrypt_string');
+            assert.isTrue(events.some(e => e.ph === 'b' && e.name === 'queued'));
+            assert.isTrue(events.some(e => e.ph === 'f'));
+            assert.isFalse(JSON.parse(dump_trace()).traceEvents.some((e: { ph: string }) => e.ph === 'X'));
+        } finally {
+            set_trace_enabled(false);
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('DecryptCacheMaxBytes serves repeated decrypts from the cache', async function () {
+        setup({ ...get_static_memory_config(test_verbose, false), DecryptCacheMaxBytes: 1 << 20 });
+        try {
+            const drr = encrypt_string('partition', simple_secret);
+            assert.equal(decrypt_string('partition', drr), simple_secret);
+            assert.equal(decrypt_string('partition', drr), simple_secret);
+            assert.equal((await decrypt_async('partition', Buffer.from(drr))).toString(), simple_secret);
+            assert.throws(() => decrypt_string('other-partition', drr));
+
+            const stats = get_decrypt_cache_stats(true);
+            assert.isTrue(stats.enabled);
+            assert.equal(stats.hits, 2);
+            assert.equal(stats.misses, 2);
+            assert.equal(stats.entries, 1);
+            assert.equal(get_decrypt_cache_stats().hits, 0);
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+        assert.equal(get_decrypt_cache_stats().entries, 0);
+    });
+
+    it('DecryptCacheDuration sweeps expired entries on later lookups', async function () {
+        this.timeout(10000);
+        setup({ ...get_static_memory_config(test_verbose, false), DecryptCacheMaxBytes: 1 << 20, DecryptCacheDuration: 1 });
+        try {
+            const stale = encrypt_string('partition', simple_secret);
+            const fresh = encrypt_string('partition', simple_secret);
+            decrypt_string('partition', stale);
+            await new Promise((resolve) => setTimeout(resolve, 1100));
+            decrypt_string('partition', fresh);
+
+            const stats = get_decrypt_cache_stats();
+            assert.equal(stats.expirations, 1);
+            assert.equal(stats.entries, 1);
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('partition handles round trip and are interned by ID', async function () {
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            const handle = partition('partition');
+            assert.strictEqual(partition('partition'), handle);
+            assert.notStrictEqual(partition('other-partition'), handle);
+            assert.equal(handle.id, 'partition');
+            assert.throws(() => partition(''));
+
+            const drr = handle.encrypt(simple_secret);
+            assert.equal(decrypt_string('partition', drr), simple_secret);
+            assert.equal(handle.decrypt_string(encrypt_string('partition', simple_secret)), simple_secret);
+            assert.equal(handle.decrypt(drr).toString(), simple_secret);
+
+            const async_drr = await handle.encrypt_async(Buffer.from(simple_secret));
+            assert.equal((await handle.decrypt_async(async_drr)).toString(), simple_secret);
+            assert.equal(await handle.decrypt_string_async(drr), simple_secret);
+            assert.throws(() => partition('other-partition').decrypt(drr));
+            assert.equal(get_metrics()['partition.encrypt'].calls, 1);
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+        assert.throws(() => partition('partition').encrypt(simple_secret));
+    });
+
+    it('worker_threads share one setup, torn down by the last shutdown', async function () {
+        const config = get_static_memory_config(test_verbose, false);
+        setup(config);
+        try {
+            const worker = new Worker(`
+                const { parentPort, workerData } = require('worker_threads');
+                const asherah = require(workerData.addon);
+                let mismatch_rejected = false;
+                try {
+                    asherah.setup({ ...workerData.config, ServiceName: 'other-service' });
+                } catch (e) {
+                    mismatch_rejected = true;
+                }
+                asherah.setup({ ...workerData.config, NativeThreadPoolSize: 2 });
+                const drr = asherah.encrypt_string('partition', workerData.secret);
+                asherah.shutdown();
+                parentPort.postMessage({ drr, mismatch_rejected, status: asherah.get_setup_status() });
+            `, {
+                eval: true,
+                workerData: { addon: require.resolve('../dist/asherah.node'), config, secret: simple_secret }
+            });
+            const [message] = await once(worker, 'message');
+            assert.isTrue(message.mismatch_rejected);
+            assert.isFalse(message.status);
+            // The worker's shutdown left this thread's setup in place
+            assert.isTrue(get_setup_status());
+            assert.equal(decrypt_string('partition', message.drr), simple_secret);
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('set_log_hook receives debug messages in batches on the event loop', async function () {
+        const messages: [number, string][] = [];
+        set_log_hook((level: number, message: string) => {
+            messages.push([level, message]);
+        });
+        setup(get_static_memory_config(true, false));
+        try {
+            assert.lengthOf(messages, 0);
+            await new Promise(resolve => setImmediate(resolve));
+            assert.isTrue(messages.some(([level, message]) =>
+                level === posix_log_levels.debug && message.startsWith('asherah-node: EndSetupAsherah: Setup complete')));
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('set_log_hook exceptions become process warnings', async function () {
+        let calls = 0;
+        set_log_hook(() => {
+            calls++;
+            throw new Error('hook failed');
+        });
+        try {
+            const warning = once(process, 'warning');
+            setup(get_static_memory_config(true, false));
+            const [emitted] = await warning;
+            assert.equal(emitted.name, 'AsherahLogHookWarning');
+            assert.include(emitted.message, 'hook failed');
+
+            // The hook keeps getting messages after throwing
+            asherah_shutdown();
+            await new Promise(resolve => setImmediate(resolve));
+            assert.equal(calls, 2);
+        } finally {
+            set_log_hook(() => { /* discard */ });
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('createEncryptStream / createDecryptStream round trip through pipeline', async function () {
+        asherah_setup_static_memory(test_verbose, false);
+        try {
+            const collect = async (input: Buffer[], transform: NodeJS.ReadWriteStream): Promise<Buffer> => {
+                const output: Buffer[] = [];
+                await pipeline(Readable.from(input), transform, new Writable({
+                    write(chunk, _encoding, callback) { output.push(chunk); callback(); }
+                }));
+                return Buffer.concat(output);
+            };
+
+            // Uneven writes that straddle chunk boundaries
+            const payload = Buffer.from(get_string(300000), 'utf8');
+            const pieces = [];
+            for (let offset = 0, i = 0; offset < payload.length; i++) {
+                const size = 1 + (i * 7919) % 20000;
+                pieces.push(payload.subarray(offset, offset + size));
+                offset += size;
+            }
+            const encrypted = await collect(pieces, createEncryptStream('partition', { chunkSize: 4096 }));
+            assert.equal(encrypted.subarray(0, 4).toString('latin1'), 'AHS1');
+
+            // Re-split the ciphertext so frames arrive in pieces too
+            const encrypted_pieces = [];
+            for (let offset = 0; offset < encrypted.length; offset += 1000) {
+                encrypted_pieces.push(encrypted.subarray(offset, offset + 1000));
+            }
+            const decrypted = await collect(encrypted_pieces, createDecryptStream('partition'));
+            assert.isTrue(decrypted.equals(payload));
+
+            // One write spanning many batches
+            const whole = await collect([payload], createEncryptStream('partition', { chunkSize: 4096 }));
+            assert.isTrue((await collect([whole], createDecryptStream('partition'))).equals(payload));
+
+            const empty = await collect([], createEncryptStream('partition'));
+            assert.equal((await collect([empty], createDecryptStream('partition'))).length, 0);
+
+            // Truncated, tampered and wrong-partition streams fail
+            const last_frame = encrypted.lastIndexOf(Buffer.from('{"Key"')) - 4;
+            await assert_throws_async(async () => { await collect([encrypted.subarray(0, last_frame)], createDecryptStream('partition')); }, 'Expected truncated stream to fail');
+            await assert_throws_async(async () => { await collect([encrypted.subarray(0, encrypted.length - 3)], createDecryptStream('partition')); }, 'Expected partial frame to fail');
+            await assert_throws_async(async () => { await collect([Buffer.from('not a stream')], createDecryptStream('partition')); }, 'Expected bad magic to fail');
+            await assert_throws_async(async () => { await collect([encrypted], createDecryptStream('wrong-partition')); }, 'Expected wrong partition to fail');
+            assert.throws(() => createEncryptStream('partition', { chunkSize: 1 }), Error);
+            assert.throws(() => createEncryptStream(''), Error);
+        } finally {
+            asherah_shutdown();
+        }
+        assert_asherah_shutdown();
+    });
+
+    it('is_stub reports stub builds', function () {
+        assert.equal(is_stub, process.env.ASHERAH_STUB === '1');
+    });
+
     it('setenv accepts valid JSON', function () {
         assert.doesNotThrow(() => {
             setenv('{"FOO": "BAR"}');
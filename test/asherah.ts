@@ -25,7 +25,7 @@ import { posix_log_levels } from './helpers';
 // Re-export this so callers don't have to import Asherah directly
 export type { AsherahConfig }
 
-function get_static_memory_config(verbose: boolean, session_cache: boolean): AsherahConfig {
+export function get_static_memory_config(verbose: boolean, session_cache: boolean): AsherahConfig {
     return {
         KMS: 'test-debug-static',
         Metastore: 'test-debug-memory',
@@ -0,0 +1,97 @@
+// Checks every base64 kernel the CPU supports against the scalar one on
+// random and corrupted input.  Build with cmake -DASHERAH_BUILD_TESTS=ON
+// and run ctest.
+
+#include "base64.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void Check(bool ok, Base64::Kernel kernel, const char *what, size_t size) {
+  if (!ok) {
+    std::fprintf(stderr, "%s: %s differs from scalar (%zu bytes)\n",
+                 Base64::KernelName(kernel), what, size);
+    failures++;
+  }
+}
+
+// Compares decoding and validating encoded with kernel against scalar
+void CheckDecode(Base64::Kernel kernel, const std::string &encoded,
+                 const char *what) {
+  size_t size = encoded.size();
+  std::vector<char> expected(size + 1);
+  std::vector<char> actual(size + 1);
+  bool expected_ok =
+      Base64::Decode(Base64::Kernel::Scalar, encoded.data(), size,
+                     expected.data());
+  bool actual_ok = Base64::Decode(kernel, encoded.data(), size, actual.data());
+  Check(actual_ok == expected_ok, kernel, what, size);
+  if (expected_ok && actual_ok) {
+    size_t decoded = Base64::DecodedLength(encoded.data(), size);
+    Check(std::equal(expected.begin(), expected.begin() + decoded,
+                     actual.begin()),
+          kernel, what, size);
+  }
+  Check(Base64::Validate(kernel, encoded.data(), size) == expected_ok, kernel,
+        what, size);
+}
+
+void CheckKernel(Base64::Kernel kernel, std::mt19937 &random) {
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::vector<size_t> sizes;
+  for (size_t size = 0; size <= 600; size++) {
+    sizes.push_back(size);
+  }
+  sizes.push_back(4096);
+  sizes.push_back(65537);
+
+  for (size_t size : sizes) {
+    std::string plain(size, '\0');
+    for (char &c : plain) {
+      c = static_cast<char>(byte(random));
+    }
+
+    std::string expected(Base64::EncodedLength(size), '\0');
+    std::string encoded(Base64::EncodedLength(size), '\0');
+    Base64::Encode(Base64::Kernel::Scalar, plain.data(), size, &expected[0]);
+    Base64::Encode(kernel, plain.data(), size, &encoded[0]);
+    Check(encoded == expected, kernel, "Encode", size);
+    CheckDecode(kernel, encoded, "Decode");
+
+    if (encoded.empty()) {
+      continue;
+    }
+    // One bad character anywhere, including in and around the padding
+    static const char bad[] = {'*', '=', '-', '_', ' ', '\0', '\x80', '\xff'};
+    std::uniform_int_distribution<size_t> position(0, encoded.size() - 1);
+    for (char c : bad) {
+      std::string corrupted = encoded;
+      corrupted[position(random)] = c;
+      CheckDecode(kernel, corrupted, "corrupted Decode");
+    }
+    CheckDecode(kernel, encoded.substr(0, encoded.size() - 1),
+                "truncated Decode");
+  }
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 random(20240601);
+  for (auto kernel : {Base64::Kernel::Scalar, Base64::Kernel::Sse41,
+                      Base64::Kernel::Avx2, Base64::Kernel::Neon}) {
+    if (!Base64::Supported(kernel)) {
+      std::printf("%s: not supported, skipped\n", Base64::KernelName(kernel));
+      continue;
+    }
+    CheckKernel(kernel, random);
+    std::printf("%s: checked\n", Base64::KernelName(kernel));
+  }
+  return failures == 0 ? 0 : 1;
+}